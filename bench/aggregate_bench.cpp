@@ -0,0 +1,66 @@
+// $group throughput vs. scan threads, on a low- and a high-cardinality key.
+// Build: g++ bench/aggregate_bench.cpp -o bin/aggregate_bench -O3 -std=c++17 -Isrc -pthread
+// Usage: aggregate_bench [docs=10000000] [reps=3]
+#include "aggregation.hpp"
+#include "query_parser.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+
+using namespace fluxdb;
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+    size_t docs = argc > 1 ? std::stoull(argv[1]) : 10000000;
+    int reps = argc > 2 ? std::stoi(argv[2]) : 3;
+
+    fs::path dir = fs::temp_directory_path() / "fluxdb_aggregate_bench";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    {
+        Collection col("bench", dir.string());
+        for (size_t i = 0; i < docs; ++i) {
+            Document doc;
+            doc["city"] = std::make_shared<Value>("city_" + std::to_string(i % 100));
+            doc["user"] = std::make_shared<Value>(static_cast<int64_t>((i * 7919) % (docs / 10 + 1)));
+            doc["amount"] = std::make_shared<Value>(static_cast<double>((i * 31) % 1000) / 10.0);
+            col.insert(std::move(doc));
+        }
+
+        auto noRegex = [](const std::string&, bool) -> std::shared_ptr<const std::regex> { return nullptr; };
+        const std::pair<const char*, const char*> pipelines[] = {
+            { "100 groups", R"([{"$group": {"_id": "$city", "total": {"$sum": "$amount"}, "avg": {"$avg": "$amount"}, "n": {"$count": {}}}}])" },
+            { "docs/10 groups", R"([{"$group": {"_id": "$user", "total": {"$sum": "$amount"}, "hi": {"$max": "$amount"}}}])" },
+            { "filtered", R"([{"$match": {"amount": {"$gte": 50}}}, {"$group": {"_id": "$city", "n": {"$count": {}}}}])" },
+        };
+
+        size_t maxThreads = ThreadPool::instance().size();
+        std::cout << "docs=" << docs << " reps=" << reps << " pool=" << maxThreads << "\n";
+
+        for (const auto& [name, json] : pipelines) {
+            QueryParser parser(json);
+            Pipeline pipeline = Pipeline::parse(*parser.parseValue());
+
+            std::cout << name << "\n";
+            std::cout << "threads   ms/run    Mdocs/s   speedup   groups\n";
+            double base = 0;
+            for (size_t t = 1; t <= maxThreads; t *= 2) {
+                col.setScanThreads(t);
+                size_t groups = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (int r = 0; r < reps; ++r) groups = pipeline.run(col, noRegex).size();
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / reps;
+
+                if (t == 1) base = ms;
+                std::cout << std::setw(7) << t << std::setw(10) << std::fixed << std::setprecision(2) << ms
+                          << std::setw(10) << docs / ms / 1000.0 << std::setw(10) << base / ms << std::setw(9) << groups << "\n";
+                if (t < maxThreads && t * 2 > maxThreads) t = maxThreads / 2; // always end on the full pool
+            }
+        }
+    }
+
+    fs::remove_all(dir);
+    return 0;
+}
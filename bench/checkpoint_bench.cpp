@@ -0,0 +1,90 @@
+// Checkpoint cost against churn: N documents, of which the given share is updated between
+// two checkpoints. Times a full snapshot rewrite and an incremental segment of the same
+// state, then a restart from base + segment.
+// Build: g++ bench/checkpoint_bench.cpp -o bin/checkpoint_bench -O3 -std=c++17 -Isrc -pthread
+// Usage: checkpoint_bench [docs=1000000] [churn_percent=0.1] [dir=<temp>]
+#include "persistence_manager.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+
+using namespace fluxdb;
+namespace fs = std::filesystem;
+
+static Document makeRow(size_t i, int64_t version) {
+    Document doc;
+    doc["city"] = std::make_shared<Value>("city_" + std::to_string(i % 100));
+    doc["user"] = std::make_shared<Value>(static_cast<int64_t>((i * 7919) % 1000003));
+    doc["version"] = std::make_shared<Value>(version);
+    doc["note"] = std::make_shared<Value>("row " + std::to_string(i));
+    return doc;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    size_t docs = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    double churn = argc > 2 ? std::stod(argv[2]) : 0.1;
+    fs::path dir = argc > 3 ? fs::path(argv[3]) / "fluxdb_checkpoint_bench" : fs::temp_directory_path() / "fluxdb_checkpoint_bench";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string wal = (dir / "bench.wal").string(), snap = (dir / "bench.flux").string();
+
+    StorageEngine engine;
+    for (size_t i = 0; i < docs;) {
+        std::vector<std::pair<Id, Document>> batch;
+        for (size_t n = 0; n < 10000 && i < docs; ++n, ++i) batch.emplace_back(i + 1, makeRow(i, 0));
+        engine.insertMany(std::move(batch));
+    }
+    engine.createIndex("city", 0);
+
+    size_t changed = static_cast<size_t>(static_cast<double>(docs) * churn / 100.0);
+    double full = 0, segment = 0;
+    uint64_t segmentBytes = 0;
+    {
+        PersistenceManager pm(wal, snap);
+        pm.saveCheckpoint(engine.freeze()); // the base
+        engine.clearDirty();
+
+        for (size_t k = 0; k < changed; ++k) {
+            Id id = (k * 2654435761u) % docs + 1;
+            engine.update(id, makeRow(id - 1, 1));
+        }
+        StorageEngine::Frozen state = engine.freeze();
+
+        auto start = std::chrono::steady_clock::now();
+        pm.saveCheckpoint(state);
+        segment = secondsSince(start);
+        for (const auto& entry : fs::directory_iterator(dir)) {
+            if (entry.path().filename().string().rfind("bench.flux.", 0) == 0) segmentBytes += fs::file_size(entry.path());
+        }
+
+        // the same state as a full rewrite, into another directory so the chain stays intact
+        fs::create_directories(dir / "full");
+        PersistenceManager other((dir / "full" / "bench.wal").string(), (dir / "full" / "bench.flux").string());
+        start = std::chrono::steady_clock::now();
+        other.saveSnapshot(state);
+        full = secondsSince(start);
+    }
+
+    double load = 0;
+    {
+        auto start = std::chrono::steady_clock::now();
+        StorageEngine restarted;
+        PersistenceManager(wal, snap).recover(restarted);
+        load = secondsSince(start);
+    }
+
+    uint64_t fullBytes = fs::file_size(dir / "full" / "bench.flux");
+    std::cout << "docs=" << docs << " churn=" << churn << "% (" << changed << " updated)\n";
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "full snapshot  " << std::setw(8) << full << " s  " << std::setw(12) << fullBytes << " bytes\n";
+    std::cout << "segment        " << std::setw(8) << segment << " s  " << std::setw(12) << segmentBytes << " bytes\n";
+    std::cout << "restart (base + segment) " << load << " s\n";
+
+    fs::remove_all(dir);
+    return 0;
+}
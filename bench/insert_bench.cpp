@@ -0,0 +1,70 @@
+// Load throughput: one INSERT per row vs. INSERT_MANY batches (WAL on, one hash + one sorted index).
+// Build: g++ bench/insert_bench.cpp -o bin/insert_bench -O3 -std=c++17 -Isrc -pthread
+// Usage: insert_bench [rows=1000000] [batch=10000]
+#include "collection.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+
+using namespace fluxdb;
+namespace fs = std::filesystem;
+
+static Document makeRow(size_t i) {
+    Document doc;
+    doc["city"] = std::make_shared<Value>("city_" + std::to_string(i % 100));
+    doc["user"] = std::make_shared<Value>(static_cast<int64_t>((i * 7919) % 1000003));
+    doc["amount"] = std::make_shared<Value>(static_cast<double>((i * 31) % 1000) / 10.0);
+    doc["note"] = std::make_shared<Value>("row " + std::to_string(i));
+    return doc;
+}
+
+// rows/sec loading `rows` documents, batch == 0 = one insert() per row
+static double load(const fs::path& dir, size_t rows, size_t batch) {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    Collection col("bench", dir.string());
+    col.createIndex("city", 0);
+    col.createIndex("user", 1);
+
+    auto start = std::chrono::steady_clock::now();
+    if (batch == 0) {
+        for (size_t i = 0; i < rows; ++i) col.insert(makeRow(i));
+    } else {
+        for (size_t i = 0; i < rows; i += batch) {
+            std::vector<Document> docs;
+            docs.reserve(batch);
+            for (size_t j = i; j < std::min(rows, i + batch); ++j) docs.push_back(makeRow(j));
+            col.insertMany(std::move(docs));
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t loaded = col.countMatching([](const Document&) { return true; });
+    if (loaded != rows) std::cerr << "row count mismatch: " << loaded << "\n";
+    return rows / secs;
+}
+
+int main(int argc, char** argv) {
+    size_t rows = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    size_t batch = argc > 2 ? std::stoull(argv[2]) : 10000;
+
+    fs::path dir = fs::temp_directory_path() / "fluxdb_insert_bench";
+    std::cout << "rows=" << rows << "\n";
+    std::cout << "mode                  rows/s   speedup\n";
+
+    double base = load(dir, rows, 0);
+    std::cout << std::left << std::setw(18) << "INSERT" << std::right << std::setw(10) << std::fixed
+              << std::setprecision(0) << base << std::setw(10) << std::setprecision(2) << 1.0 << "\n";
+
+    for (size_t b : { batch / 10, batch, batch * 10 }) {
+        if (b == 0) continue;
+        double rate = load(dir, rows, b);
+        std::cout << std::left << std::setw(18) << ("INSERT_MANY " + std::to_string(b)) << std::right << std::setw(10)
+                  << std::setprecision(0) << rate << std::setw(10) << std::setprecision(2) << rate / base << "\n";
+    }
+
+    fs::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Point reads over a collection larger than its memory budget: YCSB-style Zipfian keys
+// (theta 0.99) against all-in-memory. "recent" makes the newest documents the hottest, so
+// the hot set sits on a few pages; "scattered" spreads it over every page, the worst case
+// for page-granular caching. Reports reads/s and how many reads went to the page file.
+// Build: g++ bench/paging_bench.cpp -o bin/paging_bench -O3 -std=c++17 -Isrc -pthread
+// Usage: paging_bench [docs=500000] [budget_percent=10] [reads=1000000] [dir=<temp>]
+#include "storage_engine.hpp"
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+
+using namespace fluxdb;
+namespace fs = std::filesystem;
+
+static Document makeRow(size_t i) {
+    Document doc;
+    doc["city"] = std::make_shared<Value>("city_" + std::to_string(i % 100));
+    doc["user"] = std::make_shared<Value>(static_cast<int64_t>((i * 7919) % 1000003));
+    doc["note"] = std::make_shared<Value>(std::string(64 + i % 64, 'a' + static_cast<char>(i % 26)));
+    return doc;
+}
+
+// Gray et al. / YCSB: rank 0 is the most popular of n
+class Zipfian {
+    size_t n;
+    double theta, alpha, zetan, eta;
+
+    static double zeta(size_t n, double theta) {
+        double sum = 0;
+        for (size_t i = 1; i <= n; ++i) sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+
+public:
+    Zipfian(size_t items, double t) : n(items), theta(t) {
+        zetan = zeta(n, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+    }
+
+    size_t next(std::mt19937_64& rng) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + std::pow(0.5, theta)) return 1;
+        size_t r = static_cast<size_t>(static_cast<double>(n) * std::pow(eta * u - eta + 1.0, alpha));
+        return std::min(r, n - 1);
+    }
+};
+
+int main(int argc, char** argv) {
+    size_t docs = argc > 1 ? std::stoull(argv[1]) : 500000;
+    double percent = argc > 2 ? std::stod(argv[2]) : 10;
+    size_t reads = argc > 3 ? std::stoull(argv[3]) : 1000000;
+    fs::path dir = argc > 4 ? fs::path(argv[4]) / "fluxdb_paging_bench" : fs::temp_directory_path() / "fluxdb_paging_bench";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string pages = (dir / "bench.pages").string();
+
+    StorageEngine engine;
+    for (size_t i = 0; i < docs;) {
+        std::vector<std::pair<Id, Document>> batch;
+        for (size_t n = 0; n < 10000 && i < docs; ++n, ++i) batch.emplace_back(i + 1, makeRow(i));
+        engine.insertMany(std::move(batch));
+    }
+    // the store's own estimate of the whole collection, with a budget nothing is evicted under
+    engine.setMemoryBudget(pages, SIZE_MAX / 2);
+    size_t total = engine.documents().residentBytes();
+    size_t budget = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(total) * percent / 100.0));
+
+    std::cout << "docs: " << docs << ", ~" << total / (1024 * 1024) << " MB in memory, budget "
+              << percent << "% = " << budget / (1024 * 1024) << " MB, " << reads << " Zipfian reads\n\n";
+    std::cout << std::left << std::setw(12) << "keys" << std::setw(12) << "budget"
+              << std::right << std::setw(14) << "reads/s" << std::setw(14) << "disk reads" << std::setw(12) << "resident\n";
+
+    Zipfian zipf(docs, 0.99);
+    for (const char* mapping : { "recent", "scattered" }) {
+        bool recent = std::string(mapping) == "recent";
+        auto idOf = [&](size_t rank) -> Id {
+            if (recent) return docs - rank;
+            return (rank * 2654435761ull) % docs + 1; // a permutation (docs not a multiple of it)
+        };
+        for (bool paged : { false, true }) {
+            engine.setMemoryBudget(pages, paged ? budget : 0);
+            uint64_t before = engine.documents().paged() ? engine.documents().pageFile()->reads.load() : 0;
+
+            std::mt19937_64 rng(42);
+            size_t found = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < reads; ++i) {
+                DocumentStore::Hold hold;
+                if (engine.get(idOf(zipf.next(rng)), hold)) found++;
+                if (engine.wantsTrim()) engine.trim(); // what Collection::relieve() does
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            uint64_t pageReads = paged ? engine.documents().pageFile()->reads.load() - before : 0;
+
+            std::cout << std::left << std::setw(12) << mapping << std::setw(12) << (paged ? "paged" : "all")
+                      << std::right << std::setw(14) << static_cast<uint64_t>(static_cast<double>(reads) / seconds)
+                      << std::setw(14) << pageReads
+                      << std::setw(10) << (paged ? engine.documents().residentBytes() / (1024 * 1024) : total / (1024 * 1024)) << " MB"
+                      << (found == reads ? "" : "  (missing documents!)") << "\n";
+        }
+    }
+    std::cout << "\n" << engine.pagingJson() << "\n";
+
+    engine.setMemoryBudget(pages, 0);
+    fs::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Predicate evaluation: compiled QueryProgram vs. the per-document interpreter it replaced.
+// Build: g++ bench/predicate_bench.cpp -o bin/predicate_bench -O3 -std=c++17 -Isrc
+// Usage: predicate_bench [docs=200000] [reps=10]
+#include "query_program.hpp"
+#include "query_parser.hpp"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+
+using namespace fluxdb;
+
+// Reference: what QueryProcessor::matches/checkCondition did per document (string ops, Value operators)
+static bool interpret(const Value& val, const Value& constraint) {
+    if (constraint.type != Type::Object) return val == constraint;
+    for (const auto& [op, criterion] : constraint.asObject()) {
+        if (!criterion) continue;
+        const Value& crit = *criterion;
+        if (op == "$gt") { if (!(val > crit)) return false; }
+        else if (op == "$lt") { if (!(val < crit)) return false; }
+        else if (op == "$gte") { if (!(val >= crit)) return false; }
+        else if (op == "$lte") { if (!(val <= crit)) return false; }
+        else if (op == "$ne") { if (val == crit) return false; }
+        else if (op == "$prefix") {
+            if (val.type != Type::String || crit.type != Type::String ||
+                val.asString().compare(0, crit.asString().size(), crit.asString()) != 0) return false;
+        }
+    }
+    return true;
+}
+
+static bool interpretDoc(const Document& doc, const Document& query) {
+    for (const auto& [key, constraint] : query) {
+        if (!constraint) continue;
+        auto it = doc.find(key);
+        if (it == doc.end() || !interpret(*it->second, *constraint)) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::stoull(argv[1]) : 200000;
+    int reps = argc > 2 ? std::stoi(argv[2]) : 10;
+
+    std::mt19937_64 rng(42);
+    std::vector<Document> docs(n);
+    for (size_t i = 0; i < n; ++i) {
+        docs[i]["age"] = std::make_shared<Value>(static_cast<int64_t>(rng() % 100));
+        docs[i]["score"] = std::make_shared<Value>(static_cast<double>(rng() % 10000) / 100.0);
+        docs[i]["city"] = std::make_shared<Value>("city_" + std::to_string(rng() % 50));
+        docs[i]["active"] = std::make_shared<Value>(rng() % 2 == 0);
+    }
+
+    const char* queries[] = {
+        R"({"age": {"$gt": 30, "$lte": 60}})",
+        R"({"age": {"$gte": 18}, "score": {"$lt": 50.5}, "active": true})",
+        R"({"city": "city_7", "age": {"$ne": 40}})",
+        R"({"city": {"$prefix": "city_1"}, "score": {"$gt": 10}})",
+    };
+
+    auto noRegex = [](const std::string&, bool) { return std::shared_ptr<const std::regex>(); };
+
+    std::cout << "docs=" << n << " reps=" << reps << "\n";
+    std::cout << std::left << std::setw(60) << "query" << std::right
+              << std::setw(12) << "interp ns" << std::setw(12) << "compiled ns" << std::setw(10) << "speedup\n";
+
+    for (const char* text : queries) {
+        QueryParser parser(text);
+        Document query = parser.parseJSON();
+        QueryProgram program = QueryProgram::compile(query, noRegex);
+
+        size_t a = 0, b = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; ++r)
+            for (const auto& d : docs) a += interpretDoc(d, query);
+        auto t1 = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; ++r)
+            for (const auto& d : docs) b += program.matches(d);
+        auto t2 = std::chrono::steady_clock::now();
+
+        if (a != b) {
+            std::cerr << "MISMATCH on " << text << ": " << a << " vs " << b << "\n";
+            return 1;
+        }
+        double evals = static_cast<double>(n) * reps;
+        double ni = std::chrono::duration<double, std::nano>(t1 - t0).count() / evals;
+        double nc = std::chrono::duration<double, std::nano>(t2 - t1).count() / evals;
+        std::cout << std::left << std::setw(60) << text << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << ni << std::setw(12) << nc << std::setw(9) << ni / nc << "x\n";
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+// Unindexed scan latency vs. scan threads.
+// Build: g++ bench/scan_bench.cpp -o bin/scan_bench -O3 -std=c++17 -Isrc -pthread
+// Usage: scan_bench [docs=1000000] [reps=5]
+#include "collection.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+
+using namespace fluxdb;
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+    size_t docs = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    int reps = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    fs::path dir = fs::temp_directory_path() / "fluxdb_scan_bench";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    {
+        Collection col("bench", dir.string());
+        for (size_t i = 0; i < docs; ++i) {
+            Document doc;
+            doc["n"] = std::make_shared<Value>(static_cast<int64_t>(i));
+            doc["score"] = std::make_shared<Value>(static_cast<double>((i * 7919) % 1000));
+            doc["tag"] = std::make_shared<Value>("user_" + std::to_string(i % 100));
+            col.insert(std::move(doc));
+        }
+
+        // ~1% selectivity, same shape as {"score": {"$gt": 989}, "tag": "user_42"} minus the parser
+        auto predicate = [](const Document& doc) {
+            auto s = doc.find("score");
+            auto t = doc.find("tag");
+            return s != doc.end() && s->second->getNumeric() > 989 &&
+                   t != doc.end() && t->second->asString() == "user_42";
+        };
+
+        size_t maxThreads = ThreadPool::instance().size();
+        std::cout << "docs=" << docs << " reps=" << reps << " pool=" << maxThreads << "\n";
+        std::cout << "threads   ms/scan   speedup   matches\n";
+
+        double base = 0;
+        for (size_t t = 1; t <= maxThreads; t *= 2) {
+            col.setScanThreads(t);
+            col.findAll(predicate); // warm up
+
+            size_t matches = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < reps; ++r) matches = col.findAll(predicate).size();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / reps;
+
+            if (t == 1) base = ms;
+            std::cout << std::setw(7) << t << std::setw(10) << std::fixed << std::setprecision(2) << ms
+                      << std::setw(10) << base / ms << std::setw(10) << matches << "\n";
+            if (t < maxThreads && t * 2 > maxThreads) t = maxThreads / 2; // always end on the full pool
+        }
+
+        col.setScanThreads(maxThreads);
+        auto start = std::chrono::steady_clock::now();
+        size_t got = col.findAll(predicate, 10).size();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "limit 10: " << got << " rows in " << ms << " ms\n";
+    }
+
+    fs::remove_all(dir);
+    return 0;
+}
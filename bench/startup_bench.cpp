@@ -0,0 +1,81 @@
+// Startup time: loads a snapshot of N documents (one hash + one sorted index) the way a
+// restart does, with the block index (parallel decode), without it (one block, the layout
+// older snapshots have) and with LZ4-compressed blocks.
+// Build: g++ bench/startup_bench.cpp -o bin/startup_bench -O3 -std=c++17 -Isrc -pthread
+// Usage: startup_bench [docs=1000000] [dir=<temp>]   (10M docs need ~6 GB of RAM)
+#include "persistence_manager.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+
+using namespace fluxdb;
+namespace fs = std::filesystem;
+
+static Document makeRow(size_t i) {
+    Document doc;
+    doc["city"] = std::make_shared<Value>("city_" + std::to_string(i % 100));
+    doc["user"] = std::make_shared<Value>(static_cast<int64_t>((i * 7919) % 1000003));
+    doc["amount"] = std::make_shared<Value>(static_cast<double>((i * 31) % 1000) / 10.0);
+    doc["note"] = std::make_shared<Value>("row " + std::to_string(i));
+    return doc;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    size_t docs = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    fs::path dir = argc > 2 ? fs::path(argv[2]) / "fluxdb_startup_bench" : fs::temp_directory_path() / "fluxdb_startup_bench";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string snap = (dir / "bench.flux").string(), plain = (dir / "plain.flux").string(), packed = (dir / "lz4.flux").string();
+
+    {
+        StorageEngine engine;
+        for (size_t i = 0; i < docs;) {
+            std::vector<std::pair<Id, Document>> batch;
+            for (size_t n = 0; n < 10000 && i < docs; ++n, ++i) batch.emplace_back(i + 1, makeRow(i));
+            engine.insertMany(std::move(batch));
+        }
+        engine.createIndex("city", 0);
+        engine.createIndex("user", 1);
+
+        auto start = std::chrono::steady_clock::now();
+        PersistenceManager((dir / "bench.wal").string(), snap).saveSnapshot(engine.freeze());
+        std::cout << "save         " << std::fixed << std::setprecision(2) << secondsSince(start) << " s\n";
+
+        PersistenceManager lz4((dir / "lz4.wal").string(), packed);
+        lz4.setCompression(true);
+        start = std::chrono::steady_clock::now();
+        lz4.saveSnapshot(engine.freeze());
+        std::cout << "save lz4     " << secondsSince(start) << " s\n";
+    }
+
+    // same file cut before the block index: footer gone, records and index trailer intact
+    {
+        std::ifstream in(snap, std::ios::binary);
+        uint64_t indexAt = 0;
+        in.seekg(-16, std::ios::end);
+        in.read(reinterpret_cast<char*>(&indexAt), sizeof(indexAt));
+        in.seekg(0);
+        std::vector<char> head(indexAt);
+        in.read(head.data(), head.size());
+        std::ofstream(plain, std::ios::binary).write(head.data(), head.size());
+    }
+
+    std::cout << "docs=" << docs << " snapshot=" << fs::file_size(snap) / (1 << 20) << "MB lz4=" << fs::file_size(packed) / (1 << 20)
+              << "MB (" << static_cast<double>(fs::file_size(snap)) / fs::file_size(packed) << "x) threads=" << ThreadPool::instance().size() << "\n";
+    for (const auto& [name, file] : { std::pair<const char*, std::string>{ "block index", snap }, { "single block", plain }, { "lz4 blocks", packed } }) {
+        auto start = std::chrono::steady_clock::now();
+        StorageEngine engine;
+        PersistenceManager((dir / "none.wal").string(), file).recover(engine);
+        double secs = secondsSince(start);
+        std::cout << std::left << std::setw(13) << name << std::right << std::setprecision(2) << secs << " s  "
+                  << std::setprecision(0) << engine.size() / secs << " docs/s\n";
+    }
+
+    fs::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,68 @@
+// Insert throughput vs. concurrent writers for each WAL durability mode (group commit).
+// Build: g++ bench/wal_bench.cpp -o bin/wal_bench -O3 -std=c++17 -Isrc -pthread
+// Usage: wal_bench [rows_per_writer=2000] [dir=<temp>]   (point dir at the disk you care about)
+#include "collection.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+
+using namespace fluxdb;
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+    size_t rows = argc > 1 ? std::stoull(argv[1]) : 2000;
+    fs::path dir = argc > 2 ? fs::path(argv[2]) / "fluxdb_wal_bench" : fs::temp_directory_path() / "fluxdb_wal_bench";
+
+    struct Mode { const char* name; Durability level; unsigned ms; };
+    const Mode modes[] = { { "none", Durability::None, 0 }, { "10ms", Durability::Interval, 10 }, { "commit", Durability::Commit, 0 } };
+
+    std::cout << "rows/writer=" << rows << "\n";
+    std::cout << "mode     writers      rows/s   records/batch\n";
+
+    for (const auto& mode : modes) {
+        for (size_t writers : { 1, 2, 4, 8, 16, 32 }) {
+            fs::remove_all(dir);
+            fs::create_directories(dir);
+
+            double secs;
+            std::string wal;
+            {
+                Collection col("bench", dir.string());
+                col.setDurability(mode.level, mode.ms);
+
+                auto start = std::chrono::steady_clock::now();
+                std::vector<std::thread> threads;
+                for (size_t w = 0; w < writers; ++w) {
+                    threads.emplace_back([&, w] {
+                        for (size_t i = 0; i < rows; ++i) {
+                            Document doc;
+                            doc["writer"] = std::make_shared<Value>(static_cast<int64_t>(w));
+                            doc["seq"] = std::make_shared<Value>(static_cast<int64_t>(i));
+                            col.insert(std::move(doc));
+                        }
+                    });
+                }
+                for (auto& t : threads) t.join();
+                secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                wal = col.getStats();
+            }
+
+            // "appends": n, "batches": m from the wal stats
+            auto field = [&](const std::string& key) {
+                size_t at = wal.find("\"" + key + "\": ", wal.find("\"wal\""));
+                return at == std::string::npos ? 0.0 : std::stod(wal.substr(at + key.size() + 4));
+            };
+            double batches = field("batches");
+
+            std::cout << std::left << std::setw(9) << mode.name << std::right << std::setw(7) << writers
+                      << std::setw(12) << std::fixed << std::setprecision(0) << writers * rows / secs
+                      << std::setw(16) << std::setprecision(1);
+            if (batches > 0) std::cout << field("appends") / batches << "\n";
+            else std::cout << "-" << "\n"; // nothing written yet (non-commit modes don't wait)
+        }
+    }
+
+    fs::remove_all(dir);
+    return 0;
+}
@@ -1,5 +1,6 @@
 import socket
 import json
+import struct
 import time
 from typing import Optional, List, Dict, Any, Union, Callable
 
@@ -113,6 +114,15 @@ class FluxDB:
         print(f"Insert Failed: {resp}")
         return None
 
+    def insert_many(self, documents: List[Dict[str, Any]]) -> List[int]:
+        """Inserts a batch in one round trip (one WAL write). Returns the new IDs."""
+        resp = self._send_command(f"INSERT_MANY {json.dumps(documents)}")
+        if "IDS=" in resp:
+            first, last = resp.split("IDS=")[1].split("-")
+            return list(range(int(first), int(last) + 1))
+        print(f"Insert Failed: {resp}")
+        return []
+
     def get(self, query: Union[int, str] = "") -> Union[Dict, List[Dict], None]:
         """
         Get by ID, Range, or Dump all.
@@ -134,25 +144,102 @@ class FluxDB:
             
         return None
 
-    def find(self, query: Dict[str, Any]) -> List[Dict]:
+    def find(self, query: Dict[str, Any], fields: Optional[List[str]] = None,
+             limit: Optional[int] = None, sort: Optional[List[tuple]] = None,
+             skip: Optional[int] = None) -> List[Dict]:
         """
         Search with Smart Logic ($gt, $lt, $ne).
         Example: db.find({"age": {"$gt": 18}})
+        Projection: db.find({"age": {"$gt": 18}}, fields=["name"])
+        Paging: db.find({}, sort=[("created_at", -1)], skip=20, limit=10)
         """
         json_str = json.dumps(query)
-        resp = self._send_command(f"FIND {json_str}")
+        cmd = f"FIND {json_str}"
+        options: Dict[str, Any] = {}
+        if fields:
+            options["fields"] = fields
+        if sort:
+            options["sort"] = [{field: direction} for field, direction in sort]
+        if skip:
+            options["skip"] = skip
+        if limit is not None:
+            options["limit"] = limit
+        if options:
+            cmd += " " + json.dumps(options)
+        resp = self._send_command(cmd)
         
         if resp.startswith("OK COUNT="):
             return self._parse_multi_line_response(resp)
             
         return []
 
+    def prepare(self, name: str, query: str, options: Optional[Dict[str, Any]] = None) -> bool:
+        """
+        Prepares a FIND template; placeholders are bare $1..$n in the query text.
+        Example: db.prepare("adults", '{"age": {"$gt": $1}}', {"limit": 10})
+        """
+        cmd = f"PREPARE {name} {query}"
+        if options:
+            cmd += " " + json.dumps(options)
+        resp = self._send_command(cmd)
+        return resp.startswith("OK PREPARED")
+
+    def execute(self, name: str, params: Optional[List[Any]] = None) -> List[Dict]:
+        """Runs a prepared FIND with its parameters bound: db.execute("adults", [18])."""
+        resp = self._send_command(f"EXECUTE {name} {json.dumps(params or [])}")
+        if resp.startswith("OK COUNT="):
+            return self._parse_multi_line_response(resp)
+        return []
+
+    def count(self, query: Optional[Dict[str, Any]] = None) -> int:
+        """Number of matching documents (no documents are sent back)."""
+        cmd = "COUNT" if not query else f"COUNT {json.dumps(query)}"
+        resp = self._send_command(cmd)
+        if resp.startswith("OK COUNT="):
+            return int(resp.split("=")[1])
+        return 0
+
+    def distinct(self, field: str, query: Optional[Dict[str, Any]] = None) -> List[Any]:
+        """Distinct values of a field, optionally among documents matching query."""
+        cmd = f"DISTINCT {field}" if not query else f"DISTINCT {field} {json.dumps(query)}"
+        resp = self._send_command(cmd)
+        if resp.startswith("OK ["):
+            try:
+                return json.loads(resp[3:])
+            except:
+                pass
+        return []
+
+    def aggregate(self, pipeline: List[Dict[str, Any]]) -> List[Dict]:
+        """
+        Runs an aggregation pipeline, one dict per result row.
+        Example: db.aggregate([{"$match": {"age": {"$gt": 18}}},
+                               {"$group": {"_id": "$city", "n": {"$count": {}}}}])
+        """
+        resp = self._send_command(f"AGGREGATE {json.dumps(pipeline)}")
+        rows = []
+        if resp.startswith("OK COUNT="):
+            for line in resp.split('\n')[1:]:
+                try:
+                    rows.append(json.loads(line))
+                except:
+                    continue
+        return rows
+
     def update(self, doc_id: int, document: Dict[str, Any]) -> bool:
         """Updates a document by ID."""
         json_str = json.dumps(document)
         resp = self._send_command(f"UPDATE {doc_id} {json_str}")
         return resp == "OK UPDATED"
 
+    def update_many(self, documents: Dict[int, Dict[str, Any]]) -> int:
+        """Replaces several documents by ID in one batch. Returns how many existed."""
+        batch = [{"_id": doc_id, **doc} for doc_id, doc in documents.items()]
+        resp = self._send_command(f"UPDATE_MANY {json.dumps(batch)}")
+        if resp.startswith("OK UPDATED="):
+            return int(resp.split("=")[1])
+        return 0
+
     def delete(self, doc_id: int) -> bool:
         """Deletes a document by ID."""
         resp = self._send_command(f"DELETE {doc_id}")
@@ -189,6 +276,65 @@ class FluxDB:
         resp = self._send_command(f"CONFIG PUBSUB {val}")
         return "PUBSUB=ON" in resp
 
+    def set_result_cache(self, megabytes: int) -> bool:
+        """Sizes the FIND result cache of the current database (0 turns it off)."""
+        resp = self._send_command(f"CONFIG RESULT_CACHE {megabytes}")
+        return resp.startswith("OK CONFIG_UPDATED RESULT_CACHE=")
+
+    def set_durability(self, mode: Union[str, int]) -> bool:
+        """WAL durability of the current database: "NONE", "COMMIT" or a sync interval in ms."""
+        resp = self._send_command(f"CONFIG DURABILITY {str(mode).upper()}")
+        return resp.startswith("OK CONFIG_UPDATED DURABILITY=")
+
+    def set_compression(self, codec: str) -> bool:
+        """Compression of new snapshots and WAL batches of the current database: "LZ4" or "NONE"."""
+        resp = self._send_command(f"CONFIG COMPRESSION {codec.upper()}")
+        return resp.startswith("OK CONFIG_UPDATED COMPRESSION=")
+
+    def set_memory_budget(self, megabytes: int) -> bool:
+        """Keeps about this many MB of the current database's documents in memory, cold pages on disk (0 = all in memory)."""
+        resp = self._send_command(f"CONFIG MEMORY {megabytes}")
+        return resp.startswith("OK CONFIG_UPDATED MEMORY=")
+
+    def export(self) -> List[Dict]:
+        """
+        Every document of the current database in one binary transfer (EXPORT).
+        Skips JSON on both ends, so it is the fast way to read a whole collection.
+        """
+        if not self.sock:
+            raise Exception("Not connected to database")
+
+        self.sock.sendall(b"EXPORT\n")
+        self.sock.settimeout(5.0)
+        data = bytearray()
+        while b"\n" not in data:
+            chunk = self.sock.recv(65536)
+            if not chunk: return []
+            data += chunk
+        end = data.index(b"\n")
+        head = data[:end].decode('utf-8', errors='ignore')
+        if not head.startswith("OK EXPORT"):
+            print(f"Export Failed: {head}")
+            return []
+
+        # records: id | size | doc (varints), a 0 id ends the stream
+        results = []
+        pos = end + 1
+        while True:
+            record = self._read_record(data, pos)
+            if record is None:
+                chunk = self.sock.recv(65536)
+                if not chunk: break
+                del data[:pos]
+                pos = 0
+                data += chunk
+                continue
+            doc_id, doc, pos = record
+            if doc_id == 0: break
+            doc["_id"] = doc_id
+            results.append(doc)
+        return results
+
     # --- 📡 PUB/SUB ---
 
     def publish(self, channel: str, message: str) -> int:
@@ -241,6 +387,73 @@ class FluxDB:
 
     # --- INTERNAL HELPERS ---
 
+    @staticmethod
+    def _read_varint(data: bytearray, pos: int):
+        """(value, next pos), or None if the buffer ends first."""
+        value, shift = 0, 0
+        while pos < len(data):
+            b = data[pos]
+            pos += 1
+            value |= (b & 0x7F) << shift
+            if not b & 0x80:
+                return value, pos
+            shift += 7
+        return None
+
+    def _read_record(self, data: bytearray, pos: int):
+        """(id, doc, next pos) of an EXPORT record, or None if it is not all in the buffer yet."""
+        head = self._read_varint(data, pos)
+        if head is None: return None
+        doc_id, pos = head
+        if doc_id == 0: return 0, None, pos
+        head = self._read_varint(data, pos)
+        if head is None: return None
+        size, pos = head
+        if len(data) - pos < size: return None
+        doc, _ = self._decode_document(bytes(data[pos:pos + size]), 0)
+        return doc_id, doc, pos + size
+
+    def _decode_document(self, buf: bytes, pos: int):
+        """Storage encoding v2: count | { key | value }, counts and lengths as varints."""
+        count, pos = self._read_varint(buf, pos)
+        doc = {}
+        for _ in range(count):
+            length, pos = self._read_varint(buf, pos)
+            key = buf[pos:pos + length].decode('utf-8')
+            doc[key], pos = self._decode_value(buf, pos + length)
+        return doc, pos
+
+    def _decode_value(self, buf: bytes, pos: int):
+        """One tagged value: 0x80+ small int, 0x40+ short string, else a type tag and its payload."""
+        tag = buf[pos]
+        pos += 1
+        if tag & 0x80:
+            return tag & 0x7F, pos
+        if tag & 0x40:
+            length = tag & 0x3F
+            return buf[pos:pos + length].decode('utf-8'), pos + length
+        if tag in (0x00, 0x07): # int / double holding an integer, zig-zag varint
+            raw, pos = self._read_varint(buf, pos)
+            value = (raw >> 1) ^ -(raw & 1)
+            return (value if tag == 0x00 else float(value)), pos
+        if tag == 0x01:
+            return struct.unpack_from('<d', buf, pos)[0], pos + 8
+        if tag in (0x02, 0x03):
+            return tag == 0x03, pos
+        if tag == 0x04:
+            length, pos = self._read_varint(buf, pos)
+            return buf[pos:pos + length].decode('utf-8'), pos + length
+        if tag == 0x05:
+            return self._decode_document(buf, pos)
+        if tag == 0x06:
+            count, pos = self._read_varint(buf, pos)
+            items = []
+            for _ in range(count):
+                item, pos = self._decode_value(buf, pos)
+                items.append(item)
+            return items, pos
+        raise ValueError(f"Unknown type tag {tag}")
+
     def _parse_multi_line_response(self, resp: str) -> List[Dict]:
         """Parses the 'ID <id> <json>' format into a list of dicts."""
         results = []
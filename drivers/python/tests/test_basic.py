@@ -1,3 +1,14 @@
+import json
+import math
+import os
+import random
+import re
+import shutil
+import socket
+import struct
+import subprocess
+import tempfile
+import time
 import unittest
 from unittest.mock import MagicMock, patch
 from typing import Union, List, Dict, Any, Optional
@@ -50,6 +61,42 @@ class TestFluxDB(unittest.TestCase):
         if doc:
             self.assertEqual(doc["name"], "Bob")
 
+    def test_find_projection(self):
+        self.db._send_command = MagicMock(return_value="OK COUNT=1\nID 2 {\"name\": \"Bob\"}")
+        result = self.db.find({"age": {"$gt": 20}}, fields=["name"])
+        self.db._send_command.assert_called_once_with('FIND {"age": {"$gt": 20}} {"fields": ["name"]}')
+        self.assertEqual(result, [{"name": "Bob", "_id": 2}])
+
+    def test_find_sorted_page(self):
+        self.db._send_command = MagicMock(return_value="OK COUNT=1\nID 7 {\"created_at\": 99}")
+        result = self.db.find({}, sort=[("created_at", -1)], skip=20, limit=10)
+        self.db._send_command.assert_called_once_with(
+            'FIND {} {"sort": [{"created_at": -1}], "skip": 20, "limit": 10}')
+        self.assertEqual(result, [{"created_at": 99, "_id": 7}])
+
+    def test_count_and_distinct(self):
+        self.db._send_command = MagicMock(side_effect=["OK COUNT=42", 'OK ["a", "b"]'])
+        self.assertEqual(self.db.count({"age": {"$gt": 20}}), 42)
+        self.assertEqual(self.db.distinct("city", {"age": {"$gt": 20}}), ["a", "b"])
+        self.db._send_command.assert_called_with('DISTINCT city {"age": {"$gt": 20}}')
+
+    def test_prepare_and_execute(self):
+        self.db._send_command = MagicMock(side_effect=[
+            "OK PREPARED adults PARAMS=1",
+            'OK COUNT=1\nID 7 {"age": 30}',
+        ])
+        self.assertTrue(self.db.prepare("adults", '{"age": {"$gt": $1}}', {"limit": 10}))
+        rows = self.db.execute("adults", [18])
+        self.assertEqual(rows, [{"age": 30, "_id": 7}])
+        self.db._send_command.assert_called_with("EXECUTE adults [18]")
+
+    def test_aggregate(self):
+        self.db._send_command = MagicMock(return_value='OK COUNT=2\n{"n": 3, "_id": "a"}\n{"n": 1, "_id": "b"}')
+        pipeline = [{"$group": {"_id": "$city", "n": {"$count": {}}}}, {"$sort": {"n": -1}}]
+        rows = self.db.aggregate(pipeline)
+        self.assertEqual(rows, [{"n": 3, "_id": "a"}, {"n": 1, "_id": "b"}])
+        self.db._send_command.assert_called_with("AGGREGATE " + json.dumps(pipeline))
+
     def test_update_and_delete(self):
         self.db._send_command = MagicMock(side_effect=[
             "OK UPDATED",  # update
@@ -62,6 +109,16 @@ class TestFluxDB(unittest.TestCase):
         deleted = self.db.delete(1)
         self.assertTrue(deleted)
 
+    def test_insert_many_and_update_many(self):
+        self.db._send_command = MagicMock(side_effect=["OK INSERTED=3 IDS=7-9", "OK UPDATED=2"])
+
+        ids = self.db.insert_many([{"n": 1}, {"n": 2}, {"n": 3}])
+        self.assertEqual(ids, [7, 8, 9])
+
+        updated = self.db.update_many({7: {"n": 10}, 9: {"n": 30}})
+        self.assertEqual(updated, 2)
+        self.db._send_command.assert_called_with('UPDATE_MANY [{"_id": 7, "n": 10}, {"_id": 9, "n": 30}]')
+
     def test_stats(self):
         self.db._send_command = MagicMock(return_value='OK {"count": 10, "adaptive": true}')
         stats = self.db.stats()
@@ -77,5 +134,463 @@ class TestFluxDB(unittest.TestCase):
         self.assertTrue(self.db.toggle_adaptive(True))
         self.assertTrue(self.db.toggle_pubsub(True))
 
+    def test_result_cache(self):
+        self.db._send_command = MagicMock(return_value="OK CONFIG_UPDATED RESULT_CACHE=64MB")
+        self.assertTrue(self.db.set_result_cache(64))
+        self.db._send_command.assert_called_with("CONFIG RESULT_CACHE 64")
+
+    def test_durability(self):
+        self.db._send_command = MagicMock(return_value="OK CONFIG_UPDATED DURABILITY=COMMIT")
+        self.assertTrue(self.db.set_durability("commit"))
+        self.db._send_command.assert_called_with("CONFIG DURABILITY COMMIT")
+
+    def test_compression(self):
+        self.db._send_command = MagicMock(return_value="OK CONFIG_UPDATED COMPRESSION=LZ4")
+        self.assertTrue(self.db.set_compression("lz4"))
+        self.db._send_command.assert_called_with("CONFIG COMPRESSION LZ4")
+
+    def test_memory_budget(self):
+        self.db._send_command = MagicMock(return_value="OK CONFIG_UPDATED MEMORY=256MB")
+        self.assertTrue(self.db.set_memory_budget(256))
+        self.db._send_command.assert_called_with("CONFIG MEMORY 256")
+
+    def test_export(self):
+        # captured from a server: ids 1 and 3, the second with a long string and a large int
+        stream = (b'OK EXPORT COUNT=2 ENCODING=2\n\x01K\x08\x01w\x07\x06\x03neg\x00\xd7\x04\x02ok\x03\x04tags\x06\x03Aa\x87\x06\x01\x02'
+                  b'\x04addr\x05\x01\x04cityDOslo\x05score\x01\x00\x00\x00\x00\x00\x00\x04@\x03age\xa9\x04nameCAnn'
+                  b'\x03S\x02\x03big\x00\x80\x89z\x01s\x04F' + b'x' * 70 + b'\x00')
+        chunks = [stream[i:i + 7] for i in range(0, len(stream), 7)] # records split across reads
+        self.db.sock.recv = MagicMock(side_effect=chunks + [b''])
+        docs = self.db.export()
+        self.db.sock.sendall.assert_called_with(b"EXPORT\n")
+        self.assertEqual(docs, [
+            {"_id": 1, "name": "Ann", "age": 41, "score": 2.5, "tags": ["a", 7, [False]], "ok": True,
+             "addr": {"city": "Oslo"}, "neg": -300, "w": 3.0},
+            {"_id": 3, "s": "x" * 70, "big": 1000000},
+        ])
+        self.assertIsInstance(docs[0]["w"], float)
+
+
+def find_server() -> Optional[str]:
+    """fluxd from FLUXDB_SERVER, else the one the README builds into bin/."""
+    path = os.environ.get("FLUXDB_SERVER")
+    if path:
+        return path
+    root = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "..")
+    for name in ("fluxd.exe", "fluxd"):
+        candidate = os.path.join(root, "bin", name)
+        if os.path.isfile(candidate):
+            return candidate
+    return None
+
+SERVER = find_server()
+
+@unittest.skipUnless(SERVER, "no fluxd binary (build it into bin/ or set FLUXDB_SERVER)")
+class TestServer(unittest.TestCase):
+    """Runs against a real fluxd on a scratch data directory; stop() kills it like a crash."""
+
+    def setUp(self):
+        self.data = tempfile.mkdtemp(prefix="fluxdb_test_")
+        with socket.socket() as s:
+            s.bind(("127.0.0.1", 0))
+            self.port = s.getsockname()[1]
+        self.proc = None
+        self.start()
+
+    def tearDown(self):
+        self.stop()
+        shutil.rmtree(self.data, ignore_errors=True)
+
+    def start(self):
+        self.log = open(os.path.join(self.data, "server.log"), "a")
+        self.proc = subprocess.Popen([SERVER, str(self.port), self.data, "127.0.0.1"], stdout=self.log, stderr=subprocess.STDOUT)
+        deadline = time.time() + 10
+        while True:
+            try:
+                socket.create_connection(("127.0.0.1", self.port), timeout=1).close()
+                break
+            except OSError:
+                if time.time() > deadline: raise
+                time.sleep(0.05)
+        self.db = FluxDB(port=self.port, password="flux_admin")
+
+    def stop(self):
+        if not self.proc: return
+        self.db.close()
+        self.proc.kill()
+        self.proc.wait()
+        self.log.close()
+        self.proc = None
+
+    def restart(self, db_name: str = "t"):
+        self.stop()
+        self.start()
+        self.assertTrue(self.db.use(db_name))
+
+    def files(self, db_name: str = "t") -> List[str]:
+        return sorted(f for f in os.listdir(self.data) if f.startswith(db_name + "."))
+
+    def wal_bytes(self) -> bytearray:
+        with open(os.path.join(self.data, "t.wal"), "rb") as f:
+            return bytearray(f.read())
+
+    def write_wal(self, data: bytes):
+        with open(os.path.join(self.data, "t.wal"), "wb") as f:
+            f.write(data)
+
+    def test_wal_torn_tail(self):
+        self.assertTrue(self.db.use("t"))
+        self.assertTrue(self.db.set_durability("commit"))
+        for i in range(20):
+            self.db.insert({"s": "rec-%02d" % i})
+        self.stop()
+        wal = self.wal_bytes()
+        self.write_wal(wal[:-3]) # the last frame was only partly written
+
+        self.restart()
+        self.assertEqual(self.db.count(), 19)
+        self.assertIsNone(self.db.get(20))
+        self.assertLess(len(self.wal_bytes()), len(wal) - 3) # cut back to the last whole frame
+        self.assertEqual(self.db.insert({"s": "after"}), 20)
+        self.restart() # new frames follow the good prefix
+        self.assertEqual(self.db.count(), 20)
+        self.assertEqual(self.db.get(20), {"s": "after"})
+
+    def test_wal_checksum_mismatch(self):
+        self.assertTrue(self.db.use("t"))
+        self.assertTrue(self.db.set_durability("commit"))
+        for i in range(20):
+            self.db.insert({"s": "rec-%02d" % i})
+        self.stop()
+        wal = self.wal_bytes()
+        at = wal.index(b"rec-10")
+        wal[at] ^= 0x01 # bit rot inside the 11th record
+        self.write_wal(wal)
+
+        self.restart() # replay stops at the bad frame, nothing after it is trusted
+        self.assertEqual(self.db.count(), 10)
+        self.assertEqual(self.db.get(10), {"s": "rec-09"})
+        self.assertIsNone(self.db.get(12))
+        self.restart()
+        self.assertEqual(self.db.count(), 10)
+
+    @staticmethod
+    def encode_v1(value: Any) -> bytes:
+        """A value in the original storage encoding: type byte, fixed-size ints, u32 counts, u16 string lengths."""
+        if isinstance(value, bool): return b"\x02" + bytes([value])
+        if isinstance(value, int): return b"\x00" + struct.pack("<q", value)
+        if isinstance(value, float): return b"\x01" + struct.pack("<d", value)
+        if isinstance(value, str): return b"\x03" + TestServer.encode_string_v1(value)
+        if isinstance(value, list): return b"\x05" + struct.pack("<I", len(value)) + b"".join(TestServer.encode_v1(v) for v in value)
+        return b"\x04" + TestServer.encode_doc_v1(value)
+
+    @staticmethod
+    def encode_string_v1(s: str) -> bytes:
+        raw = s.encode("utf-8")
+        return struct.pack("<H", len(raw)) + raw
+
+    @staticmethod
+    def encode_doc_v1(doc: Dict[str, Any]) -> bytes:
+        return struct.pack("<I", len(doc)) + b"".join(TestServer.encode_string_v1(k) + TestServer.encode_v1(v) for k, v in doc.items())
+
+    def test_v1_files_round_trip(self):
+        docs = {
+            1: {"name": "Ann", "age": 41, "score": 2.5, "ok": True, "tags": ["a", 7, [False]], "addr": {"city": "Oslo"}},
+            2: {"big": -(2 ** 40), "s": "x" * 300},
+            3: {"gone": 1},
+        }
+        self.stop()
+        # headerless snapshot (nextId | count | { id | u32 size | doc }), then a v1 WAL on top
+        snap = struct.pack("<QQ", 4, len(docs))
+        for doc_id, doc in docs.items():
+            body = self.encode_doc_v1(doc)
+            snap += struct.pack("<QI", doc_id, len(body)) + body
+        with open(os.path.join(self.data, "t.flux"), "wb") as f:
+            f.write(snap)
+        update = self.encode_doc_v1({"name": "Bea", "n": 3.0})
+        self.write_wal(b"\x01" + struct.pack("<QI", 4, len(update)) + update + b"\x02" + struct.pack("<Q", 3))
+        docs[4] = {"name": "Bea", "n": 3.0}
+        del docs[3]
+
+        self.restart() # replayed, then rewritten in the current encoding
+        def check():
+            self.assertEqual({doc_id: self.db.get(doc_id) for doc_id in docs}, docs)
+            self.assertIsNone(self.db.get(3))
+            self.assertEqual(self.db.count(), 3)
+        check()
+        with open(os.path.join(self.data, "t.flux"), "rb") as f:
+            self.assertEqual(f.read(8), b"FXSN\x02\x00\x00\x00")
+        self.assertEqual(self.wal_bytes()[:4], b"FXWL")
+        exported = {doc.pop("_id"): doc for doc in self.db.export()}
+        self.assertEqual(exported, docs)
+
+        self.restart() # and loads back from the v2 files
+        check()
+
+    def segments(self) -> List[str]:
+        return [f for f in self.files() if re.fullmatch(r"t\.flux\.\d+", f)]
+
+    def test_segments_replay_and_compact(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        self.assertTrue(db.set_durability("commit"))
+        ids = db.insert_many([{"n": i, "pad": "p" * 50} for i in range(1000)])
+        self.assertTrue(db.checkpoint()) # base snapshot
+        for r in range(9):
+            self.assertTrue(db.update(ids[r], {"n": 1000 + r}))
+            if r == 4: self.assertTrue(db.delete(ids[500]))
+            self.assertTrue(db.checkpoint()) # one segment each
+        self.assertEqual(len(self.segments()), 9)
+
+        def check():
+            self.assertEqual(self.db.count(), 999)
+            self.assertEqual([self.db.get(ids[r])["n"] for r in range(9)], [1000 + r for r in range(9)])
+            self.assertEqual(self.db.get(ids[9])["n"], 9)
+            self.assertIsNone(self.db.get(ids[500]))
+
+        self.restart() # the checkpoints emptied the WAL: all of it comes from the segments
+        check()
+
+        # more than eight segments: the janitor (every 5 s) merges them into the newest
+        deadline = time.time() + 20
+        while len(self.segments()) > 1 and time.time() < deadline:
+            time.sleep(0.5)
+        self.assertEqual(self.segments(), ["t.flux.10"])
+        self.restart()
+        check()
+
+    def test_durability_survives_restart(self):
+        self.assertTrue(self.db.use("t"))
+        self.assertTrue(self.db.set_durability("commit"))
+        self.restart()
+        self.assertEqual(self.db.stats()["wal"]["durability"], "commit")
+
+        self.assertTrue(self.db.set_durability(50))
+        self.restart()
+        wal = self.db.stats()["wal"]
+        self.assertEqual((wal["durability"], wal["interval_ms"]), ("interval", 50))
+
+        self.assertTrue(self.db.set_durability("none"))
+        self.restart()
+        self.assertEqual(self.db.stats()["wal"]["durability"], "none")
+        self.assertNotIn("t.durability", self.files())
+
+    def test_compression_survives_restart(self):
+        self.assertTrue(self.db.use("t"))
+        self.assertTrue(self.db.set_durability("commit"))
+        self.db.insert({"s": "plain"})
+        self.assertNotIn("compression_ratio", self.db.stats()["wal"]) # only reported with compression on
+        self.assertTrue(self.db.set_compression("lz4"))
+        self.db.insert_many([{"s": "compressible " * 20} for _ in range(50)])
+        self.assertGreater(self.db.stats()["wal"]["compression_ratio"], 1)
+        self.restart()
+        self.assertEqual(self.db.stats()["wal"]["compression"], "lz4")
+        self.assertEqual(self.db.count(), 51)
+
+        self.assertTrue(self.db.set_compression("none"))
+        self.restart()
+        self.assertEqual(self.db.stats()["wal"]["compression"], "none")
+        self.assertNotIn("t.compression", self.files())
+
+    def test_drop_then_recreate(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        self.assertTrue(db.set_durability("commit"))
+        ids = db.insert_many([{"n": i} for i in range(200)])
+        self.assertTrue(db.checkpoint()) # base snapshot
+        self.assertTrue(db.update(ids[0], {"n": -1}))
+        self.assertTrue(db.checkpoint()) # delta segment on top of it
+        self.assertIn("t.flux.2", self.files())
+
+        self.assertTrue(db.drop_database("t"))
+        self.assertEqual(self.files(), [])
+        self.assertIn("NEW_DATABASE_CREATED", db._send_command("USE t"))
+        self.assertEqual(db.count(), 0)
+
+    def test_drop_removes_crash_leftovers(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        self.assertTrue(db.set_durability("commit"))
+        db.insert_many([{"n": i} for i in range(10)])
+
+        # a checkpoint that sealed the WAL and crashed before its snapshot was written
+        self.stop()
+        os.rename(os.path.join(self.data, "t.wal"), os.path.join(self.data, "t.wal.1"))
+        with open(os.path.join(self.data, "t.pages"), "wb") as f: # paged mode's scratch file
+            f.write(b"\0" * 4096)
+        self.restart()
+        self.assertEqual(self.db.count(), 10)
+        self.assertIn("t.wal.1", self.files())
+
+        self.assertTrue(self.db.drop_database("t"))
+        self.assertEqual(self.files(), [])
+        self.assertIn("NEW_DATABASE_CREATED", self.db._send_command("USE t"))
+        self.assertEqual(self.db.count(), 0)
+
+    def test_index_types_share_field(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        db.toggle_adaptive(False)
+        db.insert_many([{"a": 1}, {"a": 1}, {"a": 2}])
+        for cmd in ("INDEX a 0", "INDEX a 1", "INDEX a 0", "INDEX a 1"): # a second type, then again
+            self.assertEqual(db._send_command(cmd), "OK INDEX_CREATED")
+            self.assertEqual(db.count({"a": 1}), 2)
+            self.assertEqual(db.count({"a": {"$gte": 1}}), 3)
+            self.assertEqual(db.find({"a": 1}, fields=["a"]), [{"a": 1, "_id": 1}, {"a": 1, "_id": 2}])
+
+    def test_regex_on_trigram_index(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        db.toggle_adaptive(False)
+        # paged mode: every page a scan touches is a page read, an index lookup reads one
+        self.assertTrue(db.set_memory_budget(1))
+        for b in range(10):
+            db.insert_many([{"s": "item-%05d-%s" % (b * 2000 + i, "x" * 100)} for i in range(2000)])
+        self.assertEqual(db._send_command("INDEX s 3"), "OK INDEX_CREATED")
+
+        before = db.stats()["memory"]
+        self.assertGreater(before["evicted_pages"], 10)
+        rows = db.find({"s": {"$regex": "m-01234-"}})
+        self.assertEqual([r["_id"] for r in rows], [1235])
+        self.assertLessEqual(db.stats()["memory"]["page_reads"] - before["page_reads"], 2)
+
+    def test_execute_refuses_operator_params(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        db.insert_many([{"g": [float(i), 1.0], "n": i} for i in range(4)])
+        self.assertTrue(db.prepare("p", '{"g": $1}'))
+        resp = db._send_command('EXECUTE p [{"$near": [1.0, 0.0], "$k": 1}]')
+        self.assertTrue(resp.startswith("ERROR OPERATOR_PARAM $1"), resp)
+        self.assertTrue(db.prepare("q", '{"n": $1}'))
+        self.assertTrue(db._send_command('EXECUTE q [{"$gt": 0}]').startswith("ERROR OPERATOR_PARAM $1"))
+        self.assertEqual(db.execute("q", [2]), [{"g": [2.0, 1.0], "n": 2, "_id": 3}])
+
+    def test_near_top_k(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        rng = random.Random(7)
+        vectors = [[rng.uniform(-1, 1) for _ in range(8)] for _ in range(300)]
+        ids = db.insert_many([{"v": v, "n": i} for i, v in enumerate(vectors)])
+        query = [rng.uniform(-1, 1) for _ in range(8)]
+
+        def cosine(a, b):
+            dot = sum(x * y for x, y in zip(a, b))
+            return dot / math.sqrt(sum(x * x for x in a) * sum(y * y for y in b))
+
+        def nearest(k, keep=lambda i: True):
+            ranked = sorted((i for i in range(len(vectors)) if keep(i)), key=lambda i: -cosine(vectors[i], query))
+            return [ids[i] for i in ranked[:k]]
+
+        def near(extra=None):
+            q = {"v": {"$near": query, "$k": 5}}
+            q.update(extra or {})
+            return [r["_id"] for r in db.find(q)]
+
+        exact = near() # no index: exact scan
+        self.assertEqual(exact, nearest(5))
+        self.assertEqual(db._send_command('INDEX v 4 {"ef": 100}'), "OK INDEX_CREATED")
+        self.assertEqual(near(), exact)
+        # other constraints filter the candidates, still k results nearest first
+        self.assertEqual(near({"n": {"$lt": 150}}), nearest(5, lambda i: i < 150))
+
+    def test_near_after_update(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        db.insert_many([{"v": [1.0, 0.0]}, {"v": [0.0, 1.0]}, {"v": [1.0, 1.0]}])
+        self.assertEqual(db._send_command("INDEX v 4"), "OK INDEX_CREATED")
+        self.assertTrue(db.update(2, {"v": [0.0, 1.0]})) # leaves a deleted node in the graph
+        rows = db.find({"v": {"$near": [1.0, 0.0], "$k": 3}})
+        self.assertEqual([r["_id"] for r in rows], [1, 3, 2])
+
+    def test_near_with_other_index(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        db.toggle_adaptive(False)
+        rng = random.Random(40)
+        db.insert_many([{"v": [rng.uniform(-1, 1) for _ in range(4)]} for _ in range(40)])
+        query = {"v": {"$near": [1.0, 0.0, 0.0, 0.0], "$k": 40}}
+        exact = [r["_id"] for r in db.find(query)]
+        self.assertEqual(db._send_command('INDEX v 4 {"ef": 4}'), "OK INDEX_CREATED")
+        for cmd in ("INDEX v 0", "INDEX v 1", "INDEX v 4"): # must not add the documents to the graph again
+            self.assertEqual(db._send_command(cmd), "OK INDEX_CREATED")
+            self.assertEqual([r["_id"] for r in db.find(query)], exact)
+
+    def test_parallel_scan_limit(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        db.toggle_adaptive(False) # stay unindexed
+        keys = [(i * 7919) % 1000 for i in range(40000)] # past the parallel scan threshold
+        ids = []
+        for b in range(0, len(keys), 5000):
+            ids += db.insert_many([{"k": k} for k in keys[b:b + 5000]])
+
+        cases = [({"k": {"$gt": 990}}, 0, 25), ({"k": 3}, 10, 20), ({"k": {"$in": [1, 500, 999]}}, 5, 40),
+                 ({"$or": [{"k": {"$lt": 2}}, {"k": {"$gte": 998}}]}, 60, 30), ({"k": {"$gt": 2000}}, 0, 10)]
+        for threads in ("1", "64"):
+            self.assertTrue(db._send_command("CONFIG SCAN_THREADS " + threads).startswith("OK"))
+            for query, skip, limit in cases:
+                expected = [ids[i] for i, k in enumerate(keys) if self.matches(query, k)][skip:skip + limit]
+                rows = db.find(query, skip=skip, limit=limit)
+                self.assertEqual([r["_id"] for r in rows], expected, (threads, query))
+
+    @staticmethod
+    def matches(query: Dict[str, Any], k: int) -> bool:
+        if "$or" in query: return any(TestServer.matches(q, k) for q in query["$or"])
+        c = query["k"]
+        if not isinstance(c, dict): return k == c
+        ops = {"$gt": k > c.get("$gt", 0), "$lt": k < c.get("$lt", 0), "$gte": k >= c.get("$gte", 0), "$in": k in c.get("$in", [])}
+        return all(ops[op] for op in c)
+
+    def test_text_search(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        db.insert_many([
+            {"body": "the quick brown fox"},
+            {"body": "a fox, quick and quick again, a quick fox"},
+            {"body": "brown dogs are quick"},
+            {"body": "fox"},
+        ])
+        self.assertEqual(db._send_command("INDEX body 2"), "OK INDEX_CREATED")
+        rows = db.find({"body": {"$text": "quick fox"}})
+        self.assertEqual(sorted(r["_id"] for r in rows), [1, 2]) # every term, BM25 order
+        self.assertEqual([r["_id"] for r in db.find({"body": {"$phrase": "quick brown"}})], [1])
+
+    def test_field_stats(self):
+        db = self.db
+        self.assertTrue(db.use("t"))
+        self.assertTrue(db.set_durability("commit"))
+        db.insert_many([{"a": i, "s": "x"} for i in range(10)] + [{"a": "str"}])
+        self.assertTrue(db.update(1, {"a": 100})) # drops "s"
+        self.assertTrue(db.delete(2))
+
+        def check():
+            stats = self.db.stats()["field_stats"]
+            self.assertEqual((stats["a"]["present"], stats["a"]["types"]), (10, {"int": 9, "string": 1}))
+            self.assertEqual((stats["s"]["present"], stats["s"]["distinct"]), (8, 1))
+            self.assertAlmostEqual(stats["s"]["absent_ratio"], 0.2)
+            self.assertEqual(stats["a"]["max"], "str")
+
+        check() # kept up to date by the writes
+        self.restart()
+        check() # rebuilt from the replayed WAL
+
+    def test_snapshot_blocks_load(self):
+        for name, codec in (("t", "none"), ("u", "lz4")):
+            self.assertTrue(self.db.use(name))
+            self.assertTrue(self.db.set_compression(codec))
+            for b in range(0, 30000, 5000): # a few MB: several snapshot blocks, decoded in parallel
+                self.db.insert_many([{"n": i, "pad": "%06d" % i * 12} for i in range(b, b + 5000)])
+            self.assertTrue(self.db.delete(778)) # n = 777
+            self.assertEqual(self.db._send_command("INDEX n 1"), "OK INDEX_CREATED")
+            self.assertTrue(self.db.checkpoint())
+            self.assertGreater(os.path.getsize(os.path.join(self.data, name + ".flux")), 0)
+
+        for name in ("t", "u"):
+            self.restart(name)
+            self.assertEqual(self.db.count(), 29999)
+            self.assertEqual(self.db.get(30000), {"n": 29999, "pad": "029999" * 12})
+            self.assertIsNone(self.db.get(778))
+            self.assertEqual([r["_id"] for r in self.db.find({"n": {"$gte": 1023, "$lt": 1026}})], [1024, 1025, 1026])
+
 if __name__ == "__main__":
     unittest.main()
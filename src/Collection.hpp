@@ -10,24 +10,37 @@
 #include <optional>   
 #include <functional>  
 #include <vector>      
+#include <unordered_set>
+#include <memory>
+#include <fstream>
+#include <filesystem>
 
 #include "storage_engine.hpp"
 #include "persistence_manager.hpp"
 #include "expiry_manager.hpp"
+#include "thread_pool.hpp"
+#include "result_order.hpp"
+#include "result_cache.hpp"
 
 namespace fluxdb {
 
 class Collection {
 private:
     std::string db_name;
+    std::string memory_path;      // memory budget in MB, kept across restarts
+    std::string durability_path;  // CONFIG DURABILITY, kept as well
+    std::string compression_path; // CONFIG COMPRESSION, kept as well
+    std::string page_path;        // page file while the budget is set
     
     // workers
     StorageEngine storage;
     PersistenceManager persistence;
     ExpiryManager expiry_manager;
+    ResultCache result_cache;
 
     // concurrency control
     mutable std::shared_mutex rw_lock;
+    std::mutex checkpoint_lock; // one snapshot write or compaction at a time; taken before rw_lock
     std::atomic<bool> running{true};
     
     // Threads & Sync
@@ -38,6 +51,13 @@ private:
 
     const long MAX_WAL_SIZE = 10 * 1024 * 1024; // 10MB
 
+    // scans below this many docs stay on the calling thread
+    const size_t PARALLEL_SCAN_MIN = 16 * 1024;
+    std::atomic<size_t> scan_threads{ ThreadPool::instance().size() };
+
+    // bumped whenever the index set changes (prepared FIND plans are re-made)
+    std::atomic<uint64_t> index_epoch{ 0 };
+
     // --- BACKGROUND TASKS ---
     
     void janitorTask() {
@@ -55,11 +75,12 @@ private:
                 }
             } 
 
+            lk.unlock(); // Release CV lock
             if (needsCheckpoint) {
-                lk.unlock(); // Release CV lock
                 std::cout << "[Janitor] Compacting WAL...\n";
                 checkpoint();
             }
+            compactSegments();
         }
     }
 
@@ -71,8 +92,9 @@ private:
             if (!deadIds.empty()) {
                 std::unique_lock lock(rw_lock);
                 for (Id id : deadIds) {
-                    if (storage.get(id)) {
+                    if (const Document* doc = storage.get(id)) {
                         persistence.appendLog(0x02, id);
+                        result_cache.onWrite(doc, nullptr);
                         storage.remove(id);
                         std::cout << "[TTL] Removed ID " << id << "\n";
                     }
@@ -81,11 +103,94 @@ private:
         }
     }
 
+    // Paged mode: reads under the shared lock may leave more faulted-in pages than the budget
+    // allows, the next caller without a lock trims them
+    void relieve() {
+        if (!storage.wantsTrim()) return;
+        std::unique_lock lock(rw_lock);
+        storage.trim();
+    }
+
+    // Read before recovery, so the snapshot load already stays within the budget
+    void loadMemoryBudget() {
+        std::ifstream in(memory_path);
+        size_t mb = 0;
+        if (!(in >> mb) || mb == 0) return;
+        if (storage.setMemoryBudget(page_path, mb * 1024 * 1024)) {
+            std::cout << "[Paging] '" << db_name << "' keeps about " << mb << "MB of documents in memory\n";
+        }
+    }
+
+    // "COMMIT" or a sync interval in ms; no file = NONE
+    void loadDurability() {
+        std::ifstream in(durability_path);
+        std::string level;
+        if (!(in >> level)) return;
+        if (level == "COMMIT") {
+            persistence.setDurability(Durability::Commit);
+            return;
+        }
+        try {
+            unsigned long ms = std::stoul(level);
+            if (ms > 0) persistence.setDurability(Durability::Interval, static_cast<unsigned>(ms));
+        } catch (const std::exception&) {
+            std::cerr << "[Config] Ignoring unreadable " << durability_path << "\n";
+        }
+    }
+
+    // "LZ4"; no file = uncompressed. Before recovery, which may rewrite the snapshot
+    void loadCompression() {
+        std::ifstream in(compression_path);
+        std::string codec;
+        if (in >> codec && codec == "LZ4") persistence.setCompression(true);
+    }
+
+    // Shallow copy of the document a write is about to replace, only taken while results are cached
+    std::optional<Document> previousVersion(Id id) const {
+        const Document* doc = result_cache.enabled() ? storage.get(id) : nullptr;
+        if (!doc) return std::nullopt;
+        return *doc;
+    }
+
+    static void addDistinct(std::unordered_set<Value, ValueHasher>& set, const Value& v) {
+        if (v.type != Type::Object && v.type != Type::Array) set.insert(v); // never equal to anything
+    }
+
+    // Already distinct: 3 and 3.0 hash alike and compare ==, so sets and index walks keep one
+    static std::vector<Value> sortedValues(std::vector<Value> out) {
+        std::sort(out.begin(), out.end(), ValueLess());
+        return out;
+    }
+
+    // Partitioned scan: workers pull storage pages (morsels) until none are left or fn(slot, id, doc)
+    // returns false. Caller holds the lock; fn runs concurrently and must be thread-safe
+    template <typename Fn>
+    void scanPartitions(Fn&& fn) const {
+        const DocumentStore& docs = storage.documents();
+        size_t threads = docs.size() < PARALLEL_SCAN_MIN ? 1 : scan_threads.load();
+        std::atomic<size_t> next_page{ 0 };
+
+        ThreadPool::instance().run(threads, [&](size_t slot) {
+            size_t p;
+            while ((p = next_page++) < docs.pageCount()) {
+                bool more = docs.forEachInPage(p, [&](Id id, const Document& doc) { return fn(slot, id, doc); });
+                if (!more) return;
+            }
+        });
+    }
+
 public:
     Collection(std::string name, std::string storageDir) 
         : db_name(name),
+          memory_path(storageDir + "/" + name + ".memory"),
+          durability_path(storageDir + "/" + name + ".durability"),
+          compression_path(storageDir + "/" + name + ".compression"),
+          page_path(storageDir + "/" + name + ".pages"),
           persistence(storageDir + "/" + name + ".wal", storageDir + "/" + name + ".flux") 
     {
+        loadMemoryBudget();
+        loadDurability();
+        loadCompression();
         persistence.recover(storage); // recover
         
         
@@ -115,44 +220,123 @@ public:
         std::unique_lock lock(rw_lock);
         Id id = storage.getNextId();
         
-        persistence.appendLog(0x01, id, doc);
+        uint64_t ticket = persistence.appendLog(0x01, id, doc);
         
         storage.insert(id, std::move(doc));
         storage.setNextId(id + 1);
+        result_cache.onWrite(nullptr, storage.get(id));
         
+        lock.unlock(); // concurrent writers join the same WAL batch while this one waits
+        persistence.commit(ticket);
         return id;
     }
 
     void insert(Id id, const Document& doc) {
         std::unique_lock lock(rw_lock);
-        persistence.appendLog(0x01, id, doc);
+        uint64_t ticket = persistence.appendLog(0x01, id, doc);
+        auto before = previousVersion(id);
         storage.insert(id, doc);
+        result_cache.onWrite(before ? &*before : nullptr, storage.get(id));
+
+        lock.unlock();
+        persistence.commit(ticket);
     }
 
     bool update(Id id, const Document& doc) {
         std::unique_lock lock(rw_lock);
         if (!storage.get(id)) return false;
         
-        persistence.appendLog(0x01, id, doc);
+        uint64_t ticket = persistence.appendLog(0x01, id, doc);
+        auto before = previousVersion(id);
         storage.update(id, doc);
+        result_cache.onWrite(before ? &*before : nullptr, storage.get(id));
+
+        lock.unlock();
+        persistence.commit(ticket);
         return true;
     }
 
+    // Bulk load: one lock, a contiguous id range and one WAL write. Returns the first id
+    Id insertMany(std::vector<Document>&& docs) {
+        std::unique_lock lock(rw_lock);
+        Id first = storage.getNextId();
+
+        std::vector<std::pair<Id, Document>> batch;
+        batch.reserve(docs.size());
+        for (size_t i = 0; i < docs.size(); ++i) batch.emplace_back(first + i, std::move(docs[i]));
+
+        uint64_t ticket = persistence.appendLogBatch(batch);
+        storage.insertMany(std::move(batch));
+        storage.setNextId(first + docs.size());
+
+        if (result_cache.enabled()) {
+            for (Id id = first; id < first + docs.size(); ++id) result_cache.onWrite(nullptr, storage.get(id));
+        }
+
+        lock.unlock();
+        persistence.commit(ticket);
+        return first;
+    }
+
+    // Missing ids are skipped, a repeated id keeps its last document. Returns the number updated
+    size_t updateMany(std::vector<std::pair<Id, Document>>&& updates) {
+        std::unique_lock lock(rw_lock);
+
+        std::unordered_map<Id, size_t> last;
+        for (size_t i = 0; i < updates.size(); ++i) last[updates[i].first] = i;
+
+        std::vector<std::pair<Id, Document>> batch;
+        batch.reserve(last.size());
+        for (size_t i = 0; i < updates.size(); ++i) {
+            Id id = updates[i].first;
+            if (last[id] == i && storage.get(id)) batch.push_back(std::move(updates[i]));
+        }
+
+        std::vector<std::optional<Document>> before;
+        if (result_cache.enabled()) {
+            for (const auto& [id, doc] : batch) before.push_back(previousVersion(id));
+        }
+
+        uint64_t ticket = persistence.appendLogBatch(batch);
+        std::vector<Id> ids;
+        ids.reserve(batch.size());
+        for (const auto& [id, doc] : batch) ids.push_back(id);
+        storage.updateMany(std::move(batch));
+
+        for (size_t i = 0; i < before.size(); ++i) {
+            result_cache.onWrite(before[i] ? &*before[i] : nullptr, storage.get(ids[i]));
+        }
+
+        lock.unlock();
+        persistence.commit(ticket);
+        return ids.size();
+    }
+
     bool removeById(Id id) {
         std::unique_lock lock(rw_lock);
-        if (!storage.get(id)) return false;
+        const Document* doc = storage.get(id);
+        if (!doc) return false;
 
-        persistence.appendLog(0x02, id); 
+        uint64_t ticket = persistence.appendLog(0x02, id); 
+        result_cache.onWrite(doc, nullptr);
         storage.remove(id);
         expiry_manager.removeTTL(id); 
+
+        lock.unlock();
+        persistence.commit(ticket);
         return true;
     }
 
-    std::optional<std::reference_wrapper<const Document>> getById(Id id) const {
-        std::shared_lock lock(rw_lock);
-        const Document* doc = storage.get(id);
-        if (doc) return *doc;
-        return std::nullopt;
+    // A copy: in paged mode the document may live on an evicted page only this call holds
+    std::optional<Document> getById(Id id) {
+        std::optional<Document> out;
+        {
+            std::shared_lock lock(rw_lock);
+            DocumentStore::Hold hold;
+            if (const Document* doc = storage.get(id, hold)) out = *doc;
+        }
+        relieve();
+        return out;
     }
 
     std::vector<Id> find(const std::string& field, const Value& val) {
@@ -166,35 +350,321 @@ public:
         return storage.findRange(field, min, max);
     }
 
-    std::vector<Id> findAll(std::function<bool(const Document&)> predicate) {
+    // Matches merged in id order from per-thread buffers: the first 'limit' by id. Pages are
+    // taken in order but finish in any order, so the scan only stops at pages after the first
+    // run of finished pages 0..p that holds 'limit' matches
+    std::vector<Id> findAll(const std::function<bool(const Document&)>& predicate, size_t limit = SIZE_MAX) {
         std::shared_lock lock(rw_lock);
-        std::vector<Id> results;
-        for (auto it = storage.begin(); it != storage.end(); ++it) {
-            if (predicate(it->second)) {
-                results.push_back(it->first);
+        const DocumentStore& docs = storage.documents();
+        size_t threads = docs.size() < PARALLEL_SCAN_MIN ? 1 : scan_threads.load();
+        size_t pages = docs.pageCount();
+
+        std::vector<std::vector<Id>> buffers(ThreadPool::instance().size());
+        std::vector<size_t> matches(pages, 0);
+        std::vector<bool> finished(pages, false);
+        std::mutex progress;
+        size_t prefix = 0, prefix_matches = 0; // pages [0, prefix) finished, with that many matches
+        std::atomic<size_t> last_needed{ SIZE_MAX };
+        std::atomic<size_t> next_page{ 0 };
+
+        ThreadPool::instance().run(threads, [&](size_t slot) {
+            size_t p;
+            while ((p = next_page++) < pages && p <= last_needed.load(std::memory_order_relaxed)) {
+                size_t n = 0;
+                docs.forEachInPage(p, [&](Id id, const Document& doc) {
+                    if (predicate(doc)) {
+                        buffers[slot].push_back(id);
+                        n++;
+                    }
+                    return p <= last_needed.load(std::memory_order_relaxed);
+                });
+
+                std::lock_guard<std::mutex> lk(progress);
+                matches[p] = n;
+                finished[p] = true;
+                while (prefix < pages && finished[prefix] && prefix_matches < limit) prefix_matches += matches[prefix++];
+                if (prefix > 0 && prefix_matches >= limit) last_needed = std::min(last_needed.load(), prefix - 1);
             }
+        });
+        return mergeById(buffers, limit);
+    }
+
+    // First k matches in 'order': a bounded heap per worker, merged at the end (ids best first)
+    std::vector<Id> findTopK(const std::function<bool(const Document&)>& predicate, const ResultOrder& order, size_t k) {
+        std::shared_lock lock(rw_lock);
+
+        std::vector<TopK> heaps(ThreadPool::instance().size(), TopK(order, k));
+        scanPartitions([&](size_t slot, Id id, const Document& doc) {
+            if (predicate(doc)) heaps[slot].offer(id, doc);
+            return true;
+        });
+
+        for (size_t i = 1; i < heaps.size(); ++i) heaps[0].merge(std::move(heaps[i]));
+        return heaps[0].take();
+    }
+
+    // Streams matches in sorted-index order until 'need' are found; false without a sorted index.
+    // Docs lacking the field are not in the index, the caller appends them
+    bool findOrdered(const std::string& field, bool descending, const std::function<bool(const Document&)>& predicate,
+                     size_t need, std::vector<Id>& out) {
+        bool found;
+        {
+            std::shared_lock lock(rw_lock);
+            DocumentStore::Hold hold;
+            found = storage.forEachSortedRun(field, descending, [&](const std::vector<Id>& run) {
+                for (Id id : run) {
+                    const Document* doc = storage.get(id, hold);
+                    if (doc && predicate(*doc)) {
+                        out.push_back(id);
+                        if (out.size() >= need) return false;
+                    }
+                }
+                return true;
+            });
         }
-        return results;
+        relieve();
+        return found;
+    }
+
+    bool hasTextIndex(const std::string& field) const {
+        std::shared_lock lock(rw_lock);
+        return storage.hasTextIndex(field);
+    }
+
+    // $prefix / $regex candidates: a sorted index walks the prefix, a trigram index the literals
+    bool hasPatternIndex(const std::string& field) const {
+        std::shared_lock lock(rw_lock);
+        return storage.hasSortedIndex(field) || storage.hasTrigramIndex(field);
+    }
+
+    std::vector<std::pair<Id, double>> searchText(const std::string& field, const std::string& query, bool phrase) const {
+        std::shared_lock lock(rw_lock);
+        return storage.searchText(field, query, phrase);
+    }
+
+    bool findPrefix(const std::string& field, const std::string& prefix, std::vector<Id>& out) const {
+        std::shared_lock lock(rw_lock);
+        return storage.findPrefix(field, prefix, out);
+    }
+
+    bool findTrigrams(const std::string& field, const std::vector<std::string>& runs, std::vector<Id>& out) const {
+        std::shared_lock lock(rw_lock);
+        return storage.findTrigrams(field, runs, out);
+    }
+
+    bool findNearest(const std::string& field, const Value& query, size_t k, size_t ef,
+                     std::vector<std::pair<Id, float>>& out) const {
+        std::shared_lock lock(rw_lock);
+        return storage.findNearest(field, query, k, ef, out);
+    }
+
+    bool findCovered(const Document& query, const std::vector<std::string>& fields,
+                     std::vector<std::pair<Id, Document>>& out) const {
+        std::shared_lock lock(rw_lock);
+        return storage.findCovered(query, fields, out);
+    }
+
+    bool planCandidates(const Document& query, std::vector<Id>& out) const {
+        std::shared_lock lock(rw_lock);
+        return storage.planCandidates(query, out);
+    }
+
+    // --- COUNT / DISTINCT (documents are read, never serialized) ---
+
+    bool countIndexed(const Document& query, size_t& out) const {
+        std::shared_lock lock(rw_lock);
+        return storage.countIndexed(query, out);
+    }
+
+    size_t countMatching(const std::function<bool(const Document&)>& predicate) const {
+        std::shared_lock lock(rw_lock);
+        std::vector<size_t> counts(ThreadPool::instance().size(), 0);
+        scanPartitions([&](size_t slot, Id, const Document& doc) {
+            if (predicate(doc)) counts[slot]++;
+            return true;
+        });
+        size_t total = 0;
+        for (size_t c : counts) total += c;
+        return total;
+    }
+
+    bool distinctIndexed(const std::string& field, std::vector<Value>& out) const {
+        std::shared_lock lock(rw_lock);
+        if (!storage.distinctIndexed(field, out)) return false;
+        out = sortedValues(std::move(out));
+        return true;
+    }
+
+    // Distinct scalar values of 'field' over matching docs, ValueLess ordered
+    std::vector<Value> distinctMatching(const std::string& field, const std::function<bool(const Document&)>& predicate) const {
+        using ValueSet = std::unordered_set<Value, ValueHasher>;
+        std::shared_lock lock(rw_lock);
+
+        std::vector<ValueSet> sets(ThreadPool::instance().size());
+        scanPartitions([&](size_t slot, Id, const Document& doc) {
+            auto it = doc.find(field);
+            if (it != doc.end() && it->second && predicate(doc)) addDistinct(sets[slot], *it->second);
+            return true;
+        });
+        for (size_t i = 1; i < sets.size(); ++i) sets[0].insert(sets[i].begin(), sets[i].end());
+        return sortedValues({ sets[0].begin(), sets[0].end() });
+    }
+
+    std::vector<Value> distinctOf(const std::string& field, const std::vector<Id>& ids,
+                                  const std::function<bool(const Document&)>& predicate) {
+        std::unordered_set<Value, ValueHasher> set;
+        forEachById(ids, [&](Id, const Document& doc) {
+            auto it = doc.find(field);
+            if (it != doc.end() && it->second && predicate(doc)) addDistinct(set, *it->second);
+        });
+        return sortedValues({ set.begin(), set.end() });
+    }
+
+    // fn(slot, id, doc) for every match, run by the scan workers: per-slot state needs no locking
+    template <typename Fn>
+    void forEachMatching(const std::function<bool(const Document&)>& predicate, Fn&& fn) const {
+        std::shared_lock lock(rw_lock);
+        scanPartitions([&](size_t slot, Id id, const Document& doc) {
+            if (predicate(doc)) fn(slot, id, doc);
+            return true;
+        });
+    }
+
+    // Documents with lo <= id <= hi in id order under one shared lock, fn(id, doc) returns false to stop
+    template <typename Fn>
+    void forEachInRange(Id lo, Id hi, Fn&& fn) const {
+        std::shared_lock lock(rw_lock);
+        storage.documents().forEachInRange(lo, hi, std::forward<Fn>(fn));
+    }
+
+    // fn(docs) over a copy-on-write copy of the store, for long walks (EXPORT streaming to a
+    // client) that must not hold writers: the copy is taken and dropped under the lock, walked
+    // without it
+    template <typename Fn>
+    void withFrozenDocuments(Fn&& fn) const {
+        std::unique_ptr<DocumentStore> docs;
+        {
+            std::shared_lock lock(rw_lock);
+            docs = std::make_unique<DocumentStore>(storage.documents());
+        }
+        fn(static_cast<const DocumentStore&>(*docs));
+        std::shared_lock lock(rw_lock); // page refcounts are read by writers deciding whether to clone
+        docs.reset();
+    }
+
+    // Visits a batch of documents under one shared lock (instead of a getById per ID)
+    template <typename Fn>
+    void forEachById(const std::vector<Id>& ids, Fn&& fn) {
+        {
+            std::shared_lock lock(rw_lock);
+            DocumentStore::Hold hold;
+            for (Id id : ids) {
+                if (const Document* doc = storage.get(id, hold)) fn(id, *doc);
+            }
+        }
+        relieve();
     }
 
     // --- UTILITIES ---
 
-    void createIndex(const std::string& field, int type = 0) {
+    void createIndex(const std::string& field, int type = 0, const Document& options = {}) {
         std::unique_lock lock(rw_lock);
-        storage.createIndex(field, type);
+        storage.createIndex(field, type, options);
+        index_epoch++;
+        result_cache.invalidateAll();
     }
 
+    bool hasIndex(const std::string& field) const {
+        std::shared_lock lock(rw_lock);
+        return storage.hasIndex(field);
+    }
+
+    uint64_t getIndexEpoch() const { return index_epoch; }
+
     void expire(Id id, int seconds) {
         expiry_manager.setTTL(id, seconds);
     }
 
+    // Writers are held only while the state is frozen (page pointers shared, not docs copied)
+    // and the WAL switched to a fresh file; the snapshot is written from the frozen copy while
+    // they continue. Usually that is a segment of the documents changed since the last
+    // checkpoint. Sealed WAL files go once it is in place
     void checkpoint() {
+        std::lock_guard<std::mutex> one(checkpoint_lock);
+        std::unique_ptr<StorageEngine::Frozen> state;
+        uint64_t fence = 0;
+        {
+            std::unique_lock lock(rw_lock);
+            std::cout << "[Checkpoint] Saving snapshot...\n";
+            state = std::make_unique<StorageEngine::Frozen>(storage.freeze());
+            storage.clearDirty();
+            fence = persistence.rotateWal();
+        }
+        bool saved = persistence.saveCheckpoint(*state);
+        {
+            // page refcounts are read by writers deciding whether to clone
+            std::unique_lock lock(rw_lock);
+            state.reset();
+            if (!saved) storage.markAllDirty(); // what it held is only in the WAL: next one is full
+        }
+        if (saved && fence) persistence.dropCoveredWal(fence);
+    }
+
+    // Background merge of snapshot segments, writers are not held
+    void compactSegments() {
+        std::lock_guard<std::mutex> one(checkpoint_lock);
+        persistence.compactSegments();
+    }
+
+    // Kept in <name>.durability for restarts
+    void setDurability(Durability level, unsigned intervalMs = 0) {
+        persistence.setDurability(level, intervalMs);
+        std::error_code ec;
+        if (level == Durability::None) {
+            std::filesystem::remove(durability_path, ec);
+        } else {
+            std::ofstream out(durability_path, std::ios::trunc);
+            out << (level == Durability::Commit ? std::string("COMMIT") : std::to_string(intervalMs)) << "\n";
+        }
+    }
+
+    // Kept in <name>.compression for restarts
+    void setCompression(bool on) {
+        persistence.setCompression(on);
+        std::error_code ec;
+        if (!on) {
+            std::filesystem::remove(compression_path, ec);
+        } else {
+            std::ofstream out(compression_path, std::ios::trunc);
+            out << "LZ4\n";
+        }
+    }
+
+    void setScanThreads(size_t threads) {
+        scan_threads = std::max<size_t>(1, std::min(threads, ThreadPool::instance().size()));
+    }
+
+    size_t getScanThreads() const { return scan_threads; }
+
+    // Paged mode: about mb MB of documents stay in memory, cold pages go to <name>.pages
+    // (0 = everything in memory). Kept in <name>.memory for restarts; false if the page file
+    // can't be created
+    bool setMemoryBudget(size_t mb) {
         std::unique_lock lock(rw_lock);
-        std::cout << "[Checkpoint] Saving snapshot...\n";
-        persistence.saveSnapshot(storage);
-        persistence.truncateWal();
+        if (!storage.setMemoryBudget(page_path, mb * 1024 * 1024)) return false;
+        std::error_code ec;
+        if (mb == 0) {
+            std::filesystem::remove(memory_path, ec);
+        } else {
+            std::ofstream out(memory_path, std::ios::trunc);
+            out << mb << "\n";
+        }
+        return true;
     }
 
+    // internally synchronized, safe to use without the collection lock
+    ResultCache& resultCache() { return result_cache; }
+
     void setAdaptive(bool enabled) {
         std::unique_lock lock(rw_lock);
         storage.setAdaptive(enabled);
@@ -202,7 +672,12 @@ public:
 
     void reportQueryMiss(const std::string& field, bool isRange = false) { // for QueryProcessor
         std::unique_lock lock(rw_lock); 
+        size_t indexes = storage.getIndexDefinitions().size();
         storage.reportQueryMiss(field, isRange);
+        if (storage.getIndexDefinitions().size() != indexes) {
+            index_epoch++;
+            result_cache.invalidateAll();
+        }
     }
 
     std::string getStats() {
@@ -212,25 +687,34 @@ public:
         json += "\"documents\": " + std::to_string(storage.size()) + ", ";
         json += "\"adaptive_mode\": " + std::string(storage.isAdaptive() ? "true" : "false") + ", ";
         
-        auto fields = storage.getSampleFields();
+        auto fields = storage.getFields();
         json += "\"fields\": [";
         for (size_t i = 0; i < fields.size(); ++i) {
             json += "\"" + fields[i] + "\"";
             if (i < fields.size() - 1) json += ", ";
         }
-        json += "]}";
+        json += "], ";
+        json += "\"field_stats\": " + storage.getStats().toJson(storage.size()) + ", ";
+        json += "\"result_cache\": " + result_cache.toJson() + ", ";
+        if (storage.getMemoryBudget()) json += "\"memory\": " + storage.pagingJson() + ", ";
+        json += "\"wal\": " + persistence.walStats();
+        json += "}";
         return json;
     }
 
     void clear() {
+        std::lock_guard<std::mutex> one(checkpoint_lock); // same snapshot file
         std::unique_lock lock(rw_lock);
         
         storage.clear(); 
+        result_cache.invalidateAll();
         
         std::cout << "[Maintenance] DB Flushed.\n";
         
-        persistence.saveSnapshot(storage);
-        persistence.truncateWal();
+        if (persistence.saveSnapshot(storage.freeze())) {
+            persistence.truncateWal();
+            storage.clearDirty();
+        }
     }
 };
 
@@ -0,0 +1,517 @@
+#ifndef AGGREGATION_HPP
+#define AGGREGATION_HPP
+
+#include "collection.hpp"
+#include "query_program.hpp"
+#include "result_order.hpp"
+#include "thread_pool.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdint>
+
+namespace fluxdb {
+
+// $group accumulators: {"total": {"$sum": "$amount"}}, {"n": {"$count": {}}}
+enum class AccOp : uint8_t { Sum, Avg, Min, Max, Count };
+
+struct Accumulator {
+    std::string out;                 // output field
+    AccOp op = AccOp::Count;
+    std::string field;               // "$field" argument, empty = constant
+    std::shared_ptr<Value> constant; // {"$sum": 1}
+};
+
+// {"_id": "$city"} | {"_id": {"c": "$city", "y": "$year"}} | {"_id": <literal>} (one group)
+struct GroupSpec {
+    std::vector<std::pair<std::string, std::string>> key; // (output name, source field)
+    bool compound = false;
+    std::shared_ptr<Value> constantKey;
+    std::vector<Accumulator> accumulators;
+};
+
+// Partial state of one accumulator in one group. Partials of the same group merge exactly
+struct AccState {
+    double sum = 0;
+    int64_t isum = 0;
+    bool ints = true;            // every summed value was an Int: $sum stays an Int
+    uint64_t n = 0;
+    std::shared_ptr<Value> best; // $min / $max
+};
+
+// true if a + b does not fit an int64 (out is then left alone)
+inline bool addOverflows(int64_t a, int64_t b, int64_t& out) {
+    if (b > 0 ? a > INT64_MAX - b : a < INT64_MIN - b) return true;
+    out = a + b;
+    return false;
+}
+
+// One worker's hash table of groups. Lookups hash the document's key values in place,
+// a group (and its key copy) is only allocated the first time its key is seen
+class GroupTable {
+public:
+    struct Group {
+        uint64_t hash;
+        std::vector<std::shared_ptr<Value>> key; // per key part, null = field missing
+        std::vector<AccState> acc;
+        uint32_t next;                           // older group with the same hash
+    };
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+    using Part = const std::shared_ptr<Value>*; // null = field missing
+
+    const GroupSpec* spec;
+    std::unordered_map<uint64_t, uint32_t> heads;
+    std::vector<Group> groups;
+    std::vector<Part> parts; // scratch, one per key field
+
+    // objects/arrays never compare equal, so they are grouped by their JSON text
+    static bool composite(const Value& v) { return ValueLess::getRank(v) == 3; }
+
+    static uint64_t hashPart(Part p) {
+        if (!p) return 0x51ed270b;
+        const Value& v = **p;
+        return composite(v) ? std::hash<std::string>{}(v.ToJson()) : ValueHasher{}(v);
+    }
+
+    static bool samePart(const std::shared_ptr<Value>& stored, Part p) {
+        if (!stored || !p) return !stored && !p;
+        const Value& a = *stored;
+        const Value& b = **p;
+        if (composite(a) || composite(b)) return composite(a) && composite(b) && a.ToJson() == b.ToJson();
+        return a == b;
+    }
+
+    uint64_t hashKey(const Part* key) const {
+        uint64_t h = 0x9e3779b97f4a7c15ULL;
+        for (size_t i = 0; i < spec->key.size(); ++i) {
+            h ^= hashPart(key[i]) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        }
+        h ^= h >> 33; // finalize: the low bits pick buckets and merge partitions
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    Group& locate(const Part* key, uint64_t h) {
+        auto [it, fresh] = heads.try_emplace(h, NONE);
+        for (uint32_t i = it->second; i != NONE; i = groups[i].next) {
+            bool same = true;
+            for (size_t k = 0; k < spec->key.size() && same; ++k) same = samePart(groups[i].key[k], key[k]);
+            if (same) return groups[i];
+        }
+
+        Group g;
+        g.hash = h;
+        g.key.reserve(spec->key.size());
+        for (size_t k = 0; k < spec->key.size(); ++k) g.key.push_back(key[k] ? *key[k] : nullptr);
+        g.acc.resize(spec->accumulators.size());
+        g.next = it->second;
+        it->second = static_cast<uint32_t>(groups.size());
+        groups.push_back(std::move(g));
+        return groups.back();
+    }
+
+    static void accumulate(const Accumulator& a, AccState& s, Part v) {
+        switch (a.op) {
+            case AccOp::Count: s.n++; return;
+            case AccOp::Sum:
+            case AccOp::Avg:
+                if (!v || !*v || !(*v)->isNumber()) return;
+                // past int64 the sum goes on in double only
+                if ((*v)->type != Type::Int || addOverflows(s.isum, (*v)->asInt(), s.isum)) s.ints = false;
+                s.sum += (*v)->getNumeric();
+                s.n++;
+                return;
+            case AccOp::Min:
+            case AccOp::Max: {
+                if (!v || !*v) return;
+                ValueLess less;
+                if (!s.best || (a.op == AccOp::Min ? less(**v, *s.best) : less(*s.best, **v))) s.best = *v;
+                return;
+            }
+        }
+    }
+
+    static void mergeState(const Accumulator& a, AccState& into, const AccState& from) {
+        into.sum += from.sum;
+        into.ints = into.ints && from.ints && !addOverflows(into.isum, from.isum, into.isum);
+        into.n += from.n;
+        if (from.best) accumulate(a, into, &from.best);
+    }
+
+public:
+    explicit GroupTable(const GroupSpec& s) : spec(&s), parts(s.key.size()) {}
+
+    void add(const Document& doc) {
+        for (size_t k = 0; k < spec->key.size(); ++k) {
+            auto it = doc.find(spec->key[k].second);
+            parts[k] = (it != doc.end() && it->second) ? &it->second : nullptr;
+        }
+        Group& g = locate(parts.data(), hashKey(parts.data()));
+
+        for (size_t i = 0; i < spec->accumulators.size(); ++i) {
+            const Accumulator& a = spec->accumulators[i];
+            Part v = &a.constant;
+            if (!a.field.empty()) {
+                auto it = doc.find(a.field);
+                v = it != doc.end() ? &it->second : nullptr;
+            }
+            accumulate(a, g.acc[i], v);
+        }
+    }
+
+    // Folds another table's partial group into this one
+    void merge(const Group& other) {
+        for (size_t k = 0; k < spec->key.size(); ++k) parts[k] = other.key[k] ? &other.key[k] : nullptr;
+        Group& g = locate(parts.data(), other.hash);
+        for (size_t i = 0; i < spec->accumulators.size(); ++i) mergeState(spec->accumulators[i], g.acc[i], other.acc[i]);
+    }
+
+    const std::vector<Group>& getGroups() const { return groups; }
+
+    // One output row per group: "_id" then the accumulators (a missing key / empty $avg is left out)
+    void emit(std::vector<Document>& rows) const {
+        for (const auto& g : groups) {
+            Document row;
+            if (spec->compound) {
+                Document id;
+                for (size_t k = 0; k < spec->key.size(); ++k) {
+                    if (g.key[k]) id[spec->key[k].first] = g.key[k];
+                }
+                row["_id"] = std::make_shared<Value>(std::move(id));
+            } else if (!spec->key.empty()) {
+                if (g.key[0]) row["_id"] = g.key[0];
+            } else if (spec->constantKey) {
+                row["_id"] = spec->constantKey;
+            }
+
+            for (size_t i = 0; i < spec->accumulators.size(); ++i) {
+                const Accumulator& a = spec->accumulators[i];
+                const AccState& s = g.acc[i];
+                std::shared_ptr<Value> out;
+                switch (a.op) {
+                    case AccOp::Count: out = std::make_shared<Value>(static_cast<int64_t>(s.n)); break;
+                    case AccOp::Sum: out = s.ints ? std::make_shared<Value>(s.isum) : std::make_shared<Value>(s.sum); break;
+                    case AccOp::Avg: if (s.n) out = std::make_shared<Value>(s.sum / static_cast<double>(s.n)); break;
+                    case AccOp::Min:
+                    case AccOp::Max: out = s.best; break;
+                }
+                if (out) row[a.out] = out;
+            }
+            rows.push_back(std::move(row));
+        }
+    }
+};
+
+// Partitioned parallel hash aggregation: every scan worker folds documents into its own table,
+// then the partial groups are split by key hash and each partition is merged by one worker
+class GroupAggregator {
+private:
+    const GroupSpec& spec;
+    std::vector<GroupTable> partials;
+
+public:
+    GroupAggregator(const GroupSpec& s, size_t slots) : spec(s) {
+        partials.reserve(slots);
+        for (size_t i = 0; i < slots; ++i) partials.emplace_back(s);
+    }
+
+    void add(size_t slot, const Document& doc) { partials[slot].add(doc); }
+
+    std::vector<Document> finish() {
+        std::vector<const GroupTable*> used;
+        for (const auto& t : partials) {
+            if (!t.getGroups().empty()) used.push_back(&t);
+        }
+
+        std::vector<Document> rows;
+        if (used.size() <= 1) {
+            if (!used.empty()) used[0]->emit(rows);
+            return rows;
+        }
+
+        ThreadPool& pool = ThreadPool::instance();
+        size_t parts = pool.size();
+        std::vector<GroupTable> merged(parts, GroupTable(spec));
+        std::atomic<size_t> next{ 0 };
+
+        pool.run(parts, [&](size_t) {
+            size_t p;
+            while ((p = next++) < parts) {
+                for (const GroupTable* t : used) {
+                    for (const auto& g : t->getGroups()) {
+                        if (g.hash % parts == p) merged[p].merge(g);
+                    }
+                }
+            }
+        });
+
+        for (const auto& t : merged) t.emit(rows);
+        return rows;
+    }
+};
+
+// AGGREGATE [{"$match": {...}}, {"$group": {...}}, {"$sort": {...}}, {"$skip": n}, {"$limit": n}, {"$project": {...}}]
+class Pipeline {
+public:
+    enum class Kind : uint8_t { Match, Group, Sort, Skip, Limit, Project };
+
+    // {"a": 1, "total": "$sum", "_id": 0}: inclusion (with renames) or exclusion, "_id" kept unless 0
+    struct ProjectSpec {
+        std::vector<std::pair<std::string, std::string>> include; // (output name, source field)
+        std::vector<std::string> exclude;
+        bool keepId = true;
+    };
+
+    struct Stage {
+        Kind kind;
+        Document match;
+        GroupSpec group;
+        ResultOrder order;
+        size_t count = 0;
+        ProjectSpec project;
+    };
+
+private:
+    std::vector<Stage> stages;
+
+    static std::runtime_error invalid(const std::string& stage) {
+        return std::runtime_error("INVALID_STAGE " + stage);
+    }
+
+    // "$field" -> "field", anything else -> ""
+    static std::string fieldRef(const Value& v) {
+        if (v.type != Type::String || v.asString().size() < 2 || v.asString()[0] != '$') return "";
+        return v.asString().substr(1);
+    }
+
+    static GroupSpec parseGroup(const Document& spec) {
+        GroupSpec g;
+        for (const auto& [name, val] : spec) {
+            if (!val) throw invalid("$group");
+
+            if (name == "_id") {
+                if (!fieldRef(*val).empty()) {
+                    g.key.push_back({ "_id", fieldRef(*val) });
+                } else if (val->type == Type::Object) {
+                    g.compound = true;
+                    for (const auto& [part, ref] : val->asObject()) {
+                        if (!ref || fieldRef(*ref).empty()) throw invalid("$group (compound _id parts must be \"$field\")");
+                        g.key.push_back({ part, fieldRef(*ref) });
+                    }
+                } else {
+                    g.constantKey = val;
+                }
+                continue;
+            }
+
+            if (val->type != Type::Object || val->asObject().size() != 1) throw invalid("$group (Use {\"out\": {\"$sum\": \"$field\"}})");
+            const auto& [opName, arg] = *val->asObject().begin();
+
+            Accumulator a;
+            a.out = name;
+            if (opName == "$sum") a.op = AccOp::Sum;
+            else if (opName == "$avg") a.op = AccOp::Avg;
+            else if (opName == "$min") a.op = AccOp::Min;
+            else if (opName == "$max") a.op = AccOp::Max;
+            else if (opName == "$count") a.op = AccOp::Count;
+            else throw std::runtime_error("UNKNOWN_ACCUMULATOR " + opName);
+
+            if (a.op != AccOp::Count) {
+                if (!arg) throw invalid("$group");
+                a.field = fieldRef(*arg);
+                if (a.field.empty()) a.constant = arg;
+            }
+            g.accumulators.push_back(std::move(a));
+        }
+        return g;
+    }
+
+    static ProjectSpec parseProject(const Document& spec) {
+        ProjectSpec p;
+        for (const auto& [name, val] : spec) {
+            if (!val) throw invalid("$project");
+            bool on = val->isNumber() ? val->getNumeric() != 0 : (val->type == Type::Bool ? val->asBool() : true);
+
+            if (name == "_id") p.keepId = on;
+            else if (!fieldRef(*val).empty()) p.include.push_back({ name, fieldRef(*val) });
+            else if (val->type == Type::String || val->type == Type::Object || val->type == Type::Array) throw invalid("$project");
+            else if (on) p.include.push_back({ name, name });
+            else p.exclude.push_back(name);
+        }
+        if (!p.include.empty() && !p.exclude.empty()) throw invalid("$project (cannot mix inclusion and exclusion)");
+        return p;
+    }
+
+    // Counts past SIZE_MAX mean "all of them"
+    static size_t parseCount(const Value& v, const std::string& stage) {
+        if (!v.isNumber() || !(v.getNumeric() >= 0)) throw invalid(stage);
+        if (v.getNumeric() >= static_cast<double>(SIZE_MAX)) return SIZE_MAX;
+        return static_cast<size_t>(v.getNumeric());
+    }
+
+    static void project(const ProjectSpec& p, Document& row) {
+        if (p.include.empty()) {
+            for (const auto& f : p.exclude) row.erase(f);
+            if (!p.keepId) row.erase("_id");
+            return;
+        }
+        Document out;
+        if (p.keepId) {
+            auto it = row.find("_id");
+            if (it != row.end()) out["_id"] = it->second;
+        }
+        for (const auto& [name, source] : p.include) {
+            auto it = row.find(source);
+            if (it != row.end() && it->second) out[name] = it->second;
+        }
+        row = std::move(out);
+    }
+
+    // Stable: rows that tie keep their incoming order
+    static void sortRows(const ResultOrder& order, std::vector<Document>& rows) {
+        std::vector<std::pair<ResultOrder::Row, size_t>> keys;
+        keys.reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) keys.push_back({ order.extract(rows[i]), i });
+        std::sort(keys.begin(), keys.end(), [&](const auto& a, const auto& b) {
+            return order.before(a.first, a.second, b.first, b.second);
+        });
+
+        std::vector<Document> sorted;
+        sorted.reserve(rows.size());
+        for (const auto& k : keys) sorted.push_back(std::move(rows[k.second]));
+        rows = std::move(sorted);
+    }
+
+    // Later stages run over the rows in memory
+    static void apply(const Stage& s, std::vector<Document>& rows, const QueryProgram::RegexCompiler& compileRegex) {
+        switch (s.kind) {
+            case Kind::Match: {
+                QueryProgram program = QueryProgram::compile(s.match, compileRegex);
+                rows.erase(std::remove_if(rows.begin(), rows.end(), [&](const Document& row) {
+                    return !program.matches(row);
+                }), rows.end());
+                break;
+            }
+            case Kind::Group: {
+                GroupAggregator agg(s.group, 1);
+                for (const auto& row : rows) agg.add(0, row);
+                rows = agg.finish();
+                break;
+            }
+            case Kind::Sort: sortRows(s.order, rows); break;
+            case Kind::Skip: rows.erase(rows.begin(), rows.begin() + std::min(s.count, rows.size())); break;
+            case Kind::Limit: if (rows.size() > s.count) rows.resize(s.count); break;
+            case Kind::Project: for (auto& row : rows) project(s.project, row); break;
+        }
+    }
+
+public:
+    static Pipeline parse(const Value& spec) {
+        if (spec.type != Type::Array) {
+            throw std::runtime_error("INVALID_PIPELINE (Use AGGREGATE [{\"$match\": {...}}, {\"$group\": {...}}])");
+        }
+
+        Pipeline p;
+        for (const auto& item : spec.asArray()) {
+            if (!item || item->type != Type::Object || item->asObject().size() != 1) {
+                throw std::runtime_error("INVALID_PIPELINE (one {\"$stage\": ...} per element)");
+            }
+            const auto& [name, arg] = *item->asObject().begin();
+            if (!arg) throw invalid(name);
+
+            Stage s;
+            if (name == "$match") {
+                if (arg->type != Type::Object) throw invalid(name);
+                s.kind = Kind::Match;
+                s.match = arg->asObject();
+            } else if (name == "$group") {
+                if (arg->type != Type::Object) throw invalid(name);
+                s.kind = Kind::Group;
+                s.group = parseGroup(arg->asObject());
+            } else if (name == "$sort") {
+                s.kind = Kind::Sort;
+                if (!ResultOrder::parse(*arg, s.order)) throw invalid(name);
+            } else if (name == "$skip") {
+                s.kind = Kind::Skip;
+                s.count = parseCount(*arg, name);
+            } else if (name == "$limit") {
+                s.kind = Kind::Limit;
+                s.count = parseCount(*arg, name);
+            } else if (name == "$project") {
+                if (arg->type != Type::Object) throw invalid(name);
+                s.kind = Kind::Project;
+                s.project = parseProject(arg->asObject());
+            } else {
+                throw std::runtime_error("UNKNOWN_STAGE " + name);
+            }
+            p.stages.push_back(std::move(s));
+        }
+        return p;
+    }
+
+    // A leading $match takes the FIND index path (hash/sorted lookups, else a parallel scan) and
+    // feeds a following $group straight from the scan workers; documents are never copied for it
+    std::vector<Document> run(Collection& col, const QueryProgram::RegexCompiler& compileRegex) const {
+        size_t i = 0;
+        Document query;
+        if (!stages.empty() && stages[0].kind == Kind::Match) {
+            query = stages[0].match;
+            i = 1;
+        }
+
+        QueryProgram program = QueryProgram::compile(query, compileRegex);
+        auto predicate = [&program](const Document& doc) { return program.matches(doc); };
+        std::vector<Id> ids;
+        bool indexed = !query.empty() && col.planCandidates(query, ids);
+
+        std::vector<Document> rows;
+        if (i < stages.size() && stages[i].kind == Kind::Group) {
+            GroupAggregator agg(stages[i].group, ThreadPool::instance().size());
+            if (indexed) {
+                col.forEachById(ids, [&](Id, const Document& doc) {
+                    if (program.matches(doc)) agg.add(0, doc);
+                });
+            } else {
+                col.forEachMatching(predicate, [&](size_t slot, Id, const Document& doc) { agg.add(slot, doc); });
+            }
+            rows = agg.finish();
+            i++;
+        } else {
+            // documents flow on as rows ("_id" = document id); a $sort + $limit right here bounds the scan
+            std::vector<Id> matched;
+            if (indexed) {
+                matched = std::move(ids);
+            } else {
+                size_t j = i, limit = SIZE_MAX;
+                const ResultOrder* order = nullptr;
+                if (j < stages.size() && stages[j].kind == Kind::Sort) order = &stages[j++].order;
+                if (j < stages.size() && stages[j].kind == Kind::Limit) limit = stages[j].count;
+
+                if (!order) matched = col.findAll(predicate, limit);
+                else if (limit != SIZE_MAX) matched = col.findTopK(predicate, *order, limit);
+                else matched = col.findAll(predicate);
+            }
+
+            col.forEachById(matched, [&](Id id, const Document& doc) {
+                if (indexed && !program.matches(doc)) return;
+                Document row = doc;
+                row["_id"] = std::make_shared<Value>(static_cast<int64_t>(id));
+                rows.push_back(std::move(row));
+            });
+        }
+
+        for (; i < stages.size(); ++i) apply(stages[i], rows, compileRegex);
+        return rows;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,520 @@
+#ifndef ASYNC_FILE_HPP
+#define ASYNC_FILE_HPP
+
+#include "file_io.hpp"
+#include "byte_sink.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <ostream>
+#include <streambuf>
+#include <cstring>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#if defined(IORING_FEAT_NODROP) && defined(__NR_io_uring_setup)
+#define FLUX_IO_URING
+#endif
+#endif
+#endif
+
+namespace fluxdb {
+
+#ifdef FLUX_IO_URING
+// Just enough io_uring for AsyncFile, on the raw syscalls (no liburing): one submitting
+// thread, writes and fsyncs. Kernels before 5.5 (no IORING_FEAT_NODROP) are refused, so a
+// full completion queue never drops an entry
+class IoRing {
+private:
+    int fd = -1;
+    unsigned entries = 0;
+    unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_array = nullptr, sq_mask = 0;
+    unsigned *cq_head = nullptr, *cq_tail = nullptr, cq_mask = 0;
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    size_t sq_bytes = 0, cq_bytes = 0;
+    unsigned filled = 0; // SQEs written but not published to the kernel yet
+
+    int enter(unsigned submit, unsigned wait) {
+        while (true) {
+            long r = syscall(__NR_io_uring_enter, fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (r >= 0 || errno != EINTR) return static_cast<int>(r);
+        }
+    }
+
+public:
+    IoRing() = default;
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+    ~IoRing() { close(); }
+
+    bool open(unsigned depth) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &p));
+        if (fd < 0) return false;
+        if (!(p.features & IORING_FEAT_NODROP)) {
+            close();
+            return false;
+        }
+        entries = p.sq_entries;
+        sq_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_bytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_bytes = cq_bytes = std::max(sq_bytes, cq_bytes);
+
+        sq_ring = ::mmap(nullptr, sq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cq_ring = single ? sq_ring : ::mmap(nullptr, cq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        void* s = ::mmap(nullptr, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || s == MAP_FAILED) {
+            if (s != MAP_FAILED) ::munmap(s, p.sq_entries * sizeof(io_uring_sqe));
+            close();
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(s);
+
+        char* sq = static_cast<char*>(sq_ring);
+        char* cq = static_cast<char*>(cq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    unsigned capacity() const { return entries; }
+
+    // Fixed buffers for IORING_OP_WRITE_FIXED (pinned once instead of on every write)
+    bool registerBuffers(const std::vector<iovec>& buffers) {
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+    }
+
+    // The next submission entry, cleared; the caller keeps no more than capacity() in flight
+    io_uring_sqe* next() {
+        unsigned index = (*sq_tail + filled) & sq_mask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        filled++;
+        return sqe;
+    }
+
+    // Publishes what next() filled and hands everything not yet consumed to the kernel;
+    // with wait, also blocks until a completion is there
+    bool submit(bool wait = false) {
+        unsigned tail = *sq_tail + filled;
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+        filled = 0;
+        unsigned pending = tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (!pending && !wait) return true;
+        return enter(pending, wait ? 1 : 0) >= 0;
+    }
+
+    // fn(user_data, res) for every completion that arrived
+    template <typename Fn>
+    void reap(Fn&& fn) {
+        unsigned head = *cq_head, tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & cq_mask];
+            fn(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    void close() {
+        if (sqes) ::munmap(sqes, entries * sizeof(io_uring_sqe));
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) ::munmap(cq_ring, cq_bytes);
+        if (sq_ring != MAP_FAILED) ::munmap(sq_ring, sq_bytes);
+        sqes = nullptr;
+        sq_ring = cq_ring = MAP_FAILED;
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+};
+#endif
+
+// Positional writes and syncs of one file, queued ahead of the (single) submitting thread:
+// write() returns a ticket, wait(ticket) blocks until everything up to it is done. A write
+// with sync is followed by an fdatasync that only starts once it finished (linked on
+// io_uring). Every file has an I/O thread of its own that does the writes, through io_uring
+// where the kernel has it, otherwise as plain syscalls. The ring is opened, used and closed on
+// that thread alone: the kernel signals a ring's owner (closing it makes the owner's next
+// blocking recv() with a timeout fail with EINTR), which must not be a client's thread. Data
+// must stay untouched until its ticket is done. After a failure every later wait() reports
+// false. Worth it when writes queue up (snapshot files); a lone write + sync waited for at
+// once (a WAL commit) is faster as plain syscalls, io_uring hands the fsync to a kernel worker
+class AsyncFile {
+public:
+    static constexpr unsigned DEPTH = 16;
+
+    // Off: new files use plain syscalls even where io_uring works (benchmarks)
+    static std::atomic<bool>& ioUringAllowed() {
+        static std::atomic<bool> allowed{ true };
+        return allowed;
+    }
+
+private:
+    RandomAccessFile file;
+    uint64_t submitted = 0;
+    bool broken = false;
+
+    struct Op {
+        uint64_t offset;
+        const char* data;
+        size_t size;
+        bool sync;
+        int bufIndex;
+        uint64_t ticket;
+    };
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable work_cv, done_cv;
+    std::deque<Op> queue;
+    uint64_t finished = 0;
+    bool stopping = false;
+    bool started = false;   // the worker has picked its backend
+    bool uring = false;     // ... and it is io_uring
+
+    bool perform(const Op& op) {
+        bool ok = op.size == 0 || file.writeAt(op.offset, op.data, op.size);
+        return ok && (!op.sync || file.sync());
+    }
+
+    void run() {
+#ifdef FLUX_IO_URING
+        if (ioUringAllowed()) {
+            ring = std::make_unique<IoRing>();
+            if (ring->open(DEPTH)) {
+                runRing();
+                ring.reset(); // closed by the thread that owns it
+                return;
+            }
+            ring.reset();
+        }
+#endif
+        std::unique_lock<std::mutex> lk(mtx);
+        started = true;
+        done_cv.notify_all();
+        while (true) {
+            work_cv.wait(lk, [&] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            Op op = queue.front();
+            queue.pop_front();
+            lk.unlock();
+            bool ok = perform(op);
+            lk.lock();
+            if (!ok) broken = true;
+            finished = op.ticket;
+            done_cv.notify_all();
+        }
+    }
+
+#ifdef FLUX_IO_URING
+    // Worker thread only
+    struct Flight {
+        iovec iov;       // WRITEV reads it at submission, kept anyway until completion
+        unsigned left;   // completions still to come
+        bool ok = true;
+    };
+    std::unique_ptr<IoRing> ring;
+    std::map<uint64_t, Flight> flights; // ticket order: the first one bounds what is done
+    std::vector<iovec> fixed;           // set by registerBuffers() before the first write
+    unsigned sqes_out = 0;
+    bool ring_failed = false;
+
+    void complete(uint64_t data, int res) {
+        sqes_out--;
+        auto it = flights.find(data >> 1);
+        if (it == flights.end()) return;
+        Flight& f = it->second;
+        bool isWrite = (data & 1) == 0;
+        if (res < 0 || (isWrite && static_cast<size_t>(res) != f.iov.iov_len)) f.ok = false;
+        if (--f.left > 0) return;
+        if (!f.ok) ring_failed = true;
+        flights.erase(it);
+    }
+
+    // Blocks for one more completion; false if the ring itself failed
+    bool waitOne() {
+        if (!ring->submit(true)) {
+            ring_failed = true;
+            return false;
+        }
+        ring->reap([&](uint64_t data, int res) { complete(data, res); });
+        return true;
+    }
+
+    void ringWrite(const Op& op) {
+        unsigned need = (op.size ? 1 : 0) + (op.sync ? 1 : 0);
+        if (!need) return;
+        while (sqes_out + need > ring->capacity()) {
+            if (!waitOne()) return;
+        }
+        Flight& f = flights[op.ticket];
+        f.iov.iov_base = const_cast<char*>(op.data);
+        f.iov.iov_len = op.size;
+        f.left = need;
+        if (op.size) {
+            io_uring_sqe* sqe = ring->next();
+            sqe->fd = file.handle();
+            sqe->off = op.offset;
+            sqe->user_data = op.ticket << 1;
+            if (static_cast<size_t>(op.bufIndex) < fixed.size()) {
+                sqe->opcode = IORING_OP_WRITE_FIXED;
+                sqe->addr = reinterpret_cast<uint64_t>(op.data);
+                sqe->len = static_cast<uint32_t>(op.size);
+                sqe->buf_index = static_cast<uint16_t>(op.bufIndex);
+            } else {
+                sqe->opcode = IORING_OP_WRITEV;
+                sqe->addr = reinterpret_cast<uint64_t>(&f.iov);
+                sqe->len = 1;
+            }
+            if (op.sync) sqe->flags |= IOSQE_IO_LINK; // a failed or short write cancels the sync
+        }
+        if (op.sync) {
+            io_uring_sqe* sqe = ring->next();
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fd = file.handle();
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            sqe->user_data = (op.ticket << 1) | 1;
+        }
+        sqes_out += need;
+        if (!ring->submit()) {
+            ring_failed = true;
+            sqes_out -= need;
+            flights.erase(op.ticket);
+        }
+    }
+
+    // Hands what is queued to the ring, then waits for a completion; done counts up to the
+    // oldest ticket still in flight
+    void runRing() {
+        std::unique_lock<std::mutex> lk(mtx);
+        started = uring = true;
+        done_cv.notify_all();
+        uint64_t taken = 0; // last ticket off the queue
+        while (true) {
+            if (queue.empty() && flights.empty()) {
+                work_cv.wait(lk, [&] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+            }
+            std::deque<Op> batch;
+            batch.swap(queue);
+            lk.unlock();
+            for (const Op& op : batch) {
+                ringWrite(op);
+                taken = op.ticket;
+            }
+            if (!flights.empty() && !waitOne()) flights.clear(); // ring gone: what's left failed
+            lk.lock();
+            if (ring_failed) broken = true;
+            finished = flights.empty() ? taken : flights.begin()->first - 1;
+            done_cv.notify_all();
+        }
+    }
+#endif
+
+public:
+    AsyncFile() = default;
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+    ~AsyncFile() { close(); }
+
+    bool open(const std::string& path, bool truncate = false) {
+        close();
+        if (!file.open(path, truncate)) return false;
+        submitted = finished = 0;
+        broken = stopping = started = uring = false;
+#ifdef FLUX_IO_URING
+        fixed.clear();
+        flights.clear();
+        sqes_out = 0;
+        ring_failed = false;
+#endif
+        worker = std::thread(&AsyncFile::run, this);
+        std::unique_lock<std::mutex> lk(mtx);
+        done_cv.wait(lk, [&] { return started; });
+        return true;
+    }
+
+    bool isOpen() const { return file.isOpen(); }
+
+    const char* backend() const { return uring ? "io_uring" : "thread"; }
+
+    // io_uring only, before the first write: buffers write() may then be given by index
+    // (pinned once, not per write). They must outlive the file or the next open()
+    bool registerBuffers(const std::vector<std::pair<char*, size_t>>& buffers) {
+#ifdef FLUX_IO_URING
+        if (!uring) return false;
+        std::lock_guard<std::mutex> lk(mtx); // publishes fixed to the worker
+        std::vector<iovec> iovs;
+        for (const auto& [p, n] : buffers) iovs.push_back({ p, n });
+        if (!ring->registerBuffers(iovs)) return false;
+        fixed = std::move(iovs);
+        return true;
+#else
+        (void)buffers;
+        return false;
+#endif
+    }
+
+    // size bytes at offset (none: just the sync); bufIndex = a registered buffer holding them
+    uint64_t write(uint64_t offset, const char* data, size_t size, bool sync = false, int bufIndex = -1) {
+        Op op{ offset, data, size, sync, bufIndex, 0 };
+        std::lock_guard<std::mutex> lk(mtx);
+        op.ticket = ++submitted;
+        queue.push_back(op);
+        work_cv.notify_one();
+        return op.ticket;
+    }
+
+    uint64_t sync() { return write(0, nullptr, 0, true); }
+
+    // Everything up to ticket done; false if anything so far failed
+    bool wait(uint64_t ticket) {
+        std::unique_lock<std::mutex> lk(mtx);
+        done_cv.wait(lk, [&] { return finished >= ticket; });
+        return !broken;
+    }
+
+    bool waitAll() { return wait(submitted); }
+
+    // Waits for what is queued first
+    void close() {
+        if (!file.isOpen()) return;
+        if (worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                stopping = true;
+            }
+            work_cv.notify_one();
+            worker.join();
+        }
+        file.close();
+    }
+};
+
+// Write-behind file sink: records are encoded into one of DEPTH buffers while the full ones
+// are on their way to the file, so encoding and disk writes overlap. The buffers are
+// allocated once and registered with io_uring; one that had to grow past its size (a huge
+// record) goes out as a plain write from then on. finish() syncs and closes
+class FileSink : public BufferSink {
+private:
+    static constexpr size_t DEPTH = 4;
+
+    // Lets code written against std::ostream (index trailer, vector graphs) write here too
+    class Stream : public std::streambuf {
+    private:
+        FileSink& sink;
+
+    protected:
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            sink.write(s, static_cast<size_t>(n));
+            return n;
+        }
+        int_type overflow(int_type c) override {
+            if (c != traits_type::eof()) sink.put(static_cast<uint8_t>(c));
+            return traits_type::not_eof(c);
+        }
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override {
+            if (off != 0 || dir != std::ios_base::cur) return pos_type(off_type(-1));
+            return pos_type(static_cast<off_type>(sink.position()));
+        }
+
+    public:
+        explicit Stream(FileSink& s) : sink(s) {}
+    };
+
+    size_t flush_at;
+    std::vector<std::vector<char>> pool;
+    std::vector<uint64_t> tickets; // last write out of each buffer
+    std::vector<size_t> pinned;    // capacity when registered (0 = not), growing ends it
+    size_t current = 0;
+    uint64_t written = 0;          // bytes handed to the file
+    AsyncFile file;                // after the buffers: closed before they go
+    Stream adapter{ *this };
+    std::ostream out{ &adapter };
+
+    void fillNext() {
+        current = (current + 1) % DEPTH;
+        file.wait(tickets[current]);
+        buf = &pool[current];
+        buf->clear();
+    }
+
+public:
+    explicit FileSink(size_t flushAt = 1 << 20) : flush_at(flushAt), pool(DEPTH), tickets(DEPTH, 0), pinned(DEPTH, 0) {
+        for (auto& b : pool) b.reserve(flushAt + flushAt / 4); // records may run past flush_at
+        buf = &pool[0];
+    }
+
+    // A new (truncated) file at path
+    bool open(const std::string& path) {
+        if (!file.open(path, true)) return false;
+        std::vector<std::pair<char*, size_t>> buffers;
+        for (auto& b : pool) buffers.emplace_back(b.data(), b.capacity());
+        bool fixed = file.registerBuffers(buffers);
+        for (size_t i = 0; i < DEPTH; ++i) pinned[i] = fixed ? pool[i].capacity() : 0;
+        return true;
+    }
+
+    const char* backend() const { return file.backend(); }
+
+    // Pieces of any size (snapshot blocks) are cut at the buffer size
+    void write(const void* data, size_t n) {
+        const char* p = static_cast<const char*>(data);
+        while (n > 0) {
+            if (size() >= flush_at) flush();
+            size_t k = std::min(n, flush_at - size());
+            BufferSink::write(p, k);
+            p += k;
+            n -= k;
+        }
+    }
+
+    void flushIfFull() {
+        if (size() >= flush_at) flush();
+    }
+
+    void flush() {
+        if (!size()) return;
+        std::vector<char>& b = pool[current];
+        if (b.capacity() != pinned[current]) pinned[current] = 0; // reallocated: not the pinned memory
+        tickets[current] = file.write(written, b.data(), b.size(), false, pinned[current] ? static_cast<int>(current) : -1);
+        written += b.size();
+        fillNext();
+    }
+
+    // Offset in the file of the next byte written
+    uint64_t position() const { return written + size(); }
+
+    std::ostream& stream() { return out; }
+
+    // Everything on stable storage and the file closed; false if any write failed
+    bool finish() {
+        flush();
+        bool ok = file.wait(file.sync());
+        file.close();
+        return ok;
+    }
+};
+
+}
+
+#endif
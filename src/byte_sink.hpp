@@ -0,0 +1,82 @@
+#ifndef BYTE_SINK_HPP
+#define BYTE_SINK_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace fluxdb {
+
+// Where encoded bytes go: a growable buffer the Serializer appends to directly. A BufferSink
+// appends to the caller's vector (a WAL batch, a snapshot block) or to one of its own that is
+// kept, capacity included, across uses. FileSink (async_file.hpp) and SocketSink drain it
+// between records, so a record is always whole in the buffer while it is being written
+class BufferSink {
+public:
+    BufferSink() : buf(&own) {}
+    explicit BufferSink(std::vector<char>& out) : buf(&out) {}
+    BufferSink(const BufferSink&) = delete;
+    BufferSink& operator=(const BufferSink&) = delete;
+
+    void put(uint8_t b) { buf->push_back(static_cast<char>(b)); }
+
+    void write(const void* data, size_t n) {
+        const char* p = static_cast<const char*>(data);
+        buf->insert(buf->end(), p, p + n);
+    }
+
+    // Room for n more bytes; grows geometrically so repeated small reserves stay amortized
+    void reserve(size_t n) {
+        if (buf->capacity() - buf->size() >= n) return;
+        buf->reserve(std::max(buf->size() + n, buf->capacity() * 2));
+    }
+
+    size_t size() const { return buf->size(); }
+    char* data() { return buf->data(); }
+    void clear() { buf->clear(); }
+    std::vector<char>& bytes() { return *buf; }
+
+    // A varint length in front of bytes not written yet: openLength() leaves room for one
+    // that fits `expected`, closeLength() writes the real one there, moving the bytes after
+    // it if it needs a different width
+    struct LengthMark {
+        size_t at, width;
+    };
+
+    LengthMark openLength(size_t expected) {
+        size_t width = varintWidth(expected);
+        LengthMark mark{ buf->size(), width };
+        buf->resize(buf->size() + width);
+        return mark;
+    }
+
+    void closeLength(LengthMark mark) {
+        size_t len = buf->size() - mark.at - mark.width;
+        size_t width = varintWidth(len);
+        if (width > mark.width) {
+            buf->insert(buf->begin() + static_cast<std::ptrdiff_t>(mark.at + mark.width), width - mark.width, 0);
+        } else if (width < mark.width) {
+            buf->erase(buf->begin() + static_cast<std::ptrdiff_t>(mark.at + width), buf->begin() + static_cast<std::ptrdiff_t>(mark.at + mark.width));
+        }
+        char* p = buf->data() + mark.at;
+        for (; len >= 0x80; len >>= 7) *p++ = static_cast<char>(len | 0x80);
+        *p = static_cast<char>(len);
+    }
+
+    static size_t varintWidth(uint64_t v) {
+        size_t n = 1;
+        for (; v >= 0x80; v >>= 7) n++;
+        return n;
+    }
+
+private:
+    std::vector<char> own;
+
+protected:
+    std::vector<char>* buf;
+};
+
+}
+
+#endif
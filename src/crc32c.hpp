@@ -0,0 +1,93 @@
+#ifndef CRC32C_HPP
+#define CRC32C_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define FLUX_CRC32C_SSE42
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define FLUX_CRC32C_ARM
+#endif
+
+namespace fluxdb {
+
+// CRC32C (Castagnoli), the checksum of WAL frames. The crc32 instruction when the build
+// enables it (-msse4.2 / -march=native, ARMv8 CRC), slicing-by-8 tables otherwise
+namespace crc32c {
+
+namespace detail {
+
+struct Tables {
+    uint32_t t[8][256];
+
+    Tables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int s = 1; s < 8; ++s) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+        }
+    }
+};
+
+inline const Tables& tables() {
+    static const Tables instance;
+    return instance;
+}
+
+inline uint32_t software(uint32_t crc, const uint8_t* p, size_t n) {
+    const auto& t = tables().t;
+    while (n >= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8); // little-endian hosts only, like the rest of the file formats
+        word ^= crc;
+        crc = t[7][word & 0xFF] ^ t[6][(word >> 8) & 0xFF] ^ t[5][(word >> 16) & 0xFF] ^ t[4][(word >> 24) & 0xFF] ^
+              t[3][(word >> 32) & 0xFF] ^ t[2][(word >> 40) & 0xFF] ^ t[1][(word >> 48) & 0xFF] ^ t[0][word >> 56];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+}
+
+// Continues crc over n more bytes (start from 0)
+inline uint32_t extend(uint32_t crc, const void* data, size_t n) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+#if defined(FLUX_CRC32C_SSE42)
+    uint64_t c = crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        c = _mm_crc32_u64(c, word);
+    }
+    crc = static_cast<uint32_t>(c);
+    for (; n > 0; --n) crc = _mm_crc32_u8(crc, *p++);
+#elif defined(FLUX_CRC32C_ARM)
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        crc = __crc32cd(crc, word);
+    }
+    for (; n > 0; --n) crc = __crc32cb(crc, *p++);
+#else
+    crc = detail::software(crc, p, n);
+#endif
+    return ~crc;
+}
+
+inline uint32_t value(const void* data, size_t n) { return extend(0, data, n); }
+
+}
+
+}
+
+#endif
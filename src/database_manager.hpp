@@ -109,10 +109,17 @@ public:
 
         std::string wal = DATA_FOLDER + "/" + name + ".wal";
         std::string snap = DATA_FOLDER + "/" + name + ".flux";
+        std::string memory = DATA_FOLDER + "/" + name + ".memory";
+        std::string durability = DATA_FOLDER + "/" + name + ".durability";
+        std::string compression = DATA_FOLDER + "/" + name + ".compression";
+        std::string pages = DATA_FOLDER + "/" + name + ".pages"; // left behind by a crash
         
         try {
-            if (fs::exists(wal)) fs::remove(wal);
-            if (fs::exists(snap)) fs::remove(snap);
+            if (!PersistenceManager::removeFiles(wal, snap)) return false;
+            if (fs::exists(memory)) fs::remove(memory);
+            if (fs::exists(durability)) fs::remove(durability);
+            if (fs::exists(compression)) fs::remove(compression);
+            if (fs::exists(pages)) fs::remove(pages);
             std::cout << "[DB Manager] Dropped database '" << name << "'\n";
             return true;
         } catch (const std::exception& e) {
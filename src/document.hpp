@@ -216,7 +216,7 @@ struct ValueLess {              // Number < Bool < String < Object
 struct ValueHasher {
     std::size_t operator()(const Value& v) const {
 
-        std::size_t h = std::hash<int>{}(static_cast<int>(v.type)); 
+        std::size_t h = std::hash<int>{}(ValueLess::getRank(v)); // 3 and 3.0 are ==, so they must hash alike
 
         std::size_t d_hash = 0;
 
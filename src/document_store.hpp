@@ -0,0 +1,778 @@
+#ifndef DOCUMENT_STORE_HPP
+#define DOCUMENT_STORE_HPP
+
+#include "document.hpp"
+#include "serializer.hpp"
+#include "page_file.hpp"
+#include <vector>
+#include <array>
+#include <memory>
+#include <optional>
+#include <iterator>
+#include <queue>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <iostream>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace fluxdb {
+
+using Id = std::uint64_t;
+
+// Index of the lowest set bit; bits must not be 0
+inline size_t lowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, bits);
+    return static_cast<size_t>(i);
+#else
+    return static_cast<size_t>(__builtin_ctzll(bits));
+#endif
+}
+
+// Primary storage ordered by id: a directory of fixed-size pages (id >> PAGE_BITS), each a
+// slot array plus a bitmap of live slots. Ids come from next_id so pages fill densely; a page
+// is freed when its last document goes. Pages double as the morsels of a parallel scan.
+// Copies share pages copy-on-write: copying the store only copies the directory, and whichever
+// side writes to a shared page clones it first (checkpoints write from such a copy).
+// Slots written or erased since the last clearDirty() are tracked per page, so a checkpoint
+// can save just those.
+// Paged mode (setPaging): pages are also the unit of a buffer pool. Past the memory budget,
+// trim() evicts pages to a PageFile in CLOCK order and reads fault them back, so an id is
+// its own page/slot locator and indexes need nothing else. A point read of an evicted page
+// fetches just its record the first time and the whole page on a second miss (2Q style),
+// so a cold document costs one small read and a scan of cold pages evicts nothing hot
+class DocumentStore {
+public:
+    static constexpr size_t PAGE_BITS = 10;
+    static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+    using value_type = std::pair<const Id, Document>;
+
+private:
+    using Bits = std::array<uint64_t, PAGE_SIZE / 64>;
+
+    struct Page {
+        std::array<std::optional<value_type>, PAGE_SIZE> slots;
+        Bits live{};
+        size_t count = 0;
+
+        // paged mode only
+        size_t bytes = 0;                              // estimated memory of the page and its documents
+        Bits resizing{};                               // slots handed out for writing, counted again by settle()
+        mutable std::atomic<bool> referenced{ true };  // CLOCK: used since the hand last passed
+
+        Page() = default;
+        Page(const Page& o) : slots(o.slots), live(o.live), count(o.count), bytes(o.bytes), resizing(o.resizing) {}
+
+        bool has(size_t i) const { return live[i / 64] >> (i % 64) & 1; }
+
+        // fn(entry) over the live slots in [from, to), false from fn stops the walk
+        template <typename Fn>
+        bool forEach(size_t from, size_t to, Fn&& fn) const {
+            for (size_t w = from / 64; w * 64 < to; ++w) {
+                uint64_t bits = live[w];
+                if (w == from / 64) bits &= ~uint64_t(0) << (from % 64);
+                while (bits) {
+                    size_t i = w * 64 + lowestBit(bits);
+                    if (i >= to) return true;
+                    if (!fn(*slots[i])) return false;
+                    bits &= bits - 1;
+                }
+            }
+            return true;
+        }
+    };
+
+    std::vector<std::shared_ptr<Page>> pages;
+    size_t count = 0;
+    std::vector<Bits> dirty; // by page, may outlive the page
+    size_t dirty_count = 0;
+    bool all_dirty = false;  // cleared: nothing written before counts
+
+    // Paged mode. A page is resident (in pages), evicted (only in spilled) or both while its
+    // copy in the file is current. Readers under a shared lock can't touch the directory, so
+    // what they read back and keep goes to faulted until trim() adopts it
+    std::shared_ptr<PageFile> page_file; // null: every page stays in memory
+    std::vector<std::shared_ptr<const PageFile::Extent>> spilled;
+    size_t budget = 0;
+    mutable std::atomic<size_t> resident{ 0 }; // estimated bytes of resident and faulted pages
+    std::vector<Id> resized;           // slots whose new size settle() still adds
+    size_t hand = 0;                   // CLOCK
+    uint64_t evictions = 0;
+    bool spill_failed = false;
+    mutable std::mutex fault_lock;
+    mutable std::unordered_map<size_t, std::shared_ptr<Page>> faulted;
+    mutable std::unordered_map<size_t, uint64_t> ghosts; // evicted page -> miss that last read a record of it
+    mutable uint64_t misses = 0;
+    size_t typical_page = 0; // bytes, averaged over evictions
+    Serializer spill_writer;
+    std::vector<char> spill_buffer;
+
+    void touch(size_t p, size_t s) {
+        if (p >= dirty.size()) dirty.resize(p + 1);
+        uint64_t bit = uint64_t(1) << (s % 64);
+        if (dirty[p][s / 64] & bit) return;
+        dirty[p][s / 64] |= bit;
+        dirty_count++;
+    }
+
+    static size_t pageOf(Id id) { return static_cast<size_t>(id >> PAGE_BITS); }
+    static size_t slotOf(Id id) { return static_cast<size_t>(id & (PAGE_SIZE - 1)); }
+
+    bool isSpilled(size_t p) const { return p < spilled.size() && spilled[p]; }
+    bool exists(size_t p) const { return p < pages.size() && (pages[p] || isSpilled(p)); }
+
+    // Rough heap use of documents (map nodes, keys, shared values, string bodies)
+    static size_t footprint(const Value& v) {
+        size_t n = sizeof(Value) + 16;
+        if (v.type == Type::String) return n + v.asString().capacity();
+        if (v.type == Type::Object) return n + footprint(v.asObject());
+        if (v.type == Type::Array) {
+            for (const auto& e : v.asArray()) n += sizeof(e) + (e ? footprint(*e) : 0);
+        }
+        return n;
+    }
+
+    static size_t footprint(const Document& doc) {
+        size_t n = 64 + doc.bucket_count() * sizeof(void*);
+        for (const auto& [key, value] : doc) n += 64 + key.capacity() + (value ? footprint(*value) : 0);
+        return n;
+    }
+
+    // How a read treats an evicted page: Keep installs it whatever the budget says (the caller
+    // trims afterwards), Walk only while there is room and otherwise leaves it to `hold`
+    enum class ReadBack { Keep, Walk };
+
+public:
+    // An evicted page (or a single record of one) read back for one caller, which keeps it
+    // alive (and the documents it was handed valid) until the next read through the same
+    // Hold or its end
+    class Hold {
+    private:
+        friend class DocumentStore;
+        size_t page = SIZE_MAX;
+        std::shared_ptr<Page> data;
+        Document record;
+    };
+
+private:
+    std::shared_ptr<Page> readBack(const PageFile::Extent& at) const {
+        auto page = std::make_shared<Page>();
+        page->bytes = sizeof(Page);
+        std::vector<char> bytes;
+        if (!page_file->read(at, bytes)) {
+            std::cerr << "[Paging] Cannot read a page from " << page_file->filePath() << ", its documents are missing from this read.\n";
+            return page;
+        }
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes.data());
+        size_t pos = 0;
+        uint64_t id = 0, size = 0;
+        while (pos < bytes.size() && varint::get(p, bytes.size(), pos, id) && varint::get(p, bytes.size(), pos, size) && size <= bytes.size() - pos) {
+            Deserializer reader(p + pos, static_cast<size_t>(size));
+            pos += static_cast<size_t>(size);
+            size_t s = slotOf(id);
+            page->slots[s].emplace(id, reader.deserialize());
+            page->live[s / 64] |= uint64_t(1) << (s % 64);
+            page->count++;
+            page->bytes += footprint(page->slots[s]->second);
+        }
+        return page;
+    }
+
+    // Page p for reading: resident, faulted in already, or read back now (see ReadBack)
+    const Page* readable(size_t p, Hold& hold, ReadBack mode) const {
+        if (p >= pages.size()) return nullptr;
+        if (const Page* page = pages[p].get()) {
+            if (page_file && !page->referenced.load(std::memory_order_relaxed)) page->referenced.store(true, std::memory_order_relaxed);
+            return page;
+        }
+        if (!isSpilled(p)) return nullptr;
+        if (hold.page == p && hold.data) return hold.data.get();
+        {
+            std::lock_guard<std::mutex> lk(fault_lock);
+            auto it = faulted.find(p);
+            if (it != faulted.end()) return it->second.get();
+        }
+
+        std::shared_ptr<Page> page = readBack(*spilled[p]);
+        std::lock_guard<std::mutex> lk(fault_lock);
+        auto it = faulted.find(p); // another reader may have been quicker
+        if (it != faulted.end()) return it->second.get();
+        if (mode == ReadBack::Keep || resident.load() + page->bytes <= budget) {
+            resident += page->bytes;
+            return faulted.emplace(p, std::move(page)).first->second.get();
+        }
+        hold.page = p;
+        hold.data = std::move(page);
+        return hold.data.get();
+    }
+
+    const Page* readable(size_t p) const {
+        Hold hold;
+        return readable(p, hold, ReadBack::Keep);
+    }
+
+    // Point read of evicted page p: true once it is worth bringing in whole, false while
+    // single records do. A page missed twice within as many misses as the budget holds
+    // pages is at least as hot as what is resident (LRU-2); one a reader brought in already
+    // is taken as it is
+    bool admit(size_t p) const {
+        std::lock_guard<std::mutex> lk(fault_lock);
+        if (faulted.count(p)) return true;
+        uint64_t now = ++misses, window = budget / std::max<size_t>(typical_page, 1) + 1;
+        auto it = ghosts.find(p);
+        if (it != ghosts.end() && now - it->second <= window) {
+            ghosts.erase(it);
+            return true;
+        }
+        ghosts[p] = now;
+        if (ghosts.size() > 2 * window + 64) {
+            for (auto g = ghosts.begin(); g != ghosts.end();) g = now - g->second > window ? ghosts.erase(g) : std::next(g);
+        }
+        return false;
+    }
+
+    // Slot s of an evicted page read on its own into hold; nullptr if it is empty
+    const Document* readRecord(const PageFile::Extent& at, size_t s, Hold& hold) const {
+        uint32_t from = at.records[s], to = at.records[s + 1];
+        if (from == to) return nullptr;
+        std::vector<char> bytes;
+        if (!page_file->read(at, from, to, bytes)) {
+            std::cerr << "[Paging] Cannot read a record from " << page_file->filePath() << ", it is missing from this read.\n";
+            return nullptr;
+        }
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes.data());
+        size_t pos = 0;
+        uint64_t id = 0, size = 0;
+        if (!varint::get(p, bytes.size(), pos, id) || !varint::get(p, bytes.size(), pos, size) || size > bytes.size() - pos) return nullptr;
+        hold.record = Deserializer(p + pos, static_cast<size_t>(size)).deserialize();
+        return &hold.record;
+    }
+
+    // Evicted page p back in the directory: the copy a reader brought in, or read now
+    void adopt(size_t p) {
+        std::shared_ptr<Page> page;
+        {
+            std::lock_guard<std::mutex> lk(fault_lock);
+            auto it = faulted.find(p);
+            if (it != faulted.end()) {
+                page = std::move(it->second);
+                faulted.erase(it);
+            }
+        }
+        if (!page) {
+            page = readBack(*spilled[p]);
+            resident += page->bytes;
+        }
+        pages[p] = std::move(page);
+    }
+
+    // Page p, ready to be modified: allocated if missing, read back if evicted, cloned if a
+    // copy still shares it. Its copy in the page file is out of date from here on.
+    // Copies are made under the owner's lock and dropped while no writer runs, so use_count is stable
+    Page& writable(size_t p) {
+        if (!pages[p] && isSpilled(p)) adopt(p);
+        if (!pages[p]) {
+            pages[p] = std::make_shared<Page>();
+            if (page_file) {
+                pages[p]->bytes = sizeof(Page);
+                resident += sizeof(Page);
+            }
+        } else if (pages[p].use_count() > 1) {
+            pages[p] = std::make_shared<Page>(*pages[p]);
+        }
+        if (isSpilled(p)) spilled[p].reset();
+        pages[p]->referenced.store(true, std::memory_order_relaxed);
+        return *pages[p];
+    }
+
+    // Paged mode: a slot handed out for writing. Its old size comes off now, settle() adds the
+    // new one once the caller is done with it
+    void unsize(Page& page, Id id) {
+        size_t s = slotOf(id);
+        uint64_t bit = uint64_t(1) << (s % 64);
+        if (page.resizing[s / 64] & bit) return;
+        page.resizing[s / 64] |= bit;
+        size_t n = footprint(page.slots[s]->second);
+        page.bytes -= n;
+        resident -= n;
+        resized.push_back(id);
+    }
+
+    void settle() {
+        for (Id id : resized) {
+            size_t p = pageOf(id), s = slotOf(id);
+            Page* page = p < pages.size() ? pages[p].get() : nullptr;
+            uint64_t bit = uint64_t(1) << (s % 64);
+            if (!page || !(page->resizing[s / 64] & bit)) continue;
+            page->resizing[s / 64] &= ~bit;
+            size_t n = footprint(page->slots[s]->second);
+            page->bytes += n;
+            resident += n;
+        }
+        resized.clear();
+    }
+
+    // The page's records (id | size | doc, the snapshot record) in the page file; nullptr on failure
+    std::shared_ptr<const PageFile::Extent> writeOut(const Page& page, Serializer& writer, std::vector<char>& buffer) const {
+        buffer.clear();
+        BufferSink out(buffer);
+        std::vector<uint32_t> records(PAGE_SIZE + 1);
+        page.forEach(0, PAGE_SIZE, [&](const value_type& entry) {
+            records[slotOf(entry.first)] = static_cast<uint32_t>(buffer.size());
+            writer.writeRecord(out, entry.first, entry.second);
+            return true;
+        });
+        records[PAGE_SIZE] = static_cast<uint32_t>(buffer.size());
+        for (size_t s = PAGE_SIZE; s-- > 0;) {
+            if (!page.has(s)) records[s] = records[s + 1]; // empty: no bytes
+        }
+        return page_file->write(buffer, static_cast<uint32_t>(page.count), std::move(records));
+    }
+
+    bool evict(size_t p) {
+        if (!isSpilled(p)) {
+            auto extent = writeOut(*pages[p], spill_writer, spill_buffer);
+            if (!extent) {
+                if (!spill_failed) std::cerr << "[Paging] Cannot write to " << page_file->filePath() << ", pages stay in memory.\n";
+                spill_failed = true;
+                return false;
+            }
+            if (spilled.size() <= p) spilled.resize(pages.size());
+            spilled[p] = std::move(extent);
+        }
+        resident -= pages[p]->bytes;
+        typical_page = typical_page ? (typical_page * 7 + pages[p]->bytes) / 8 : pages[p]->bytes;
+        pages[p].reset();
+        evictions++;
+        return true;
+    }
+
+public:
+    DocumentStore() = default;
+
+    // Shares pages (and evicted pages' extents); what readers faulted in stays with the original
+    DocumentStore(const DocumentStore& o)
+        : pages(o.pages), count(o.count), dirty(o.dirty), dirty_count(o.dirty_count), all_dirty(o.all_dirty),
+          page_file(o.page_file), spilled(o.spilled), budget(o.budget), resident(o.resident.load()) {}
+
+    DocumentStore& operator=(const DocumentStore&) = delete;
+
+    // Id order: next live slot, skipping freed pages. Evicted pages are read back for the
+    // walk (kept if the budget has room)
+    class const_iterator {
+    private:
+        const DocumentStore* store = nullptr;
+        size_t page = 0;
+        size_t slot = 0;
+        const Page* current = nullptr;
+        Hold hold;
+
+        void settle() {
+            for (; page < store->pages.size(); ++page, slot = 0, current = nullptr) {
+                if (!current) current = store->readable(page, hold, ReadBack::Walk);
+                if (!current) continue;
+                for (; slot < PAGE_SIZE; ++slot) {
+                    if (current->has(slot)) return;
+                }
+            }
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = DocumentStore::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator() = default;
+        const_iterator(const DocumentStore* s, size_t idx) : store(s), page(idx) {
+            settle();
+        }
+
+        reference operator*() const { return *current->slots[slot]; }
+        pointer operator->() const { return &**this; }
+
+        const_iterator& operator++() {
+            ++slot;
+            settle();
+            return *this;
+        }
+
+        bool operator==(const const_iterator& o) const { return page == o.page && slot == o.slot; }
+        bool operator!=(const const_iterator& o) const { return !(*this == o); }
+    };
+
+    // An evicted page is read back and kept (writers trim afterwards)
+    const Document* find(Id id) const {
+        const Page* p = readable(pageOf(id));
+        return p && p->has(slotOf(id)) ? &p->slots[slotOf(id)]->second : nullptr;
+    }
+
+    // Point read under a shared lock: the first miss on an evicted page reads just the
+    // record into hold, the next one brings the page back (the owner trims afterwards)
+    const Document* find(Id id, Hold& hold) const {
+        size_t p = pageOf(id), s = slotOf(id);
+        if (p < pages.size() && !pages[p] && isSpilled(p) && hold.page != p && !admit(p)) {
+            return readRecord(*spilled[p], s, hold);
+        }
+        const Page* page = readable(p, hold, ReadBack::Keep);
+        return page && page->has(s) ? &page->slots[s]->second : nullptr;
+    }
+
+    // For in-place modification (the page is unshared first)
+    Document* find(Id id) {
+        size_t p = pageOf(id), s = slotOf(id);
+        const Page* seen = readable(p);
+        if (!seen || !seen->has(s)) return nullptr;
+        Page& page = writable(p);
+        touch(p, s);
+        if (page_file) unsize(page, id);
+        return &page.slots[s]->second;
+    }
+
+    template <typename Doc>
+    bool emplace(Id id, Doc&& doc) {
+        size_t p = pageOf(id), s = slotOf(id);
+        if (p >= pages.size()) pages.resize(p + 1);
+        const Page* seen = readable(p);
+        if (seen && seen->has(s)) return false;
+
+        Page& page = writable(p);
+        page.slots[s].emplace(id, std::forward<Doc>(doc));
+        page.live[s / 64] |= uint64_t(1) << (s % 64);
+        page.count++;
+        count++;
+        touch(p, s);
+        if (page_file) {
+            size_t n = footprint(page.slots[s]->second);
+            page.bytes += n;
+            resident += n;
+        }
+        return true;
+    }
+
+    bool erase(Id id) {
+        size_t p = pageOf(id), s = slotOf(id);
+        const Page* seen = readable(p);
+        if (!seen || !seen->has(s)) return false;
+
+        Page& page = writable(p);
+        if (page_file) {
+            uint64_t bit = uint64_t(1) << (s % 64);
+            if (page.resizing[s / 64] & bit) page.resizing[s / 64] &= ~bit; // its size is off already
+            else {
+                size_t n = footprint(page.slots[s]->second);
+                page.bytes -= n;
+                resident -= n;
+            }
+        }
+        page.slots[s].reset();
+        page.live[s / 64] &= ~(uint64_t(1) << (s % 64));
+        count--;
+        touch(p, s);
+        if (--page.count == 0) {
+            if (page_file) resident -= page.bytes;
+            pages[p].reset();
+            while (!pages.empty() && !exists(pages.size() - 1)) pages.pop_back();
+            if (spilled.size() > pages.size()) spilled.resize(pages.size());
+        }
+        return true;
+    }
+
+    void clear() {
+        pages.clear();
+        spilled.clear();
+        {
+            std::lock_guard<std::mutex> lk(fault_lock);
+            faulted.clear();
+            ghosts.clear();
+        }
+        resident = 0;
+        resized.clear();
+        hand = 0;
+        count = 0;
+        clearDirty();
+        all_dirty = true;
+    }
+
+    // Ids written or erased since the last clearDirty(), in id order: fn(id, doc), doc is
+    // nullptr for an id no longer live. allDirty(): the store was cleared in between, so only
+    // a full copy describes it
+    template <typename Fn>
+    void forEachDirty(Fn&& fn) const {
+        for (size_t p = 0; p < dirty.size(); ++p) {
+            Hold hold;
+            const Page* page = nullptr;
+            bool read = false;
+            for (size_t w = 0; w < dirty[p].size(); ++w) {
+                for (uint64_t bits = dirty[p][w]; bits; bits &= bits - 1) {
+                    if (!read) {
+                        page = readable(p, hold, ReadBack::Walk);
+                        read = true;
+                    }
+                    size_t s = w * 64 + lowestBit(bits);
+                    Id id = (Id(p) << PAGE_BITS) + s;
+                    fn(id, page && page->has(s) ? &page->slots[s]->second : nullptr);
+                }
+            }
+        }
+    }
+
+    size_t dirtyCount() const { return dirty_count; }
+    bool allDirty() const { return all_dirty; }
+
+    void clearDirty() {
+        dirty.clear();
+        dirty_count = 0;
+        all_dirty = false;
+    }
+
+    void markAllDirty() { all_dirty = true; }
+
+    // Parallel bulk fill of an empty store: prepareLoad() sizes the directory once, then
+    // threads load() into disjoint pages (no shared state is touched) and hand each finished
+    // page to loaded(), finishLoad() settles the count. Ids must be below maxId
+    void prepareLoad(Id maxId) {
+        clear();
+        all_dirty = false;
+        pages.resize(pageOf(maxId) + 1);
+        if (page_file) spilled.resize(pages.size());
+    }
+
+    bool load(Id id, Document&& doc) {
+        size_t p = pageOf(id), s = slotOf(id);
+        if (!pages[p]) {
+            pages[p] = isSpilled(p) ? readBack(*spilled[p]) : std::make_shared<Page>();
+            if (page_file && !isSpilled(p)) pages[p]->bytes = sizeof(Page);
+            if (isSpilled(p)) spilled[p].reset();
+        }
+
+        Page& page = *pages[p];
+        if (page.has(s)) return false;
+        page.slots[s].emplace(id, std::move(doc));
+        page.live[s / 64] |= uint64_t(1) << (s % 64);
+        page.count++;
+        if (page_file) page.bytes += footprint(page.slots[s]->second);
+        return true;
+    }
+
+    // Paged mode: the page holding id is complete. It stays while the budget has room and
+    // goes straight to the page file otherwise
+    void loaded(Id id) {
+        size_t p = pageOf(id);
+        if (!page_file || !pages[p]) return;
+        size_t bytes = pages[p]->bytes;
+        if (resident.fetch_add(bytes) + bytes <= budget) return;
+        resident -= bytes;
+
+        Serializer writer;
+        std::vector<char> buffer;
+        auto extent = writeOut(*pages[p], writer, buffer);
+        if (!extent) {
+            resident += bytes;
+            return;
+        }
+        spilled[p] = std::move(extent);
+        pages[p].reset();
+    }
+
+    void finishLoad() {
+        count = 0;
+        for (size_t p = 0; p < pages.size(); ++p) count += pages[p] ? pages[p]->count : isSpilled(p) ? spilled[p]->docs : 0;
+        while (!pages.empty() && !exists(pages.size() - 1)) pages.pop_back();
+        if (spilled.size() > pages.size()) spilled.resize(pages.size());
+    }
+
+    static Id pageStart(Id id) { return id & ~Id(PAGE_SIZE - 1); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Live documents with lo <= id <= hi in id order; only allocated pages are visited.
+    // fn(id, doc) returns false to stop
+    template <typename Fn>
+    void forEachInRange(Id lo, Id hi, Fn&& fn) const {
+        if (lo > hi || pages.empty()) return;
+        size_t last = std::min(pageOf(hi), pages.size() - 1);
+        for (size_t p = pageOf(lo); p <= last; ++p) {
+            Hold hold;
+            const Page* page = readable(p, hold, ReadBack::Walk);
+            if (!page) continue;
+            size_t from = p == pageOf(lo) ? slotOf(lo) : 0;
+            size_t to = p == pageOf(hi) ? slotOf(hi) + 1 : PAGE_SIZE;
+            bool more = page->forEach(from, to, [&](const value_type& entry) {
+                return fn(entry.first, entry.second);
+            });
+            if (!more) return;
+        }
+    }
+
+    // Morsels for parallel scans (freed pages are empty morsels)
+    size_t pageCount() const { return pages.size(); }
+
+    template <typename Fn>
+    bool forEachInPage(size_t p, Fn&& fn) const {
+        Hold hold;
+        const Page* page = readable(p, hold, ReadBack::Walk);
+        if (!page) return true;
+        return page->forEach(0, PAGE_SIZE, [&](const value_type& entry) {
+            return fn(entry.first, entry.second);
+        });
+    }
+
+    // fn(refs) over every document in id order, in batches of whole pages held in memory
+    // until fn returns: one batch unless the store is paged, then about chunkBytes each
+    template <typename Fn>
+    void forEachChunk(size_t chunkBytes, Fn&& fn) const {
+        std::vector<std::pair<Id, const Document*>> refs;
+        std::vector<Hold> held;
+        size_t bytes = 0;
+        for (size_t p = 0; p < pages.size(); ++p) {
+            held.emplace_back();
+            const Page* page = readable(p, held.back(), ReadBack::Walk);
+            if (!page) continue;
+            page->forEach(0, PAGE_SIZE, [&](const value_type& entry) {
+                refs.emplace_back(entry.first, &entry.second);
+                return true;
+            });
+            bytes += page->bytes;
+            if (page_file && bytes >= chunkBytes) {
+                fn(refs);
+                refs.clear();
+                held.clear();
+                bytes = 0;
+            }
+        }
+        if (!refs.empty()) fn(refs);
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, pages.size()); }
+
+    // --- Paged mode ---
+
+    // On with a page file and a budget in bytes (adjusted if on already), off with nullptr:
+    // then every evicted page is read back in
+    void setPaging(std::shared_ptr<PageFile> file, size_t bytes) {
+        if (!file) {
+            if (!page_file) return;
+            for (size_t p = 0; p < pages.size(); ++p) {
+                if (!pages[p] && isSpilled(p)) adopt(p);
+            }
+            spilled.clear();
+            {
+                std::lock_guard<std::mutex> lk(fault_lock);
+                faulted.clear();
+                ghosts.clear();
+            }
+            resized.clear();
+            page_file.reset();
+            budget = 0;
+            resident = 0;
+            return;
+        }
+        if (!page_file) {
+            size_t total = 0;
+            for (auto& page : pages) {
+                if (!page) continue;
+                page->bytes = sizeof(Page);
+                page->forEach(0, PAGE_SIZE, [&](const value_type& entry) {
+                    page->bytes += footprint(entry.second);
+                    return true;
+                });
+                page->resizing = {};
+                total += page->bytes;
+            }
+            resident = total;
+            page_file = std::move(file);
+        }
+        budget = bytes;
+    }
+
+    bool paged() const { return page_file != nullptr; }
+    const std::shared_ptr<PageFile>& pageFile() const { return page_file; }
+
+    // Something for trim() to do: faulted-in pages took the estimate over the budget
+    bool wantsTrim() const { return page_file && resident.load() > budget; }
+
+    // Estimated bytes of documents in memory (paged mode only)
+    size_t residentBytes() const { return resident.load(); }
+
+    // Evicts pages until the estimate is within the budget, in CLOCK order: a page used since the hand last passed gets another
+    // round. Pages whose copy in the page file is current are just dropped, others are
+    // written first. The owner's exclusive lock is held: no reader has a document of this store
+    void trim() {
+        if (!page_file) return;
+        settle();
+        {
+            std::lock_guard<std::mutex> lk(fault_lock);
+            for (auto& [p, page] : faulted) {
+                if (p < pages.size() && !pages[p] && isSpilled(p)) pages[p] = std::move(page);
+                else resident -= page->bytes;
+            }
+            faulted.clear();
+        }
+        for (size_t steps = 2 * pages.size(); resident.load() > budget && steps > 0; --steps) {
+            if (hand >= pages.size()) hand = 0;
+            size_t p = hand++;
+            Page* page = pages[p].get();
+            if (!page) continue;
+            if (page->referenced.exchange(false, std::memory_order_relaxed)) continue;
+            if (!evict(p)) break;
+        }
+    }
+
+    // Paged mode counters for STATS
+    std::string pagingJson() const {
+        size_t inMemory = 0, evicted = 0;
+        for (size_t p = 0; p < pages.size(); ++p) {
+            if (pages[p]) inMemory++;
+            else if (isSpilled(p)) evicted++;
+        }
+        std::string json = "{";
+        json += "\"budget_bytes\": " + std::to_string(budget) + ", ";
+        json += "\"resident_bytes\": " + std::to_string(resident.load()) + ", ";
+        json += "\"resident_pages\": " + std::to_string(inMemory) + ", ";
+        json += "\"evicted_pages\": " + std::to_string(evicted) + ", ";
+        json += "\"page_reads\": " + std::to_string(page_file ? page_file->reads.load() : 0) + ", ";
+        json += "\"page_writes\": " + std::to_string(page_file ? page_file->writes.load() : 0) + ", ";
+        json += "\"evictions\": " + std::to_string(evictions) + ", ";
+        json += "\"page_file_bytes\": " + std::to_string(page_file ? page_file->fileBytes() : 0);
+        json += "}";
+        return json;
+    }
+};
+
+// Sorts per-thread result buffers and k-way merges them into one id-ordered list
+inline std::vector<Id> mergeById(std::vector<std::vector<Id>>& buffers, size_t limit = SIZE_MAX) {
+    using Head = std::pair<Id, size_t>; // (id, buffer)
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+    std::vector<size_t> pos(buffers.size(), 0);
+    size_t total = 0;
+
+    for (size_t b = 0; b < buffers.size(); ++b) {
+        std::sort(buffers[b].begin(), buffers[b].end());
+        total += buffers[b].size();
+        if (!buffers[b].empty()) heap.push({ buffers[b][0], b });
+    }
+
+    std::vector<Id> out;
+    out.reserve(std::min(total, limit));
+    while (!heap.empty() && out.size() < limit) {
+        auto [id, b] = heap.top();
+        heap.pop();
+        out.push_back(id);
+        if (++pos[b] < buffers[b].size()) heap.push({ buffers[b][pos[b]], b });
+    }
+    return out;
+}
+
+}
+
+#endif
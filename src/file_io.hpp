@@ -0,0 +1,299 @@
+#ifndef FILE_IO_HPP
+#define FILE_IO_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cerrno>
+#include <mutex>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace fluxdb {
+
+// Raw append-only file descriptor: what std::ofstream can't do (reach stable storage)
+class AppendFile {
+private:
+    int fd = -1;
+
+public:
+    AppendFile() = default;
+    AppendFile(const AppendFile&) = delete;
+    AppendFile& operator=(const AppendFile&) = delete;
+    ~AppendFile() { close(); }
+
+    bool open(const std::string& path, bool truncate = false) {
+        close();
+#ifdef _WIN32
+        int flags = _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY | (truncate ? _O_TRUNC : 0);
+        fd = ::_open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+        int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+        fd = ::open(path.c_str(), flags, 0644);
+#endif
+        return fd >= 0;
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    // Whole buffer or false (short writes are retried)
+    bool write(const char* data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            int n = ::_write(fd, data, static_cast<unsigned>(size > 0x40000000 ? 0x40000000 : size));
+#else
+            ssize_t n = ::write(fd, data, size);
+#endif
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Data (not necessarily metadata) on stable storage
+    bool sync() {
+#if defined(_WIN32)
+        return ::_commit(fd) == 0;
+#elif defined(__APPLE__)
+        return ::fsync(fd) == 0;
+#else
+        return ::fdatasync(fd) == 0;
+#endif
+    }
+
+    int64_t size() const {
+#ifdef _WIN32
+        return ::_lseeki64(fd, 0, SEEK_END);
+#else
+        return static_cast<int64_t>(::lseek(fd, 0, SEEK_END));
+#endif
+    }
+
+    void close() {
+        if (fd < 0) return;
+#ifdef _WIN32
+        ::_close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+};
+
+// Read-write file addressed by offset (the page file, snapshot writes): pread/pwrite, so
+// readers and writers on different threads need no shared position. The CRT has no positional
+// calls, so on Windows a lock covers seek + read/write
+class RandomAccessFile {
+private:
+    int fd = -1;
+#ifdef _WIN32
+    std::mutex seek_lock;
+#endif
+
+public:
+    RandomAccessFile() = default;
+    RandomAccessFile(const RandomAccessFile&) = delete;
+    RandomAccessFile& operator=(const RandomAccessFile&) = delete;
+    ~RandomAccessFile() { close(); }
+
+    bool open(const std::string& path, bool truncate = false) {
+        close();
+#ifdef _WIN32
+        int flags = _O_RDWR | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : 0);
+        fd = ::_open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+        int flags = O_RDWR | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+        fd = ::open(path.c_str(), flags, 0644);
+#endif
+        return fd >= 0;
+    }
+
+    bool isOpen() const { return fd >= 0; }
+    int handle() const { return fd; }
+
+    // Whole range or false (short transfers are retried)
+    bool readAt(uint64_t offset, char* data, size_t size) {
+#ifdef _WIN32
+        std::lock_guard<std::mutex> lk(seek_lock);
+        if (::_lseeki64(fd, static_cast<int64_t>(offset), SEEK_SET) < 0) return false;
+#endif
+        while (size > 0) {
+#ifdef _WIN32
+            int n = ::_read(fd, data, static_cast<unsigned>(std::min<size_t>(size, 0x40000000)));
+#else
+            ssize_t n = ::pread(fd, data, size, static_cast<off_t>(offset));
+#endif
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            offset += static_cast<uint64_t>(n);
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool writeAt(uint64_t offset, const char* data, size_t size) {
+#ifdef _WIN32
+        std::lock_guard<std::mutex> lk(seek_lock);
+        if (::_lseeki64(fd, static_cast<int64_t>(offset), SEEK_SET) < 0) return false;
+#endif
+        while (size > 0) {
+#ifdef _WIN32
+            int n = ::_write(fd, data, static_cast<unsigned>(std::min<size_t>(size, 0x40000000)));
+#else
+            ssize_t n = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+#endif
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            offset += static_cast<uint64_t>(n);
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Data (not necessarily metadata) on stable storage
+    bool sync() {
+#if defined(_WIN32)
+        return ::_commit(fd) == 0;
+#elif defined(__APPLE__)
+        return ::fsync(fd) == 0;
+#else
+        return ::fdatasync(fd) == 0;
+#endif
+    }
+
+    void close() {
+        if (fd < 0) return;
+#ifdef _WIN32
+        ::_close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+};
+
+// Contents of a closed file on stable storage (e.g. before it is renamed into place)
+inline bool syncFile(const std::string& path) {
+    AppendFile file;
+    return file.open(path) && file.sync();
+}
+
+// Makes renames and creations in dir survive a crash (no-op where directories can't be synced)
+inline void syncDirectory(const std::string& dir) {
+#ifndef _WIN32
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+#else
+    (void)dir;
+#endif
+}
+
+// Read-only view of a whole file for one sequential pass (recovery). mmap where available so
+// records are decoded straight from the page cache; elsewhere the file is read into memory
+class MappedFile {
+private:
+    const uint8_t* ptr = nullptr;
+    size_t len = 0;
+#ifdef _WIN32
+    std::vector<uint8_t> copy;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    // False if missing or unreadable; an empty file opens with size() == 0
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        int fd = ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+        if (fd < 0) return false;
+        int64_t n = ::_lseeki64(fd, 0, SEEK_END);
+        ::_lseeki64(fd, 0, SEEK_SET);
+        copy.resize(n > 0 ? static_cast<size_t>(n) : 0);
+        size_t done = 0;
+        while (done < copy.size()) {
+            int r = ::_read(fd, copy.data() + done, static_cast<unsigned>(std::min<size_t>(copy.size() - done, 0x40000000)));
+            if (r <= 0) break;
+            done += static_cast<size_t>(r);
+        }
+        ::_close(fd);
+        copy.resize(done);
+        ptr = copy.data();
+        len = done;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        len = static_cast<size_t>(st.st_size);
+        if (len > 0) {
+            void* m = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m == MAP_FAILED) {
+                ::close(fd);
+                len = 0;
+                return false;
+            }
+            ::madvise(m, len, MADV_SEQUENTIAL);
+            ptr = static_cast<const uint8_t*>(m);
+        }
+        ::close(fd); // the mapping stays valid
+#endif
+        return true;
+    }
+
+    const uint8_t* data() const { return ptr; }
+    size_t size() const { return len; }
+
+    // Asks for [offset, offset + n) to be read in now, ahead of its use, rather than a page
+    // per fault (a no-op where the file was read whole)
+    void prefetch(size_t offset, size_t n) const {
+#ifndef _WIN32
+        if (!ptr || offset >= len) return;
+        size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t from = offset / page * page, to = std::min(len, offset + n);
+        ::madvise(const_cast<uint8_t*>(ptr) + from, to - from, MADV_WILLNEED);
+#else
+        (void)offset;
+        (void)n;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        copy.clear();
+        copy.shrink_to_fit();
+#else
+        if (ptr) ::munmap(const_cast<uint8_t*>(ptr), len);
+#endif
+        ptr = nullptr;
+        len = 0;
+    }
+};
+
+}
+
+#endif
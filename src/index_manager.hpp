@@ -2,11 +2,16 @@
 #define INDEX_MANAGER_HPP
 
 #include "document.hpp"
+#include "text_index.hpp"
+#include "trigram_index.hpp"
+#include "vector_index.hpp"
 #include <map>              //multimap (Sorted Index)
 #include <unordered_map>    // unordered multimap (Hash Index)
 #include <vector>
 #include <string>
 #include <iostream>
+#include <optional>
+#include <algorithm>
 
 namespace fluxdb {
 
@@ -16,35 +21,114 @@ using SortedIndex = std::multimap<Value, uint64_t, ValueLess>;
 // Hash Table 
 using HashIndex   = std::unordered_multimap<Value, uint64_t, ValueHasher>;
 
+// Bounds of a sorted index scan, missing side = open ended
+struct RangeBounds {
+    std::optional<Value> lower;
+    std::optional<Value> upper;
+    bool lowerInclusive = true;
+    bool upperInclusive = true;
+};
+
+// What was created, so indexes survive a restart (snapshot trailer)
+struct IndexDef {
+    std::string field;
+    int type;
+    Document options;
+};
+
 class IndexManager {
+public:
+    static constexpr unsigned ALL_TYPES = 0x1F; // addField() mask, bit n = index type n
+
 private:
     std::unordered_map<std::string, SortedIndex> sorted_indexes;
     std::unordered_map<std::string, HashIndex>   hash_indexes;
+    std::unordered_map<std::string, TextIndex>   text_indexes;
+    std::unordered_map<std::string, TrigramIndex> trigram_indexes;
+    std::unordered_map<std::string, HnswIndex>   vector_indexes;
+
+    std::vector<IndexDef> definitions;
+
+    void remember(const std::string& field, int type, const Document& options) {
+        for (const auto& d : definitions) {
+            if (d.field == field && d.type == type) return;
+        }
+        definitions.push_back({ field, type, options });
+    }
+
+    // fn(first, last) over the sorted index entries inside bounds; false without a sorted index
+    template <typename Fn>
+    bool rangeOf(const std::string& field, const RangeBounds& bounds, Fn&& fn) const {
+        auto it = sorted_indexes.find(field);
+        if (it == sorted_indexes.end()) return false;
+
+        const auto& index = it->second;
+        ValueLess less;
+
+        if (bounds.lower && bounds.upper) {
+            if (less(*bounds.upper, *bounds.lower)) return true; // empty range
+            if (!less(*bounds.lower, *bounds.upper) && !(bounds.lowerInclusive && bounds.upperInclusive)) return true;
+        }
+
+        auto start = index.begin();
+        if (bounds.lower) start = bounds.lowerInclusive ? index.lower_bound(*bounds.lower) : index.upper_bound(*bounds.lower);
+
+        auto end = index.end();
+        if (bounds.upper) end = bounds.upperInclusive ? index.upper_bound(*bounds.upper) : index.lower_bound(*bounds.upper);
+
+        fn(start, end);
+        return true;
+    }
 
 public:
-    // Type: 0 = Hash (Default), 1 = Sorted
-    void createIndex(const std::string& field, int type = 0) {
-        if (type == 1) {
+    // Type: 0 = Hash (Default), 1 = Sorted, 2 = Full-Text, 3 = Trigram, 4 = Vector (HNSW).
+    // false when the field already has an index of that type (nothing to fill)
+    bool createIndex(const std::string& field, int type = 0, const Document& options = {}) {
+        if (type < 0 || type > 4) throw std::runtime_error("Unknown index type " + std::to_string(type));
+        bool created = false;
+
+        if (type == 4) {
+            if (vector_indexes.find(field) == vector_indexes.end()) {
+                vector_indexes.emplace(field, HnswIndex(options));
+                created = true;
+                std::cout << "[Index] Created VECTOR index on '" << field << "'\n";
+            }
+        } else if (type == 3) {
+            if (trigram_indexes.find(field) == trigram_indexes.end()) {
+                trigram_indexes[field] = TrigramIndex();
+                created = true;
+                std::cout << "[Index] Created TRIGRAM index on '" << field << "'\n";
+            }
+        } else if (type == 2) {
+            if (text_indexes.find(field) == text_indexes.end()) {
+                auto sw = options.find("stopwords");
+                if (sw != options.end() && sw->second && sw->second->type == Type::Array) {
+                    std::unordered_set<std::string> words;
+                    for (const auto& w : sw->second->asArray()) {
+                        if (w && w->type == Type::String) words.insert(w->asString());
+                    }
+                    text_indexes.emplace(field, TextIndex(std::move(words)));
+                } else {
+                    text_indexes.emplace(field, TextIndex());
+                }
+                created = true;
+                std::cout << "[Index] Created TEXT index on '" << field << "'\n";
+            }
+        } else if (type == 1) {
             if (sorted_indexes.find(field) == sorted_indexes.end()) {
                 sorted_indexes[field] = SortedIndex();
+                created = true;
                 std::cout << "[Index] Created SORTED index on '" << field << "'\n";
             }
         } else {
             if (hash_indexes.find(field) == hash_indexes.end()) {
                 hash_indexes[field] = HashIndex();
+                created = true;
                 std::cout << "[Index] Created HASH index on '" << field << "'\n";
             }
         }
-    }
-
-    void addToIndex(const std::string& field, uint64_t docId, const Value& val) {
-        if (auto it = sorted_indexes.find(field); it != sorted_indexes.end()) {
-            it->second.insert({ val, docId });
-        }
-
-        if (auto it = hash_indexes.find(field); it != hash_indexes.end()) {
-            it->second.insert({ val, docId });
-        }
+        remember(field, type, options); // only once built: bad options (HnswIndex throws) aren't saved
+        return created;
     }
 
     // Data Hooks 
@@ -61,9 +145,85 @@ public:
             if (auto it = hash_indexes.find(key); it != hash_indexes.end()) {
                 it->second.insert({ *valPtr, docId });
             }
+
+            // for Text Index
+            if (auto it = text_indexes.find(key); it != text_indexes.end()) {
+                if (valPtr->type == Type::String) it->second.add(docId, valPtr->asString());
+            }
+
+            // for Trigram Index
+            if (auto it = trigram_indexes.find(key); it != trigram_indexes.end()) {
+                if (valPtr->type == Type::String) it->second.add(docId, valPtr->asString());
+            }
+
+            // for Vector Index
+            if (auto it = vector_indexes.find(key); it != vector_indexes.end()) {
+                it->second.add(docId, *valPtr);
+            }
+        }
+    }
+
+    // Batch addDocument, one index at a time. Sorted inserts are hinted with the slot after the
+    // previous key, so ascending or clustered keys (timestamps, counters) skip the tree descent
+    void addDocuments(const std::vector<std::pair<uint64_t, const Document*>>& docs) {
+        for (const auto& field : indexedFields()) addField(field, docs);
+    }
+
+    // Every index on one field, for addDocuments() and parallel builds: touches only that
+    // field's structures, so different fields can be filled from different threads. types is a
+    // mask of 1 << type: a backfill fills the new index alone, the others hold the docs already
+    void addField(const std::string& field, const std::vector<std::pair<uint64_t, const Document*>>& docs,
+                  unsigned types = ALL_TYPES) {
+        auto valueOf = [&](const Document& doc) -> const Value* {
+            auto it = doc.find(field);
+            return it != doc.end() && it->second ? it->second.get() : nullptr;
+        };
+
+        if (auto it = sorted_indexes.find(field); (types & (1u << 1)) && it != sorted_indexes.end()) {
+            auto& index = it->second;
+            auto hint = index.end();
+            for (const auto& [docId, doc] : docs) {
+                if (const Value* v = valueOf(*doc)) hint = std::next(index.insert(hint, { *v, docId }));
+            }
+        }
+
+        if (auto it = hash_indexes.find(field); (types & (1u << 0)) && it != hash_indexes.end()) {
+            if (it->second.empty()) it->second.reserve(docs.size()); // fresh index: no rehash while filling
+            for (const auto& [docId, doc] : docs) {
+                if (const Value* v = valueOf(*doc)) it->second.insert({ *v, docId });
+            }
+        }
+
+        if (auto it = text_indexes.find(field); (types & (1u << 2)) && it != text_indexes.end()) {
+            for (const auto& [docId, doc] : docs) {
+                const Value* v = valueOf(*doc);
+                if (v && v->type == Type::String) it->second.add(docId, v->asString());
+            }
+        }
+
+        if (auto it = trigram_indexes.find(field); (types & (1u << 3)) && it != trigram_indexes.end()) {
+            for (const auto& [docId, doc] : docs) {
+                const Value* v = valueOf(*doc);
+                if (v && v->type == Type::String) it->second.add(docId, v->asString());
+            }
+        }
+
+        if (auto it = vector_indexes.find(field); (types & (1u << 4)) && it != vector_indexes.end()) {
+            for (const auto& [docId, doc] : docs) {
+                if (const Value* v = valueOf(*doc)) it->second.add(docId, *v);
+            }
         }
     }
 
+    // Distinct fields with at least one index
+    std::vector<std::string> indexedFields() const {
+        std::vector<std::string> out;
+        for (const auto& d : definitions) {
+            if (std::find(out.begin(), out.end(), d.field) == out.end()) out.push_back(d.field);
+        }
+        return out;
+    }
+
     void removeDocument(uint64_t docId, const Document& doc) {
         for (const auto& [key, valPtr] : doc) {
             if (!valPtr) continue;
@@ -77,11 +237,26 @@ public:
             if (auto it = hash_indexes.find(key); it != hash_indexes.end()) {
                 removeFromMultimap(it->second, *valPtr, docId);
             }
+
+            // Remove from Text Index
+            if (auto it = text_indexes.find(key); it != text_indexes.end()) {
+                if (valPtr->type == Type::String) it->second.remove(docId, valPtr->asString());
+            }
+
+            // Remove from Trigram Index
+            if (auto it = trigram_indexes.find(key); it != trigram_indexes.end()) {
+                if (valPtr->type == Type::String) it->second.remove(docId, valPtr->asString());
+            }
+
+            // Remove from Vector Index (tombstone)
+            if (auto it = vector_indexes.find(key); it != vector_indexes.end()) {
+                it->second.remove(docId);
+            }
         }
     }
 
     // --- Query Engine ---
-    std::vector<uint64_t> searchHash(const std::string& field, const Value& val) {
+    std::vector<uint64_t> searchHash(const std::string& field, const Value& val) const {
 
         std::vector<uint64_t> results;
         
@@ -116,26 +291,209 @@ public:
         return results;
     }
 
+    // Bounds aware variant of searchSorted ($gt/$gte/$lt/$lte)
+    std::vector<uint64_t> searchRange(const std::string& field, const RangeBounds& bounds) const {
+        std::vector<uint64_t> results;
+        rangeOf(field, bounds, [&](auto start, auto end) {
+            for (auto iter = start; iter != end; ++iter) results.push_back(iter->second);
+        });
+        return results;
+    }
+
+    // Strings starting with prefix: [prefix, successor(prefix)) on a sorted index
+    std::vector<uint64_t> searchPrefix(const std::string& field, const std::string& prefix) const {
+        std::vector<uint64_t> results;
+
+        auto it = sorted_indexes.find(field);
+        if (it == sorted_indexes.end()) return results;
+
+        const auto& index = it->second;
+        auto start = index.lower_bound(Value(prefix));
+
+        // successor = prefix with its last non 0xFF byte bumped, chars compare as unsigned
+        std::string next = prefix;
+        while (!next.empty() && static_cast<unsigned char>(next.back()) == 0xFF) next.pop_back();
+
+        if (next.empty()) { // no successor: every remaining string matches
+            for (auto iter = start; iter != index.end() && iter->first.type == Type::String; ++iter) {
+                results.push_back(iter->second);
+            }
+            return results;
+        }
+
+        next.back() = static_cast<char>(static_cast<unsigned char>(next.back()) + 1);
+        auto end = index.lower_bound(Value(next));
+
+        for (auto iter = start; iter != end; ++iter) {
+            results.push_back(iter->second);
+        }
+        return results;
+    }
+
+    // Candidate ids whose value contains every literal run (false = no trigram index)
+    bool searchTrigrams(const std::string& field, const std::vector<std::string>& runs, std::vector<uint64_t>& out) const {
+        auto it = trigram_indexes.find(field);
+        if (it == trigram_indexes.end()) return false;
+        out = it->second.search(runs);
+        return true;
+    }
+
+    // Approximate top-k by the index metric (false = no vector index)
+    bool searchNearest(const std::string& field, const Value& query, size_t k, size_t ef,
+                       std::vector<std::pair<uint64_t, float>>& out) const {
+        auto it = vector_indexes.find(field);
+        if (it == vector_indexes.end()) return false;
+        out = it->second.search(query, k, ef);
+        return true;
+    }
+
+    const HnswIndex* getVectorIndex(const std::string& field) const {
+        auto it = vector_indexes.find(field);
+        return it != vector_indexes.end() ? &it->second : nullptr;
+    }
+
+    // Snapshot restore: graph comes from disk instead of a backfill
+    bool loadVectorIndex(const std::string& field, const Document& options, std::istream& in) {
+        remember(field, 4, options);
+        HnswIndex index(options);
+        if (!index.load(in)) return false;
+        vector_indexes[field] = std::move(index);
+        return true;
+    }
+
+    const std::vector<IndexDef>& getDefinitions() const { return definitions; }
+
+    // Smallest / largest key of a sorted index (exact min/max for the stats catalog)
+    bool sortedBounds(const std::string& field, Value& min, Value& max) const {
+        auto it = sorted_indexes.find(field);
+        if (it == sorted_indexes.end() || it->second.empty()) return false;
+        min = it->second.begin()->first;
+        max = it->second.rbegin()->first;
+        return true;
+    }
+
+    // Visits every (value, docId) pair of an index, hash preferred
+    template <typename Fn>
+    bool forEachEntry(const std::string& field, Fn&& fn) const {
+        if (auto it = hash_indexes.find(field); it != hash_indexes.end()) {
+            for (const auto& [val, docId] : it->second) fn(val, docId);
+            return true;
+        }
+        if (auto it = sorted_indexes.find(field); it != sorted_indexes.end()) {
+            for (const auto& [val, docId] : it->second) fn(val, docId);
+            return true;
+        }
+        return false;
+    }
+
+    // (value, docId) pairs forEachEntry() would visit, 0 without a hash/sorted index
+    size_t entryCount(const std::string& field) const {
+        if (auto it = hash_indexes.find(field); it != hash_indexes.end()) return it->second.size();
+        if (auto it = sorted_indexes.find(field); it != sorted_indexes.end()) return it->second.size();
+        return 0;
+    }
+
+    // Entries equal to val (posting size), false when the field has no hash/sorted index
+    bool countEqual(const std::string& field, const Value& val, size_t& out) const {
+        if (auto it = hash_indexes.find(field); it != hash_indexes.end()) {
+            out = it->second.count(val);
+            return true;
+        }
+        if (auto it = sorted_indexes.find(field); it != sorted_indexes.end()) {
+            auto [lo, hi] = it->second.equal_range(val);
+            out = static_cast<size_t>(std::distance(lo, hi));
+            return true;
+        }
+        return false;
+    }
+
+    bool countRange(const std::string& field, const RangeBounds& bounds, size_t& out) const {
+        out = 0;
+        return rangeOf(field, bounds, [&](auto start, auto end) {
+            out = static_cast<size_t>(std::distance(start, end));
+        });
+    }
+
+    // Distinct scalar keys of a hash/sorted index (equal keys are adjacent in both), false without one
+    bool distinctKeys(const std::string& field, std::vector<Value>& out) const {
+        auto collect = [&](const auto& index) {
+            const Value* last = nullptr;
+            for (const auto& [val, docId] : index) {
+                if (val.type == Type::Object || val.type == Type::Array) continue; // never equal to anything
+                if (!last || !(*last == val)) out.push_back(val);
+                last = &val;
+            }
+        };
+        if (auto it = sorted_indexes.find(field); it != sorted_indexes.end()) collect(it->second);
+        else if (auto it = hash_indexes.find(field); it != hash_indexes.end()) collect(it->second);
+        else return false;
+        return true;
+    }
+
+    // Walks a sorted index in key order (reverse when descending), one run of equal keys at a
+    // time with its ids ascending. fn(run) returns false to stop. False without a sorted index
+    template <typename Fn>
+    bool forEachSortedRun(const std::string& field, bool descending, Fn&& fn) const {
+        auto it = sorted_indexes.find(field);
+        if (it == sorted_indexes.end()) return false;
+
+        std::vector<uint64_t> run;
+        auto walk = [&](auto begin, auto end) {
+            ValueLess less;
+            for (auto cur = begin; cur != end;) {
+                run.clear();
+                auto next = cur;
+                while (next != end && !less(cur->first, next->first) && !less(next->first, cur->first)) {
+                    run.push_back(next->second);
+                    ++next;
+                }
+                std::sort(run.begin(), run.end());
+                if (!fn(run)) return;
+                cur = next;
+            }
+        };
+
+        if (descending) walk(it->second.rbegin(), it->second.rend());
+        else walk(it->second.begin(), it->second.end());
+        return true;
+    }
+
+    // Full-text match on a TEXT index, ranked by BM25 (best first)
+    std::vector<std::pair<uint64_t, double>> searchText(const std::string& field, const std::string& query, bool phrase) const {
+        auto it = text_indexes.find(field);
+        if (it == text_indexes.end()) return {};
+        return it->second.search(query, phrase);
+    }
+
     void clear() {
         sorted_indexes.clear();
         hash_indexes.clear();
+        text_indexes.clear();
+        trigram_indexes.clear();
+        vector_indexes.clear();
+        definitions.clear();
     }
 
     bool hasIndex(const std::string& field) const {
         return hash_indexes.count(field) || sorted_indexes.count(field);
     }
 
+    bool hasHashIndex(const std::string& field) const { return hash_indexes.count(field) > 0; }
+    bool hasSortedIndex(const std::string& field) const { return sorted_indexes.count(field) > 0; }
+    bool hasTextIndex(const std::string& field) const { return text_indexes.count(field) > 0; }
+    bool hasTrigramIndex(const std::string& field) const { return trigram_indexes.count(field) > 0; }
+    bool hasVectorIndex(const std::string& field) const { return vector_indexes.count(field) > 0; }
+
 private:
     template <typename MapType>
     void removeFromMultimap(MapType& index, const Value& val, uint64_t docId) {
     
         auto range = index.equal_range(val);
         
-        for (auto it = range.first; it != range.second; ) {
+        for (auto it = range.first; it != range.second; ++it) {
             if (it->second == docId) {
-                it = index.erase(it); 
+                index.erase(it); 
                 return; 
-                ++it;
             }
         }
     }
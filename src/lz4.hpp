@@ -0,0 +1,159 @@
+#ifndef LZ4_HPP
+#define LZ4_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace fluxdb {
+
+// LZ4 block format (interoperable with liblz4's LZ4_compress_default / LZ4_decompress_safe):
+// sequences of token (literal length << 4 | match length - 4) | extra literal length bytes |
+// literals | match offset (u16) | extra match length bytes. Greedy single-probe compressor,
+// bounds-checked decompressor. Used for snapshot blocks and WAL batches
+namespace lz4 {
+
+namespace detail {
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t LAST_LITERALS = 5; // the block ends with at least this many literals
+constexpr size_t MF_LIMIT = 12;     // no match starts in the last 12 bytes
+constexpr size_t MAX_OFFSET = 65535;
+constexpr int HASH_LOG = 14;
+
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t hash(uint32_t v) { return (v * 2654435761u) >> (32 - HASH_LOG); }
+
+inline uint8_t* writeLength(uint8_t* op, size_t len) {
+    for (; len >= 255; len -= 255) *op++ = 255;
+    *op++ = static_cast<uint8_t>(len);
+    return op;
+}
+
+inline uint8_t* emit(uint8_t* op, const uint8_t* literals, size_t litLen, size_t offset, size_t matchLen) {
+    uint8_t* token = op++;
+    size_t m = matchLen - MIN_MATCH;
+    *token = static_cast<uint8_t>((litLen >= 15 ? 15 : litLen) << 4 | (m >= 15 ? 15 : m));
+    if (litLen >= 15) op = writeLength(op, litLen - 15);
+    std::memcpy(op, literals, litLen);
+    op += litLen;
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    if (m >= 15) op = writeLength(op, m - 15);
+    return op;
+}
+
+}
+
+// Worst case output size for n input bytes
+inline size_t bound(size_t n) { return n + n / 255 + 16; }
+
+// Compresses n bytes into dst (at least bound(n) bytes); returns the compressed size
+inline size_t compress(const uint8_t* src, size_t n, uint8_t* dst) {
+    using namespace detail;
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* const end = src + n;
+    uint8_t* op = dst;
+
+    if (n > MF_LIMIT) {
+        std::vector<uint32_t> table(size_t(1) << HASH_LOG, 0);
+        const uint8_t* const matchLimit = end - LAST_LITERALS;
+        const uint8_t* const mfLimit = end - MF_LIMIT;
+        size_t misses = 0;
+        ++ip; // position 0 is the table's empty value
+
+        while (ip < mfLimit) {
+            uint32_t seq = read32(ip);
+            uint32_t& slot = table[hash(seq)];
+            const uint8_t* ref = src + slot;
+            slot = static_cast<uint32_t>(ip - src);
+
+            if (ref >= ip || static_cast<size_t>(ip - ref) > MAX_OFFSET || read32(ref) != seq) {
+                ip += 1 + (misses++ >> 6); // skip faster through incompressible data
+                continue;
+            }
+            misses = 0;
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+            const uint8_t* m = ip + MIN_MATCH;
+            const uint8_t* r = ref + MIN_MATCH;
+            while (m < matchLimit && *m == *r) {
+                ++m;
+                ++r;
+            }
+
+            op = emit(op, anchor, static_cast<size_t>(ip - anchor), static_cast<size_t>(ip - ref), static_cast<size_t>(m - ip));
+            ip = anchor = m;
+            if (ip - 2 > src && ip < mfLimit) table[hash(read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - src);
+        }
+    }
+
+    size_t litLen = static_cast<size_t>(end - anchor);
+    *op++ = static_cast<uint8_t>((litLen >= 15 ? 15 : litLen) << 4);
+    if (litLen >= 15) op = writeLength(op, litLen - 15);
+    if (litLen) std::memcpy(op, anchor, litLen);
+    op += litLen;
+    return static_cast<size_t>(op - dst);
+}
+
+// Decompresses exactly outSize bytes into dst; false for malformed input or a size mismatch
+inline bool decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t outSize) {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + n;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + outSize;
+
+    auto readLength = [&](size_t& len) {
+        uint8_t b;
+        do {
+            if (ip == iend) return false;
+            b = *ip++;
+            len += b;
+        } while (b == 255);
+        return true;
+    };
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t litLen = token >> 4;
+        if (litLen == 15 && !readLength(litLen)) return false;
+        if (litLen > static_cast<size_t>(iend - ip) || litLen > static_cast<size_t>(oend - op)) return false;
+        if (litLen) std::memcpy(op, ip, litLen);
+        ip += litLen;
+        op += litLen;
+        if (ip == iend) return op == oend; // the last sequence has no match
+
+        if (iend - ip < 2) return false;
+        size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+        ip += 2;
+        size_t matchLen = token & 15;
+        if (matchLen == 15 && !readLength(matchLen)) return false;
+        matchLen += detail::MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst) || matchLen > static_cast<size_t>(oend - op)) return false;
+
+        const uint8_t* match = op - offset;
+        if (offset >= matchLen) {
+            std::memcpy(op, match, matchLen);
+            op += matchLen;
+        } else {
+            for (size_t i = 0; i < matchLen; ++i) *op++ = match[i]; // overlapping: repeats the pattern
+        }
+    }
+    return false;
+}
+
+}
+
+}
+
+#endif
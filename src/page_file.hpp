@@ -0,0 +1,173 @@
+#ifndef PAGE_FILE_HPP
+#define PAGE_FILE_HPP
+
+#include "file_io.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+
+namespace fluxdb {
+
+// Where a paged DocumentStore keeps the pages it evicted: one extent of encoded records per
+// page. Scratch space, not part of the durable state (snapshot + WAL are): it starts empty
+// and is removed once the store and all its copies are gone. Space goes out in 4 KB units,
+// best fit from freed extents (neighbours are merged) or from the end of the file
+class PageFile : public std::enable_shared_from_this<PageFile> {
+public:
+    // A page's copy in the file. Shared by the store and its copy-on-write copies, the space
+    // is freed when the last of them lets go
+    class Extent {
+    private:
+        friend class PageFile;
+        std::shared_ptr<PageFile> file;
+
+    public:
+        uint64_t offset = 0, capacity = 0;
+        uint32_t length = 0; // bytes used
+        uint32_t docs = 0;
+        // Record i spans [records[i], records[i + 1]), so one record can be read on its own
+        std::vector<uint32_t> records;
+
+        Extent() = default;
+        Extent(const Extent&) = delete;
+        Extent& operator=(const Extent&) = delete;
+        ~Extent() {
+            if (file) file->release(offset, capacity);
+        }
+    };
+
+private:
+    std::string path;
+    RandomAccessFile file;
+
+    mutable std::mutex lock;
+    std::multimap<uint64_t, uint64_t> free_by_size; // capacity -> offset
+    std::map<uint64_t, uint64_t> free_by_offset;    // offset -> capacity
+    uint64_t end = 0;                               // first byte never handed out
+    uint64_t used = 0;
+
+    static constexpr uint64_t UNIT = 4096;
+
+    void addFree(uint64_t offset, uint64_t capacity) {
+        free_by_offset[offset] = capacity;
+        free_by_size.emplace(capacity, offset);
+    }
+
+    void removeFree(std::map<uint64_t, uint64_t>::iterator it) {
+        auto range = free_by_size.equal_range(it->second);
+        for (auto s = range.first; s != range.second; ++s) {
+            if (s->second == it->first) {
+                free_by_size.erase(s);
+                break;
+            }
+        }
+        free_by_offset.erase(it);
+    }
+
+    uint64_t allocate(uint64_t capacity) {
+        std::lock_guard<std::mutex> lk(lock);
+        used += capacity;
+        auto fit = free_by_size.lower_bound(capacity);
+        if (fit == free_by_size.end()) {
+            uint64_t offset = end;
+            end += capacity;
+            return offset;
+        }
+        uint64_t offset = fit->second, have = fit->first;
+        removeFree(free_by_offset.find(offset));
+        if (have > capacity) addFree(offset + capacity, have - capacity);
+        return offset;
+    }
+
+    void release(uint64_t offset, uint64_t capacity) {
+        std::lock_guard<std::mutex> lk(lock);
+        used -= capacity;
+        auto next = free_by_offset.lower_bound(offset);
+        if (next != free_by_offset.end() && next->first == offset + capacity) {
+            capacity += next->second;
+            next = std::next(next);
+            removeFree(std::prev(next));
+        }
+        if (next != free_by_offset.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset) {
+                offset = prev->first;
+                capacity += prev->second;
+                removeFree(prev);
+            }
+        }
+        if (offset + capacity == end) end = offset; // the tail is reused from the end
+        else addFree(offset, capacity);
+    }
+
+    explicit PageFile(std::string filePath) : path(std::move(filePath)) {}
+
+public:
+    std::atomic<uint64_t> reads{ 0 }, writes{ 0 };
+
+    // An empty page file at path (an old one is scratch from a previous run); nullptr if it
+    // can't be created
+    static std::shared_ptr<PageFile> open(const std::string& path) {
+        std::shared_ptr<PageFile> pf(new PageFile(path));
+        if (!pf->file.open(path, true)) {
+            std::cerr << "[Paging] Cannot create " << path << "\n";
+            return nullptr;
+        }
+        return pf;
+    }
+
+    ~PageFile() {
+        file.close();
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+
+    // Stores bytes (docs records starting where `records` says); nullptr if the write failed
+    std::shared_ptr<const Extent> write(const std::vector<char>& bytes, uint32_t docs, std::vector<uint32_t> records) {
+        uint64_t capacity = std::max<uint64_t>(UNIT, (bytes.size() + UNIT - 1) / UNIT * UNIT);
+        auto extent = std::make_shared<Extent>();
+        extent->offset = allocate(capacity);
+        extent->capacity = capacity;
+        extent->file = shared_from_this(); // from here on the space goes back when it is dropped
+        extent->length = static_cast<uint32_t>(bytes.size());
+        extent->docs = docs;
+        extent->records = std::move(records);
+        if (!file.writeAt(extent->offset, bytes.data(), bytes.size())) return nullptr;
+        writes++;
+        return extent;
+    }
+
+    bool read(const Extent& at, std::vector<char>& out) {
+        return read(at, 0, at.length, out);
+    }
+
+    // Bytes [from, to) of the extent
+    bool read(const Extent& at, uint32_t from, uint32_t to, std::vector<char>& out) {
+        out.resize(to - from);
+        reads++;
+        return file.readAt(at.offset + from, out.data(), out.size());
+    }
+
+    // Bytes held by live extents, and how far into the file they reach
+    uint64_t usedBytes() const {
+        std::lock_guard<std::mutex> lk(lock);
+        return used;
+    }
+
+    uint64_t fileBytes() const {
+        std::lock_guard<std::mutex> lk(lock);
+        return end;
+    }
+
+    const std::string& filePath() const { return path; }
+};
+
+}
+
+#endif
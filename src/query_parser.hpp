@@ -12,6 +12,7 @@ class QueryParser {
 private:
     std::string input;
     size_t pos = 0;
+    bool placeholders = false; // PREPARE: bare $1..$n values
 
     void skipWhitespace() {
         while (pos < input.size() && std::isspace(input[pos])) pos++;
@@ -91,8 +92,26 @@ private:
     }
 
 
+    // $n -> {"$param": n}, bound by QueryTemplate
+    std::shared_ptr<Value> parsePlaceholder() {
+        size_t start = ++pos;
+        while (pos < input.size() && std::isdigit(input[pos])) pos++;
+        if (pos == start || input[start] == '0') throw std::runtime_error("Expected placeholder $1, $2, ...");
+
+        Document param;
+        param[PARAM_KEY] = std::make_shared<Value>(static_cast<int64_t>(std::stoll(input.substr(start, pos - start))));
+        return std::make_shared<Value>(std::move(param));
+    }
+
 public:
-    QueryParser(const std::string& raw) : input(raw) {}
+    static constexpr const char* PARAM_KEY = "$param";
+
+    QueryParser(const std::string& raw, bool allowPlaceholders = false) : input(raw), placeholders(allowPlaceholders) {}
+
+    // Unparsed tail after the last parse call (e.g. FIND options)
+    std::string remaining() const {
+        return pos < input.size() ? input.substr(pos) : "";
+    }
 
     std::shared_ptr<Value> parseValue() {
         skipWhitespace();
@@ -103,6 +122,7 @@ public:
         if (c == 't' || c == 'f') return parseBool();
         if (c == '{') return std::make_shared<Value>(parseJSON()); // Recursion
         if (c == '[') return parseArray();
+        if (c == '$' && placeholders) return parsePlaceholder();
         
         throw std::runtime_error("Unknown value type");
     }
@@ -5,11 +5,47 @@
 #include "query_parser.hpp"
 #include "pubsub_manager.hpp"
 #include "database_manager.hpp"
+#include "text_index.hpp"
+#include "trigram_index.hpp"
+#include "vector_index.hpp"
+#include "query_program.hpp"
+#include "result_order.hpp"
+#include "aggregation.hpp"
+#include "query_template.hpp"
+#include "socket_sink.hpp"
 #include <string>
 #include <sstream>
+#include <regex>
 
 namespace fluxdb {
 
+// FIND <query> [options]
+struct FindOptions {
+    std::vector<std::string> fields; // projection, empty = whole document
+    ResultOrder order;               // no sort = whatever order the access path produces
+    size_t skip = 0;
+    size_t limit = SIZE_MAX;
+
+    size_t window() const { return limit > SIZE_MAX - skip ? SIZE_MAX : skip + limit; }
+};
+
+// Access path of a FIND shape, re-planned when the collection's indexes change
+struct FindPlan {
+    enum class Route : uint8_t { Near, Text, Pattern, Lookup };
+    Route route = Route::Lookup; // Lookup: hash/sorted candidates, sorted-index stream or scan
+    std::string field;           // $near / $text / $prefix-$regex field
+    bool covered = false;        // projection + sort all indexed: try answering from the indexes
+    uint64_t indexEpoch = 0;
+};
+
+// PREPARE <name> <query with $1..$n> [options]
+struct PreparedFind {
+    QueryTemplate query;
+    FindOptions opts;
+    const Collection* db = nullptr; // plan is for this collection
+    std::optional<FindPlan> plan;   // made by the first EXECUTE
+};
+
 class QueryProcessor {
 private:
     DatabaseManager& db_manager; 
@@ -22,46 +58,110 @@ private:
     std::string password = "";
     bool is_authenticated = false;
 
-    bool checkCondition(const Value& val, const Value& constraint) {
-        if (constraint.type != Type::Object) {
-            return val == constraint;
-        }
+    // compiled $regex patterns, per connection (reused across FINDs)
+    std::unordered_map<std::string, std::shared_ptr<const std::regex>> regex_cache;
+    const size_t MAX_CACHED_REGEX = 64;
+
+    // PREPAREd FINDs of this connection
+    std::unordered_map<std::string, PreparedFind> prepared;
+    const size_t MAX_PREPARED = 256;
+
+    // above this many index candidates, a sort on a sorted-index field streams the index instead
+    const size_t ORDERED_STREAM_MIN = 4096;
+
+    std::shared_ptr<const std::regex> compileRegex(const std::string& pattern, bool icase) {
+        std::string key = (icase ? "i:" : "s:") + pattern;
+        auto it = regex_cache.find(key);
+        if (it != regex_cache.end()) return it->second;
+
+        if (regex_cache.size() >= MAX_CACHED_REGEX) regex_cache.clear();
+        auto flags = std::regex::ECMAScript | (icase ? std::regex::icase : std::regex::ECMAScript);
+        auto compiled = std::make_shared<const std::regex>(pattern, flags);
+        regex_cache.emplace(key, compiled);
+        return compiled;
+    }
 
+    // {"$text": "..."} / {"$phrase": "..."}, phrase wins when both are given
+    static const char* textOperator(const Value& constraint) {
+        if (constraint.type != Type::Object) return nullptr;
         const Document& ops = constraint.asObject();
-        bool match = true;
+        for (const char* op : { "$phrase", "$text" }) {
+            auto it = ops.find(op);
+            if (it != ops.end() && it->second && it->second->type == Type::String) return op;
+        }
+        return nullptr;
+    }
+
+    // Compiled once per FIND, then run for every scanned document (thread-safe, shared by scan workers)
+    QueryProgram compileQuery(const Document& query) {
+        return QueryProgram::compile(query, [this](const std::string& pattern, bool icase) {
+            return compileRegex(pattern, icase);
+        });
+    }
 
-        for (const auto& [op, criterion] : ops) {
-            if (!criterion) continue;
-            const Value& crit = *criterion;
+    // Same layout as Value::ToJson, without copying the document. Empty fields = whole document
+    static std::string renderDocument(const Document& doc, const std::vector<std::string>& fields) {
+        std::string json = "{";
+        bool first = true;
+        auto emit = [&](const std::string& key, const Value& val) {
+            if (!first) json += ", ";
+            json += "\"" + key + "\": " + val.ToJson();
+            first = false;
+        };
 
-            if (op == "$gt") {
-                if (!(val > crit)) match = false;
-            } 
-            else if (op == "$lt") {
-                if (!(val < crit)) match = false;
-            } 
-            else if (op == "$gte") {
-                if (!(val >= crit)) match = false;
-            } 
-            else if (op == "$lte") {
-                if (!(val <= crit)) match = false;
-            } 
-            else if (op == "$ne") {
-                if (val == crit) match = false;
+        if (fields.empty()) {
+            for (const auto& [key, valPtr] : doc) {
+                if (valPtr) emit(key, *valPtr);
+            }
+        } else {
+            for (const auto& key : fields) {
+                auto it = doc.find(key);
+                if (it != doc.end() && it->second) emit(key, *it->second);
             }
         }
-        return match;
+        json += "}";
+        return json;
     }
 
-    bool matches(const Document& doc, const Document& query) {
-        for (const auto& [key, constraint] : query) {
-            if (!constraint) continue;
+    // Optional second FIND argument: {"fields": ["name"], "sort": {"age": -1}, "skip": 20, "limit": 10}
+    static bool parseFindOptions(const std::string& raw, FindOptions& opts, std::string& outError) {
+        if (raw.find_first_not_of(" \n\r\t") == std::string::npos) return true;
 
-            auto it = doc.find(key);
+        QueryParser parser(raw);
+        Document options = parser.parseJSON();
 
-            if (it == doc.end()) return false; 
-
-            if (!checkCondition(*it->second, *constraint)) {
+        for (const auto& [key, val] : options) {
+            if (key == "fields") {
+                if (!val || val->type != Type::Array) {
+                    outError = "ERROR INVALID_FIELDS (Use {\"fields\": [\"a\", \"b\"]})\n";
+                    return false;
+                }
+                for (const auto& f : val->asArray()) {
+                    if (!f || f->type != Type::String) {
+                        outError = "ERROR INVALID_FIELDS (Use {\"fields\": [\"a\", \"b\"]})\n";
+                        return false;
+                    }
+                    opts.fields.push_back(f->asString());
+                }
+            } else if (key == "limit") {
+                if (!val || !val->isNumber() || val->getNumeric() < 0) {
+                    outError = "ERROR INVALID_LIMIT\n";
+                    return false;
+                }
+                opts.limit = static_cast<size_t>(val->getNumeric());
+            } else if (key == "skip") {
+                if (!val || !val->isNumber() || val->getNumeric() < 0) {
+                    outError = "ERROR INVALID_SKIP\n";
+                    return false;
+                }
+                opts.skip = static_cast<size_t>(val->getNumeric());
+            } else if (key == "sort") {
+                if (!val || !ResultOrder::parse(*val, opts.order)) {
+                    outError = "ERROR INVALID_SORT (Use {\"sort\": {\"field\": -1}} or [{\"a\": 1}, {\"b\": -1}])\n";
+                    return false;
+                }
+            } else {
+                outError = "ERROR UNKNOWN_OPTION " + key + "\n";
                 return false;
             }
         }
@@ -98,8 +198,18 @@ public:
             else if (request == "SHOW DBS") {
                 return handleShowDbs();
             }
+            else if (request.rfind("INSERT_MANY ", 0) == 0) return handleInsertMany(request.substr(12));
+            else if (request.rfind("UPDATE_MANY ", 0) == 0) return handleUpdateMany(request.substr(12));
             else if (request.rfind("INSERT ", 0) == 0)      return handleInsert(request.substr(7));
             else if (request.rfind("FIND ", 0) == 0)   return handleFind(request.substr(5));
+            else if (request == "COUNT")               return handleCount("");
+            else if (request.rfind("COUNT ", 0) == 0)  return handleCount(request.substr(6));
+            else if (request == "DISTINCT")            return handleDistinct("");
+            else if (request.rfind("DISTINCT ", 0) == 0) return handleDistinct(request.substr(9));
+            else if (request.rfind("PREPARE ", 0) == 0) return handlePrepare(request.substr(8));
+            else if (request.rfind("EXECUTE ", 0) == 0) return handleExecute(request.substr(8));
+            else if (request.rfind("DEALLOCATE ", 0) == 0) return handleDeallocate(request.substr(11));
+            else if (request.rfind("AGGREGATE ", 0) == 0) return handleAggregate(request.substr(10));
             else if (request.rfind("DELETE ", 0) == 0) return handleDelete(request.substr(7));
             else if (request.rfind("UPDATE ", 0) == 0) return handleUpdate(request.substr(7));
             else if (request.rfind("INDEX ", 0) == 0)  return handleIndex(request.substr(6));
@@ -122,6 +232,9 @@ public:
             else if (request.rfind("GET ", 0) == 0) {
                 return handleGet(request.substr(4));
             }
+            else if (request == "EXPORT") {
+                return handleExport();
+            }
             else if (request.rfind("CONFIG ", 0) == 0) {
                 return handleConfig(request.substr(7));
             }
@@ -183,13 +296,51 @@ private:
         std::string param;
         int value = -1; 
         
-        ss >> param >> value;
+        ss >> param;
+        if (param == "DURABILITY") {
+            std::string level;
+            ss >> level;
+            if (level == "NONE") active_db->setDurability(Durability::None);
+            else if (level == "COMMIT") active_db->setDurability(Durability::Commit);
+            else {
+                try {
+                    value = std::stoi(level);
+                } catch (...) {}
+                if (value < 1) return "ERROR INVALID_VALUE (Use NONE, COMMIT or a sync interval in ms)\n";
+                active_db->setDurability(Durability::Interval, static_cast<unsigned>(value));
+                level = std::to_string(value) + "ms";
+            }
+            return "OK CONFIG_UPDATED DURABILITY=" + level + "\n";
+        }
+        if (param == "COMPRESSION") {
+            std::string codec;
+            ss >> codec;
+            if (codec != "LZ4" && codec != "NONE") return "ERROR INVALID_VALUE (Use LZ4 or NONE)\n";
+            active_db->setCompression(codec == "LZ4");
+            return "OK CONFIG_UPDATED COMPRESSION=" + codec + "\n";
+        }
+        ss >> value;
         if (param == "ADAPTIVE") {
             if (value != 0 && value != 1) return "ERROR INVALID_VALUE (Use 0 or 1)\n";
             bool state = (value == 1);
             active_db->setAdaptive(state);
             return "OK CONFIG_UPDATED ADAPTIVE=" + std::string(state ? "ON" : "OFF") + "\n";
         }
+        else if (param == "SCAN_THREADS") {
+            if (value < 1) return "ERROR INVALID_VALUE (Use 1 or more)\n";
+            active_db->setScanThreads(static_cast<size_t>(value));
+            return "OK CONFIG_UPDATED SCAN_THREADS=" + std::to_string(active_db->getScanThreads()) + "\n";
+        }
+        else if (param == "RESULT_CACHE") {
+            if (value < 0) return "ERROR INVALID_VALUE (Use MB, 0 = off)\n";
+            active_db->resultCache().setBudget(static_cast<size_t>(value) * 1024 * 1024);
+            return "OK CONFIG_UPDATED RESULT_CACHE=" + std::to_string(value) + "MB\n";
+        }
+        else if (param == "MEMORY") {
+            if (value < 0) return "ERROR INVALID_VALUE (Use MB, 0 = all in memory)\n";
+            if (!active_db->setMemoryBudget(static_cast<size_t>(value))) return "ERROR PAGE_FILE_UNAVAILABLE\n";
+            return "OK CONFIG_UPDATED MEMORY=" + std::to_string(value) + "MB\n";
+        }
         else if (param == "PUBSUB") {
             if (value != 0 && value != 1) return "ERROR INVALID_VALUE (Use 0 or 1)\n";
             bool state = (value == 1);
@@ -231,55 +382,484 @@ private:
         return "OK ID=" + std::to_string(id) + "\n";
     }
 
-    std::string handleFind(const std::string& json) {
+    // [{...}, {...}] -> documents, moved out of the parsed array
+    static std::vector<Document> parseBatch(const std::string& json, const char* usage) {
+        QueryParser parser(json);
+        std::shared_ptr<Value> root = parser.parseValue();
+        if (!root || root->type != Type::Array) throw std::runtime_error(std::string("INVALID_BATCH (Use ") + usage + ")");
+
+        std::vector<Document> docs;
+        docs.reserve(root->asArray().size());
+        for (const auto& item : root->asArray()) {
+            if (!item || item->type != Type::Object) throw std::runtime_error(std::string("INVALID_BATCH (Use ") + usage + ")");
+            docs.push_back(std::move(std::get<Document>(item->data)));
+        }
+        if (docs.empty()) throw std::runtime_error("EMPTY_BATCH");
+        return docs;
+    }
+
+    std::string handleInsertMany(const std::string& json) {
         std::string err;
         if (!checkDbSelected(err)) return err;
 
-        QueryParser parser(json);
+        std::vector<Document> docs = parseBatch(json, "INSERT_MANY [{...}, {...}]");
+        size_t n = docs.size();
+        Id first = active_db->insertMany(std::move(docs));
+        return "OK INSERTED=" + std::to_string(n) + " IDS=" + std::to_string(first) + "-" + std::to_string(first + n - 1) + "\n";
+    }
+
+    std::string handleUpdateMany(const std::string& json) {
+        std::string err;
+        if (!checkDbSelected(err)) return err;
+
+        std::vector<Document> docs = parseBatch(json, "UPDATE_MANY [{\"_id\": 1, ...}, ...]");
+        std::vector<std::pair<Id, Document>> updates;
+        updates.reserve(docs.size());
+        for (auto& doc : docs) {
+            auto it = doc.find("_id");
+            if (it == doc.end() || !it->second || it->second->type != Type::Int || it->second->asInt() < 1) {
+                return "ERROR MISSING_ID (every document needs an integer \"_id\")\n";
+            }
+            Id id = static_cast<Id>(it->second->asInt());
+            doc.erase(it);
+            updates.emplace_back(id, std::move(doc));
+        }
+        return "OK UPDATED=" + std::to_string(active_db->updateMany(std::move(updates))) + "\n";
+    }
+
+    // Renders candidates (re-checked by filter when given) in access-path order, or in opts.order
+    // through a skip+limit bounded heap. presorted = ids already follow opts.order
+    std::string renderResults(const std::vector<Id>& ids, const QueryProgram* filter, const FindOptions& opts, bool presorted = false) {
+        std::vector<Id> ordered;
+        const std::vector<Id>* rows = &ids;
+
+        if (!opts.order.empty() && !presorted) {
+            TopK top(opts.order, opts.window());
+            active_db->forEachById(ids, [&](Id id, const Document& doc) {
+                if (!filter || filter->matches(doc)) top.offer(id, doc);
+            });
+            ordered = top.take();
+            rows = &ordered;
+            filter = nullptr;
+        }
+
+        std::string body;
+        size_t count = 0, skipped = 0;
+        active_db->forEachById(*rows, [&](Id id, const Document& doc) {
+            if (count >= opts.limit || (filter && !filter->matches(doc))) return;
+            if (skipped < opts.skip) {
+                skipped++;
+                return;
+            }
+            body += "ID " + std::to_string(id) + " " + renderDocument(doc, opts.fields) + "\n";
+            count++;
+        });
+        return "OK COUNT=" + std::to_string(count) + "\n" + body;
+    }
+
+    // Served from the database's result cache when it is enabled (CONFIG RESULT_CACHE)
+    std::string handleFind(const std::string& args) {
+        std::string err;
+        if (!checkDbSelected(err)) return err;
+
+        QueryParser parser(args);
         Document query = parser.parseJSON();
-        
-        if (query.empty()) return "ERROR EMPTY_QUERY\n";
 
+        FindOptions opts;
+        if (!parseFindOptions(parser.remaining(), opts, err)) return err;
+        if (trivialFind(query, opts, err)) return err;
+
+        return cachedFind(query, opts, nullptr);
+    }
+
+    // True when the response is known without touching the collection
+    static bool trivialFind(const Document& query, const FindOptions& opts, std::string& response) {
+        // {} alone would dump everything, with a limit it is "first/latest N"
+        if (query.empty() && opts.limit == SIZE_MAX) response = "ERROR EMPTY_QUERY\n";
+        else if (opts.limit == 0) response = "OK COUNT=0\n";
+        return !response.empty();
+    }
+
+    // plan = null: planned for this call
+    std::string cachedFind(const Document& query, const FindOptions& opts, const FindPlan* plan) {
+        FindPlan fresh;
+        if (!plan) {
+            fresh = planFind(query, opts);
+            plan = &fresh;
+        }
+
+        ResultCache& cache = active_db->resultCache();
+        if (!cache.enabled()) return runFind(query, opts, *plan);
+
+        std::string key = ResultCache::makeKey(query, opts.fields, opts.order, opts.skip, opts.limit);
+        std::string response;
+        if (cache.get(key, response)) return response;
+
+        uint64_t ticket = cache.ticket(); // before any document is read
+        response = runFind(query, opts, *plan);
+        if (response.rfind("OK ", 0) == 0) {
+            auto program = std::make_shared<const QueryProgram>(compileQuery(query));
+            cache.put(key, ticket, response, ResultCache::describe(query, std::move(program), opts.fields, opts.order));
+        }
+        return response;
+    }
+
+    // Access path from the query's shape (operators and fields, not constants) and the current indexes
+    FindPlan planFind(const Document& query, const FindOptions& opts) {
+        FindPlan plan;
+        plan.indexEpoch = active_db->getIndexEpoch();
+
+        // Covered: every filtered + projected field is indexed, docs are never read
+        bool sortCovered = std::all_of(opts.order.getKeys().begin(), opts.order.getKeys().end(), [&](const ResultOrder::Key& k) {
+            return std::find(opts.fields.begin(), opts.fields.end(), k.field) != opts.fields.end();
+        });
+        plan.covered = !opts.fields.empty() && sortCovered &&
+            std::all_of(opts.fields.begin(), opts.fields.end(), [&](const std::string& f) { return active_db->hasIndex(f); });
+
+        for (const auto& [field, constraint] : query) {
+            if (!constraint || constraint->type != Type::Object) continue;
+            if (constraint->asObject().count("$near")) {
+                plan.route = FindPlan::Route::Near;
+                plan.field = field;
+                return plan;
+            }
+        }
+
+        for (const auto& [field, constraint] : query) {
+            if (constraint && textOperator(*constraint) && active_db->hasTextIndex(field)) {
+                plan.route = FindPlan::Route::Text;
+                plan.field = field;
+                return plan;
+            }
+        }
+
+        for (const auto& [field, constraint] : query) {
+            if (!constraint || constraint->type != Type::Object) continue;
+            const Document& ops = constraint->asObject();
+            if ((ops.count("$prefix") || ops.count("$regex")) && active_db->hasPatternIndex(field)) {
+                plan.route = FindPlan::Route::Pattern;
+                plan.field = field;
+                return plan;
+            }
+        }
+        return plan;
+    }
+
+    // Renders one FIND through its planned access path
+    std::string runFind(const Document& query, const FindOptions& opts, const FindPlan& plan) {
+        QueryProgram program = compileQuery(query);
+
+        std::vector<std::pair<Id, Document>> covered;
+        if (plan.covered && active_db->findCovered(query, opts.fields, covered)) {
+            if (!opts.order.empty()) {
+                std::sort(covered.begin(), covered.end(), [&](const auto& a, const auto& b) {
+                    return opts.order.before(a.second, a.first, opts.order.extract(b.second), b.first);
+                });
+            }
+            size_t first = std::min(opts.skip, covered.size());
+            size_t last = first + std::min(opts.limit, covered.size() - first);
+            std::string response = "OK COUNT=" + std::to_string(last - first) + "\n";
+            for (size_t i = first; i < last; ++i) {
+                response += "ID " + std::to_string(covered[i].first) + " " + renderDocument(covered[i].second, opts.fields) + "\n";
+            }
+            return response;
+        }
+
+        switch (plan.route) {
+            case FindPlan::Route::Near: return findNear(query, plan.field, opts);
+            case FindPlan::Route::Text: return findText(query, plan.field, opts);
+            case FindPlan::Route::Pattern: {
+                std::vector<Id> candidates;
+                if (patternCandidates(plan.field, query.at(plan.field)->asObject(), candidates)) {
+                    std::sort(candidates.begin(), candidates.end());
+                    return renderResults(candidates, &program, opts);
+                }
+                break;
+            }
+            case FindPlan::Route::Lookup: break;
+        }
+        return findIndexed(query, program, opts);
+    }
+
+    // $near: top-k from a VECTOR index (post-filtered by the rest of the query), exact scan otherwise
+    std::string findNear(const Document& query, const std::string& field, const FindOptions& opts) {
+        const Document& ops = query.at(field)->asObject();
+        const auto& near = ops.at("$near");
+        if (!near) return "ERROR INVALID_OPERATOR $near\n";
+
+        size_t k = 10, ef = 0;
+        Metric metric = Metric::Cosine;
+        if (auto it = ops.find("$k"); it != ops.end() && it->second && it->second->isNumber()) {
+            k = static_cast<size_t>(std::max(1.0, it->second->getNumeric()));
+        }
+        if (auto it = ops.find("$ef"); it != ops.end() && it->second && it->second->isNumber()) {
+            ef = static_cast<size_t>(std::max(0.0, it->second->getNumeric()));
+        }
+        if (auto it = ops.find("$metric"); it != ops.end() && it->second && it->second->type == Type::String) {
+            if (!parseMetric(it->second->asString(), metric)) return "ERROR UNKNOWN_METRIC\n";
+        }
+
+        Document residual = query;
+        Document rest = ops;
+        for (const char* op : { "$near", "$k", "$ef", "$metric" }) rest.erase(op);
+        if (rest.empty()) residual.erase(field);
+        else residual[field] = std::make_shared<Value>(std::move(rest));
+
+        QueryProgram filter = compileQuery(residual);
+        std::vector<std::pair<Id, float>> nearest;
+        size_t fetch = residual.empty() ? k : std::max(k * 4, ef); // headroom for the post-filter
+        if (!active_db->findNearest(field, *near, fetch, ef, nearest)) { // ef 0 = the index's own
+            std::vector<std::pair<uint64_t, std::shared_ptr<Value>>> candidates;
+            std::vector<Id> ids = active_db->findAll([&](const Document& doc) {
+                return doc.count(field) && filter.matches(doc);
+            });
+            active_db->forEachById(ids, [&](Id id, const Document& doc) {
+                auto it = doc.find(field);
+                if (it != doc.end() && it->second) candidates.push_back({ id, it->second });
+            });
+            nearest = bruteForceNearest(candidates, *near, k, metric);
+            residual.clear(); // already applied
+        }
+
+        std::vector<Id> ids;
+        for (const auto& [id, d] : nearest) ids.push_back(id);
+
+        // the k nearest first, then skip/limit (or a sort) within them
+        std::vector<Id> topK;
+        active_db->forEachById(ids, [&](Id id, const Document& doc) {
+            if (topK.size() < k && (residual.empty() || filter.matches(doc))) topK.push_back(id);
+        });
+        return renderResults(topK, nullptr, opts);
+    }
+
+    // Full-text: BM25 ranked candidates from a TEXT index, other constraints checked per document
+    std::string findText(const Document& query, const std::string& field, const FindOptions& opts) {
+        const auto& constraint = query.at(field);
+        const char* op = textOperator(*constraint);
+        const std::string& text = constraint->asObject().at(op)->asString();
+        auto ranked = active_db->searchText(field, text, std::string(op) == "$phrase");
+
+        Document residual = query;
+        Document rest = constraint->asObject();
+        rest.erase(op);
+        if (rest.empty()) residual.erase(field);
+        else residual[field] = std::make_shared<Value>(std::move(rest));
+
+        std::vector<Id> ids;
+        ids.reserve(ranked.size());
+        for (const auto& [id, score] : ranked) ids.push_back(id);
+        QueryProgram filter = compileQuery(residual);
+        return renderResults(ids, &filter, opts);
+    }
+
+    // $prefix / $regex: sorted range on the literal prefix, else trigram candidates (full check by the caller)
+    bool patternCandidates(const std::string& field, const Document& ops, std::vector<Id>& candidates) {
+        auto pre = ops.find("$prefix");
+        auto rx = ops.find("$regex");
+
+        if (pre != ops.end() && pre->second && pre->second->type == Type::String) {
+            return active_db->findPrefix(field, pre->second->asString(), candidates);
+        }
+        if (rx == ops.end() || !rx->second || rx->second->type != Type::String) return false;
+
+        auto opt = ops.find("$options");
+        bool icase = opt != ops.end() && opt->second && opt->second->type == Type::String &&
+                     opt->second->asString().find('i') != std::string::npos;
+
+        RegexLiterals lit = TrigramIndex::analyze(rx->second->asString());
+        if (!icase && !lit.prefix.empty() && active_db->findPrefix(field, lit.prefix, candidates)) return true;
+        return !lit.runs.empty() && active_db->findTrigrams(field, lit.runs, candidates);
+    }
+
+    // Hash/sorted indexes: equality, $in and $or become (unions of) lookups, re-checked per doc
+    std::string findIndexed(const Document& query, const QueryProgram& program, const FindOptions& opts) {
         std::vector<Id> ids;
-        bool usedIndex = false;
-        bool isRange = false;
+        bool usedIndex = active_db->planCandidates(query, ids);
+        auto predicate = [&program](const Document& doc) { return program.matches(doc); };
+
+        // One sort key with a sorted index: stream the index and stop after skip+limit,
+        // unless point lookups already left a small candidate set for the heap
+        if (opts.order.getKeys().size() == 1 && (!usedIndex || ids.size() > ORDERED_STREAM_MIN)) {
+            const ResultOrder::Key& key = opts.order.getKeys()[0];
+            std::vector<Id> streamed;
+            size_t need = opts.window();
 
-        if (query.begin()->second->type == Type::Object) {
-            isRange = true; 
+            if (active_db->findOrdered(key.field, key.descending, predicate, need, streamed)) {
+                if (streamed.size() < need) { // docs without the field sort last
+                    auto rest = active_db->findAll([&](const Document& doc) {
+                        return !doc.count(key.field) && program.matches(doc);
+                    });
+                    streamed.insert(streamed.end(), rest.begin(), rest.begin() + std::min(rest.size(), need - streamed.size()));
+                }
+                return renderResults(streamed, nullptr, opts, true);
+            }
         }
 
+        if (usedIndex) return renderResults(ids, &program, opts);
+
         if (query.size() == 1) {
             auto it = query.begin();
-            std::string field = it->first;
-            
-            if (it->second->type != Type::Object) {
-                 ids = active_db->find(field, *it->second);
-                 
-                 if (!ids.empty()) {
-                     usedIndex = true;
-                 } 
-            }
-            
-            if (!usedIndex) {
+            const std::string& field = it->first;
+            bool isRange = it->second && it->second->type == Type::Object;
+
+            // text misses are not fixed by hash/sorted indexes, $or/$and are not fields
+            if (it->second && !textOperator(*it->second) && field[0] != '$') {
                 active_db->reportQueryMiss(field, isRange);
             }
         }
 
-        if (!usedIndex) {
-            ids = active_db->findAll([this, &query](const Document& doc) {
-                return this->matches(doc, query);
+        if (!opts.order.empty()) {
+            return renderResults(active_db->findTopK(predicate, opts.order, opts.window()), nullptr, opts, true);
+        }
+        return renderResults(active_db->findAll(predicate, opts.window()), nullptr, opts);
+    }
+
+    // PREPARE <name> <query with $1..$n> [options]: parsed and validated once, planned by the first EXECUTE
+    std::string handlePrepare(const std::string& args) {
+        std::stringstream ss(args);
+        std::string name;
+        ss >> name;
+        std::string rest;
+        std::getline(ss, rest);
+        if (name.empty() || rest.find('{') == std::string::npos) return "ERROR INVALID_ARGS (Use PREPARE <name> <query> [options])\n";
+        if (prepared.size() >= MAX_PREPARED && !prepared.count(name)) return "ERROR TOO_MANY_PREPARED\n";
+
+        QueryParser parser(rest, true);
+        PreparedFind stmt;
+        stmt.query = QueryTemplate(parser.parseJSON());
+
+        std::string err;
+        if (!parseFindOptions(parser.remaining(), stmt.opts, err)) return err;
+
+        size_t params = stmt.query.paramCount();
+        prepared[name] = std::move(stmt);
+        return "OK PREPARED " + name + " PARAMS=" + std::to_string(params) + "\n";
+    }
+
+    // EXECUTE <name> [params]: binds [$1, $2, ...] into the prepared query, reusing its plan
+    std::string handleExecute(const std::string& args) {
+        std::string err;
+        if (!checkDbSelected(err)) return err;
+
+        std::stringstream ss(args);
+        std::string name;
+        ss >> name;
+        auto it = prepared.find(name);
+        if (it == prepared.end()) return "ERROR UNKNOWN_STATEMENT " + name + "\n";
+        PreparedFind& stmt = it->second;
+
+        std::string rest;
+        std::getline(ss, rest);
+        Array params;
+        if (rest.find_first_not_of(" \n\r\t") != std::string::npos) {
+            QueryParser parser(rest);
+            auto list = parser.parseValue();
+            if (list->type != Type::Array) return "ERROR INVALID_PARAMS (Use EXECUTE <name> [v1, v2, ...])\n";
+            params = list->asArray();
+        }
+
+        Document query = stmt.query.bind(params);
+        if (trivialFind(query, stmt.opts, err)) return err;
+
+        if (!stmt.plan || stmt.db != active_db || stmt.plan->indexEpoch != active_db->getIndexEpoch()) {
+            stmt.plan = planFind(query, stmt.opts);
+            stmt.db = active_db;
+        }
+        return cachedFind(query, stmt.opts, &*stmt.plan);
+    }
+
+    std::string handleDeallocate(const std::string& args) {
+        std::string name = args;
+        name.erase(name.find_last_not_of(" \n\r\t") + 1);
+        if (!prepared.erase(name)) return "ERROR UNKNOWN_STATEMENT " + name + "\n";
+        return "OK DEALLOCATED\n";
+    }
+
+    static Document parseOptionalQuery(const std::string& raw) {
+        if (raw.find_first_not_of(" \n\r\t") == std::string::npos) return {};
+        QueryParser parser(raw);
+        return parser.parseJSON();
+    }
+
+    // Candidates for COUNT/DISTINCT: a TEXT index posting list, else hash/sorted lookups
+    bool indexCandidates(const Document& query, std::vector<Id>& ids) {
+        for (const auto& [field, constraint] : query) {
+            const char* op = constraint ? textOperator(*constraint) : nullptr;
+            if (!op || !active_db->hasTextIndex(field)) continue;
+
+            auto ranked = active_db->searchText(field, constraint->asObject().at(op)->asString(), std::string(op) == "$phrase");
+            for (const auto& [id, score] : ranked) ids.push_back(id);
+            return true;
+        }
+        return active_db->planCandidates(query, ids);
+    }
+
+    // COUNT [query]: index sizes when they answer it exactly, otherwise matching docs are counted
+    std::string handleCount(const std::string& args) {
+        std::string err;
+        if (!checkDbSelected(err)) return err;
+
+        Document query = parseOptionalQuery(args);
+        size_t n = 0;
+        if (active_db->countIndexed(query, n)) return "OK COUNT=" + std::to_string(n) + "\n";
+
+        QueryProgram program = compileQuery(query);
+        std::vector<Id> ids;
+        if (indexCandidates(query, ids)) {
+            active_db->forEachById(ids, [&](Id, const Document& doc) {
+                if (program.matches(doc)) n++;
             });
+        } else {
+            n = active_db->countMatching([&program](const Document& doc) { return program.matches(doc); });
         }
+        return "OK COUNT=" + std::to_string(n) + "\n";
+    }
 
-        std::string response = "OK COUNT=" + std::to_string(ids.size()) + "\n";
-        
-        for(Id id : ids) {
-            auto res = active_db->getById(id);
-            if (res) {
-                Value temp(res->get());
-                response += "ID " + std::to_string(id) + " " + temp.ToJson() + "\n"; 
-            }
+    // DISTINCT <field> [query]: index keys when unfiltered, otherwise values of matching docs
+    std::string handleDistinct(const std::string& args) {
+        std::string err;
+        if (!checkDbSelected(err)) return err;
+
+        std::stringstream ss(args);
+        std::string field;
+        ss >> field;
+        if (field.empty()) return "ERROR MISSING_FIELD (Use DISTINCT <field> [query])\n";
+
+        std::string rest;
+        std::getline(ss, rest);
+        Document query = parseOptionalQuery(rest);
+
+        std::vector<Value> values;
+        if (!query.empty() || !active_db->distinctIndexed(field, values)) {
+            QueryProgram program = compileQuery(query);
+            auto predicate = [&program](const Document& doc) { return program.matches(doc); };
+
+            std::vector<Id> ids;
+            if (indexCandidates(query, ids)) values = active_db->distinctOf(field, ids, predicate);
+            else values = active_db->distinctMatching(field, predicate);
+        }
+
+        std::string json = "[";
+        for (size_t i = 0; i < values.size(); ++i) {
+            json += values[i].ToJson();
+            if (i < values.size() - 1) json += ", ";
         }
+        return "OK " + json + "]\n";
+    }
+
+    // AGGREGATE <pipeline>: one result row per line (group rows carry their key in "_id")
+    std::string handleAggregate(const std::string& args) {
+        std::string err;
+        if (!checkDbSelected(err)) return err;
+
+        QueryParser parser(args);
+        Pipeline pipeline = Pipeline::parse(*parser.parseValue());
+        std::vector<Document> rows = pipeline.run(*active_db, [this](const std::string& pattern, bool icase) {
+            return compileRegex(pattern, icase);
+        });
+
+        std::string response = "OK COUNT=" + std::to_string(rows.size()) + "\n";
+        for (const auto& row : rows) response += renderDocument(row, {}) + "\n";
         return response;
     }
 
@@ -327,7 +907,15 @@ private:
         
         ss >> field;
         if (ss >> type) {
-            active_db->createIndex(field, type);
+            // optional index settings, e.g. INDEX body 2 {"stopwords": ["the", "a"]}
+            Document options;
+            std::string rest;
+            std::getline(ss, rest);
+            if (rest.find('{') != std::string::npos) {
+                QueryParser parser(rest);
+                options = parser.parseJSON();
+            }
+            active_db->createIndex(field, type, options);
         } else {
             active_db->createIndex(field, 0);
         }
@@ -339,48 +927,42 @@ private:
         if (!checkDbSelected(err)) return err;
 
         if (args.empty()) {
-             std::vector<Id> allIds = active_db->findAll([](const Document&){ return true; });
-             
-             std::string response = "OK COUNT=" + std::to_string(allIds.size()) + "\n";
-             for(Id id : allIds) {
-                 auto res = active_db->getById(id);
-                 if (res) {
-                     Value temp(res->get());
-                     response += "ID " + std::to_string(id) + " " + temp.ToJson() + "\n";
-                 }
-             }
-             return response;
+             std::string body;
+             size_t count = 0;
+             active_db->forEachInRange(0, UINT64_MAX, [&](Id id, const Document& doc) {
+                 body += "ID " + std::to_string(id) + " " + renderDocument(doc, {}) + "\n";
+                 count++;
+                 return true;
+             });
+             return "OK COUNT=" + std::to_string(count) + "\n" + body;
         }
 
         size_t dashPos = args.find('-');
         if (dashPos != std::string::npos) {
+            Id start, end;
             try {
-                Id start = std::stoull(args.substr(0, dashPos));
-                Id end   = std::stoull(args.substr(dashPos + 1));
-                
-                std::string response;
-                int count = 0;
-                
-                for (Id i = start; i <= end; ++i) {
-                     auto res = active_db->getById(i);
-                     if (res) {
-                         Value temp(res->get());
-                         response += "ID " + std::to_string(i) + " " + temp.ToJson() + "\n";
-                         count++;
-                     }
-                }
-                return "OK COUNT=" + std::to_string(count) + "\n" + response;
+                start = std::stoull(args.substr(0, dashPos));
+                end   = std::stoull(args.substr(dashPos + 1));
             } catch (...) {
                 return "ERROR INVALID_RANGE\n";
             }
+
+            // one locked walk over the pages that exist, not a lookup per id in [start, end]
+            std::string response;
+            size_t count = 0;
+            active_db->forEachInRange(start, end, [&](Id id, const Document& doc) {
+                response += "ID " + std::to_string(id) + " " + renderDocument(doc, {}) + "\n";
+                count++;
+                return true;
+            });
+            return "OK COUNT=" + std::to_string(count) + "\n" + response;
         }
 
         try {
             Id id = std::stoull(args);
             auto result = active_db->getById(id); 
             if (result) {
-                Value tempVal(result->get());
-                return "OK " + tempVal.ToJson() + "\n";
+                return "OK " + renderDocument(*result, {}) + "\n";
             } else {
                 return "ERROR NOT_FOUND\n";
             }
@@ -389,6 +971,30 @@ private:
         }
     }
 
+    // Binary bulk read: a header line, then every document as a record in the storage encoding
+    // (id | size | doc, varints), ended by a 0 byte (ids start at 1). Records are encoded into
+    // the connection's output buffer and sent as it fills, from a copy-on-write copy of the
+    // store, so neither the response nor a slow reader holds memory or writers. Answered on the
+    // socket directly, the returned response is empty
+    std::string handleExport() {
+        std::string err;
+        if (!checkDbSelected(err)) return err;
+
+        SocketSink out(clientSocket);
+        Serializer writer;
+        active_db->withFrozenDocuments([&](const DocumentStore& docs) {
+            std::string head = "OK EXPORT COUNT=" + std::to_string(docs.size()) + " ENCODING=" + std::to_string(ENCODING_CURRENT) + "\n";
+            out.write(head.data(), head.size());
+            for (auto it = docs.begin(); it != docs.end() && !out.failed(); ++it) {
+                writer.writeRecord(out, it->first, it->second);
+                out.flushIfFull();
+            }
+        });
+        out.put(0);
+        out.flush();
+        return "";
+    }
+
     std::string handleExpire(const std::string& args) {
         std::string err;
         if (!checkDbSelected(err)) return err;
@@ -474,13 +1080,28 @@ private:
 
         msg += "--- CONFIG ---\n";
         msg += "CONFIG SET_PASSWORD <new> : Change system password\n";
-        msg += "CONFIG <param> <val>      : Set ADAPTIVE (1/0) or PUBSUB (1/0)\n";
+        msg += "CONFIG <param> <val>      : Set ADAPTIVE (1/0), PUBSUB (1/0), SCAN_THREADS (n) or RESULT_CACHE (MB, 0 = off)\n";
+        msg += "CONFIG DURABILITY <mode>  : WAL sync: NONE, COMMIT (ack after fdatasync) or <ms> (sync interval)\n";
+        msg += "CONFIG COMPRESSION <c>    : LZ4 or NONE, for snapshots and WAL batches written from now on\n";
+        msg += "CONFIG MEMORY <mb>        : Keep about <mb> MB of documents in memory, cold pages on disk (0 = all)\n";
         
         msg += "--- CRUD ---\n";
         msg += "INSERT <json>             : Insert document\n";
+        msg += "INSERT_MANY [json, ...]   : Bulk insert (one WAL write), returns the contiguous id range\n";
         msg += "GET <id> | <start-end>    : Get doc by ID or range\n";
+        msg += "EXPORT                    : All documents, binary (id | size | doc records, 0-terminated)\n";
         msg += "FIND <json_query>         : Search (e.g. {\"age\": {\"$gt\": 18}})\n";
+        msg += "                            Ops: $gt $gte $lt $lte $ne $in $nin $exists $not $or $and\n";
+        msg += "FIND <query> <options>    : fields/sort/skip/limit (e.g. {\"sort\": {\"age\": -1}, \"limit\": 5})\n";
+        msg += "PREPARE <name> <query>    : FIND with $1..$n placeholders (e.g. {\"age\": {\"$gt\": $1}}), planned once\n";
+        msg += "EXECUTE <name> [params]   : Run a prepared FIND (e.g. EXECUTE adults [18]); DEALLOCATE <name> drops it\n";
+        msg += "COUNT [json_query]        : Count matches (e.g. COUNT {\"age\": {\"$gt\": 18}})\n";
+        msg += "DISTINCT <field> [query]  : Distinct values of a field, optionally filtered\n";
+        msg += "AGGREGATE <pipeline>      : [{\"$match\": ..}, {\"$group\": {\"_id\": \"$f\", \"n\": {\"$sum\": 1}}}, $sort, $skip, $limit, $project]\n";
+        msg += "                            Accumulators: $sum $avg $min $max $count\n";
+        msg += "INDEX <field> [type]      : 0 = Hash, 1 = Sorted, 2 = Text ($text / $phrase), 3 = Trigram ($regex), 4 = Vector ($near)\n";
         msg += "UPDATE <id> <json>        : Update document\n";
+        msg += "UPDATE_MANY [json, ...]   : Bulk update, each document names its target with \"_id\"\n";
         msg += "DELETE <id>               : Delete by ID\n";
         
         msg += "--- UTILITIES ---\n";
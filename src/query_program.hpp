@@ -0,0 +1,377 @@
+#ifndef QUERY_PROGRAM_HPP
+#define QUERY_PROGRAM_HPP
+
+#include "document.hpp"
+#include "text_index.hpp"
+#include <vector>
+#include <string>
+#include <regex>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <unordered_set>
+#include <stdexcept>
+
+namespace fluxdb {
+
+enum class OpCode : uint8_t { Eq, Ne, Gt, Gte, Lt, Lte, In, Nin, Exists, Prefix, Regex, Text, Phrase };
+
+// What the constant was decoded to at compile time (its ValueLess rank, or a $in list)
+enum class ConstKind : uint8_t { Num, Bool, Str, Other, List };
+
+struct Instr;
+using Kernel = bool (*)(const Value&, const Instr&);
+
+constexpr size_t VALUE_TYPES = 6; // Type::Int .. Type::Array
+
+struct Instr {
+    OpCode op;
+    ConstKind kind;
+    double num = 0;
+    bool flag = false;
+    std::string str;
+    std::shared_ptr<const std::regex> regex;
+    std::vector<Token> terms;          // pre-tokenized $text / $phrase
+    std::vector<double> nums;          // $in / $nin list, split by type (sorted)
+    std::unordered_set<std::string> strs;
+    uint8_t bools = 0;                 // bit 0 = false listed, bit 1 = true listed
+    const Kernel* kernels = nullptr;   // one per document value type
+};
+
+namespace kernels {
+
+inline const Tokenizer& textTokenizer() { // $text on fields without a TEXT index
+    static const Tokenizer tokenizer;
+    return tokenizer;
+}
+
+template <ConstKind C> constexpr int constRank() {
+    if constexpr (C == ConstKind::Num) return 0;
+    else if constexpr (C == ConstKind::Bool) return 1;
+    else if constexpr (C == ConstKind::Str) return 2;
+    else return 3;
+}
+
+template <Type T> constexpr int valueRank() {
+    if constexpr (T == Type::Int || T == Type::Double) return 0;
+    else if constexpr (T == Type::Bool) return 1;
+    else if constexpr (T == Type::String) return 2;
+    else return 3;
+}
+
+// Three-way ValueLess order of (value, constant); same rank objects/arrays are equivalent
+template <Type T, ConstKind C>
+inline int order(const Value& v, const Instr& in) {
+    constexpr int rv = valueRank<T>(), rc = constRank<C>();
+    if constexpr (rv != rc) {
+        return rv < rc ? -1 : 1;
+    } else if constexpr (T == Type::Int) {
+        double d = static_cast<double>(*std::get_if<int64_t>(&v.data));
+        return d < in.num ? -1 : (in.num < d ? 1 : 0);
+    } else if constexpr (T == Type::Double) {
+        double d = *std::get_if<double>(&v.data);
+        return d < in.num ? -1 : (in.num < d ? 1 : 0);
+    } else if constexpr (T == Type::Bool) {
+        bool b = *std::get_if<bool>(&v.data);
+        return b == in.flag ? 0 : (b < in.flag ? -1 : 1);
+    } else if constexpr (T == Type::String) {
+        int c = std::get_if<std::string>(&v.data)->compare(in.str);
+        return c < 0 ? -1 : (c > 0 ? 1 : 0);
+    } else {
+        return 0;
+    }
+}
+
+// Value::operator== : numbers compare numerically, objects/arrays never equal
+template <Type T, ConstKind C>
+inline bool equal(const Value& v, const Instr& in) {
+    if constexpr (valueRank<T>() != constRank<C>() || valueRank<T>() == 3) return false;
+    else return order<T, C>(v, in) == 0;
+}
+
+// Value::operator== against any list element
+template <Type T>
+inline bool listed(const Value& v, const Instr& in) {
+    if constexpr (T == Type::Int) {
+        return std::binary_search(in.nums.begin(), in.nums.end(), static_cast<double>(*std::get_if<int64_t>(&v.data)));
+    } else if constexpr (T == Type::Double) {
+        return std::binary_search(in.nums.begin(), in.nums.end(), *std::get_if<double>(&v.data));
+    } else if constexpr (T == Type::Bool) {
+        return (in.bools >> (*std::get_if<bool>(&v.data) ? 1 : 0)) & 1;
+    } else if constexpr (T == Type::String) {
+        return in.strs.count(*std::get_if<std::string>(&v.data)) > 0;
+    } else {
+        return false;
+    }
+}
+
+template <OpCode Op, ConstKind C, Type T>
+bool run(const Value& v, const Instr& in) {
+    if constexpr (Op == OpCode::Exists) return in.flag; // only reached when the field is present
+    else if constexpr (Op == OpCode::In || Op == OpCode::Nin) {
+        if constexpr (C != ConstKind::List) return false;
+        else return listed<T>(v, in) == (Op == OpCode::In);
+    }
+    else if constexpr (Op == OpCode::Eq) return equal<T, C>(v, in);
+    else if constexpr (Op == OpCode::Ne) return !equal<T, C>(v, in);
+    else if constexpr (Op == OpCode::Gt) return order<T, C>(v, in) > 0;
+    else if constexpr (Op == OpCode::Gte) return order<T, C>(v, in) >= 0;
+    else if constexpr (Op == OpCode::Lt) return order<T, C>(v, in) < 0;
+    else if constexpr (Op == OpCode::Lte) return order<T, C>(v, in) <= 0;
+    else if constexpr (T != Type::String || C != ConstKind::Str) return false; // string only operators
+    else {
+        const std::string& s = *std::get_if<std::string>(&v.data);
+        if constexpr (Op == OpCode::Prefix) return s.compare(0, in.str.size(), in.str) == 0;
+        else if constexpr (Op == OpCode::Regex) return std::regex_search(s, *in.regex);
+        else return Tokenizer::matchTokens(textTokenizer().tokenize(s), in.terms, Op == OpCode::Phrase);
+    }
+}
+
+template <OpCode Op, ConstKind C>
+inline const Kernel* table() {
+    static const Kernel row[VALUE_TYPES] = {
+        &run<Op, C, Type::Int>, &run<Op, C, Type::Double>, &run<Op, C, Type::Bool>,
+        &run<Op, C, Type::String>, &run<Op, C, Type::Object>, &run<Op, C, Type::Array>
+    };
+    return row;
+}
+
+template <OpCode Op>
+inline const Kernel* table(ConstKind c) {
+    switch (c) {
+        case ConstKind::Num:  return table<Op, ConstKind::Num>();
+        case ConstKind::Bool: return table<Op, ConstKind::Bool>();
+        case ConstKind::Str:  return table<Op, ConstKind::Str>();
+        case ConstKind::List: return table<Op, ConstKind::List>();
+        default:              return table<Op, ConstKind::Other>();
+    }
+}
+
+inline const Kernel* lookup(OpCode op, ConstKind c) {
+    switch (op) {
+        case OpCode::Eq:     return table<OpCode::Eq>(c);
+        case OpCode::Ne:     return table<OpCode::Ne>(c);
+        case OpCode::Gt:     return table<OpCode::Gt>(c);
+        case OpCode::Gte:    return table<OpCode::Gte>(c);
+        case OpCode::Lt:     return table<OpCode::Lt>(c);
+        case OpCode::Lte:    return table<OpCode::Lte>(c);
+        case OpCode::In:     return table<OpCode::In>(c);
+        case OpCode::Nin:    return table<OpCode::Nin>(c);
+        case OpCode::Exists: return table<OpCode::Exists>(c);
+        case OpCode::Prefix: return table<OpCode::Prefix>(c);
+        case OpCode::Regex:  return table<OpCode::Regex>(c);
+        case OpCode::Text:   return table<OpCode::Text>(c);
+        default:             return table<OpCode::Phrase>(c);
+    }
+}
+
+}
+
+// A FIND query compiled once into a flat program: one step per field (looked up once),
+// each running its instructions through the kernel picked by the document value's type.
+// $and is flattened into the parent, $or keeps one sub-program per branch. The field lookup
+// (a hash probe into the document) stays: on documents out of cache it is most of the cost
+class QueryProgram {
+public:
+    using RegexCompiler = std::function<std::shared_ptr<const std::regex>(const std::string&, bool)>;
+
+private:
+    struct Step {
+        std::string field;
+        uint32_t first = 0, count = 0;     // range in 'program'
+        int cost = 0;
+        bool negate = false;               // {"$not": {...}}
+        bool missing = false;              // result when the field is absent ({"$exists": false})
+        std::vector<QueryProgram> any;     // $or branches (field unused)
+    };
+
+    static int cost(OpCode op) {
+        switch (op) {
+            case OpCode::Eq:
+            case OpCode::Exists: return 0;
+            case OpCode::In:
+            case OpCode::Nin:    return 1;
+            case OpCode::Prefix: return 2;
+            case OpCode::Regex:
+            case OpCode::Text:
+            case OpCode::Phrase: return 3;
+            default:             return 1;
+        }
+    }
+
+    std::vector<Step> steps;
+    std::vector<Instr> program;
+
+    static bool decodeOp(const std::string& name, OpCode& op) {
+        static const std::pair<const char*, OpCode> OPS[] = {
+            { "$gt", OpCode::Gt }, { "$gte", OpCode::Gte }, { "$lt", OpCode::Lt }, { "$lte", OpCode::Lte },
+            { "$ne", OpCode::Ne }, { "$in", OpCode::In }, { "$nin", OpCode::Nin }, { "$exists", OpCode::Exists },
+            { "$prefix", OpCode::Prefix }, { "$regex", OpCode::Regex },
+            { "$text", OpCode::Text }, { "$phrase", OpCode::Phrase }
+        };
+        for (const auto& [n, o] : OPS) {
+            if (name == n) { op = o; return true; }
+        }
+        return false; // $options, $k, $near ... are not filters
+    }
+
+    static bool truthy(const Value& v) {
+        if (v.type == Type::Bool) return v.asBool();
+        if (v.isNumber()) return v.getNumeric() != 0;
+        return true;
+    }
+
+    void emit(OpCode op, const Value& constant, const Document* ops, const RegexCompiler& compileRegex) {
+        Instr in;
+        in.op = op;
+        switch (constant.type) {
+            case Type::Int:
+            case Type::Double: in.kind = ConstKind::Num; in.num = constant.getNumeric(); break;
+            case Type::Bool:   in.kind = ConstKind::Bool; in.flag = constant.asBool(); break;
+            case Type::String: in.kind = ConstKind::Str; in.str = constant.asString(); break;
+            default:           in.kind = ConstKind::Other; break;
+        }
+
+        if (in.kind == ConstKind::Str) {
+            if (op == OpCode::Regex) {
+                bool icase = false;
+                auto opt = ops->find("$options");
+                if (opt != ops->end() && opt->second && opt->second->type == Type::String) {
+                    icase = opt->second->asString().find('i') != std::string::npos;
+                }
+                in.regex = compileRegex(in.str, icase);
+            }
+            else if (op == OpCode::Text || op == OpCode::Phrase) {
+                in.terms = kernels::textTokenizer().tokenize(in.str);
+            }
+        }
+
+        if (op == OpCode::In || op == OpCode::Nin) {
+            if (constant.type != Type::Array) {
+                throw std::runtime_error(std::string("INVALID_OPERATOR ") + (op == OpCode::In ? "$in" : "$nin") + " expects an array");
+            }
+            in.kind = ConstKind::List;
+            for (const auto& e : constant.asArray()) {
+                if (!e) continue;
+                if (e->isNumber()) in.nums.push_back(e->getNumeric());
+                else if (e->type == Type::Bool) in.bools |= e->asBool() ? 2 : 1;
+                else if (e->type == Type::String) in.strs.insert(e->asString());
+            }
+            std::sort(in.nums.begin(), in.nums.end());
+        }
+        else if (op == OpCode::Exists) {
+            in.kind = ConstKind::Bool;
+            in.flag = truthy(constant);
+        }
+
+        in.kernels = kernels::lookup(op, in.kind);
+        program.push_back(std::move(in));
+    }
+
+    // One step for a field constraint; $not becomes a second, negated step on the same field
+    void compileField(const std::string& field, const Value& constraint, const RegexCompiler& compileRegex, bool negate) {
+        Step step;
+        step.field = field;
+        step.negate = negate;
+        step.first = static_cast<uint32_t>(program.size());
+
+        const Value* inverted = nullptr;
+        if (constraint.type != Type::Object) {
+            emit(OpCode::Eq, constraint, nullptr, compileRegex);
+        } else {
+            const Document& ops = constraint.asObject();
+            for (const auto& [name, criterion] : ops) {
+                if (!criterion) continue;
+                OpCode op;
+                if (name == "$not") {
+                    if (criterion->type != Type::Object) throw std::runtime_error("INVALID_OPERATOR $not expects an object");
+                    inverted = criterion.get();
+                }
+                else if (decodeOp(name, op)) emit(op, *criterion, &ops, compileRegex);
+            }
+        }
+
+        step.count = static_cast<uint32_t>(program.size()) - step.first;
+        step.missing = step.count > 0;
+        for (uint32_t i = step.first; i < step.first + step.count; ++i) {
+            const Instr& in = program[i];
+            step.cost = std::max(step.cost, cost(in.op));
+            if (in.op != OpCode::Exists || in.flag) step.missing = false;
+        }
+        // a bare {"$not": {...}} doesn't require the field itself
+        if (step.count > 0 || !inverted) steps.push_back(std::move(step));
+        if (inverted) compileField(field, *inverted, compileRegex, !negate);
+    }
+
+    static const Array& branches(const Value& v, const char* op) {
+        if (v.type != Type::Array || v.asArray().empty()) {
+            throw std::runtime_error(std::string("INVALID_OPERATOR ") + op + " expects a non-empty array");
+        }
+        return v.asArray();
+    }
+
+    void compileInto(const Document& query, const RegexCompiler& compileRegex) {
+        for (const auto& [field, constraint] : query) {
+            if (!constraint) continue;
+
+            if (field == "$and") {
+                for (const auto& b : branches(*constraint, "$and")) {
+                    if (b && b->type == Type::Object) compileInto(b->asObject(), compileRegex);
+                }
+            }
+            else if (field == "$or") {
+                Step step;
+                for (const auto& b : branches(*constraint, "$or")) {
+                    if (!b || b->type != Type::Object) throw std::runtime_error("INVALID_OPERATOR $or branches must be objects");
+                    step.any.push_back(compile(b->asObject(), compileRegex));
+                    for (const auto& s : step.any.back().steps) step.cost = std::max(step.cost, s.cost + 1);
+                }
+                steps.push_back(std::move(step));
+            }
+            else compileField(field, *constraint, compileRegex, false);
+        }
+    }
+
+    bool runStep(const Step& step, const Document& doc) const {
+        if (!step.any.empty()) {
+            for (const auto& branch : step.any) {
+                if (branch.matches(doc)) return true;
+            }
+            return false;
+        }
+
+        auto it = doc.find(step.field);
+        if (it == doc.end()) return step.missing;
+
+        const Value& v = *it->second;
+        size_t t = static_cast<size_t>(v.type);
+        for (uint32_t i = step.first; i < step.first + step.count; ++i) {
+            const Instr& in = program[i];
+            if (!in.kernels[t](v, in)) return false;
+        }
+        return true;
+    }
+
+public:
+    // Throws std::regex_error for a bad $regex and runtime_error for malformed $in/$or/$not
+    static QueryProgram compile(const Document& query, const RegexCompiler& compileRegex) {
+        QueryProgram p;
+        p.compileInto(query, compileRegex);
+        // AND is order free: cheap equality/range steps reject most docs before a regex runs
+        std::stable_sort(p.steps.begin(), p.steps.end(), [](const Step& a, const Step& b) { return a.cost < b.cost; });
+        return p;
+    }
+
+    bool matches(const Document& doc) const {
+        for (const Step& step : steps) {
+            if (runStep(step, doc) == step.negate) return false;
+        }
+        return true;
+    }
+
+    bool empty() const { return steps.empty(); }
+};
+
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef QUERY_TEMPLATE_HPP
+#define QUERY_TEMPLATE_HPP
+
+#include "document.hpp"
+#include "query_parser.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <stdexcept>
+
+namespace fluxdb {
+
+// A query with $1..$n placeholders (PREPARE), parsed once. bind() swaps the arguments in and
+// shares every subtree without a placeholder with the template
+class QueryTemplate {
+private:
+    Document query;
+    size_t params = 0;
+
+    // {"$param": n}
+    static bool placeholder(const Value& v, size_t& index) {
+        if (v.type != Type::Object || v.asObject().size() != 1) return false;
+        auto it = v.asObject().find(QueryParser::PARAM_KEY);
+        if (it == v.asObject().end() || !it->second || it->second->type != Type::Int) return false;
+        index = static_cast<size_t>(it->second->asInt());
+        return true;
+    }
+
+    static void collect(const Value& v, std::vector<bool>& seen) {
+        size_t index;
+        if (placeholder(v, index)) {
+            if (seen.size() < index) seen.resize(index, false);
+            seen[index - 1] = true;
+        } else if (v.type == Type::Object) {
+            for (const auto& [key, child] : v.asObject()) {
+                if (child) collect(*child, seen);
+            }
+        } else if (v.type == Type::Array) {
+            for (const auto& child : v.asArray()) {
+                if (child) collect(*child, seen);
+            }
+        }
+    }
+
+    // {"$near": ...} and the like: would change the query's operators after it was planned
+    static bool operatorObject(const std::shared_ptr<Value>& v) {
+        if (!v || v->type != Type::Object) return false;
+        for (const auto& [key, child] : v->asObject()) {
+            if (!key.empty() && key[0] == '$') return true;
+        }
+        return false;
+    }
+
+    static std::shared_ptr<Value> bind(const std::shared_ptr<Value>& v, const Array& args) {
+        if (!v) return v;
+        size_t index;
+        if (placeholder(*v, index)) return args[index - 1];
+
+        if (v->type == Type::Object) {
+            Document out;
+            bool changed = false;
+            for (const auto& [key, child] : v->asObject()) {
+                auto bound = bind(child, args);
+                changed |= bound != child;
+                out.emplace(key, std::move(bound));
+            }
+            return changed ? std::make_shared<Value>(std::move(out)) : v;
+        }
+        if (v->type == Type::Array) {
+            Array out;
+            bool changed = false;
+            for (const auto& child : v->asArray()) {
+                auto bound = bind(child, args);
+                changed |= bound != child;
+                out.push_back(std::move(bound));
+            }
+            return changed ? std::make_shared<Value>(std::move(out)) : v;
+        }
+        return v;
+    }
+
+public:
+    QueryTemplate() = default;
+
+    // Placeholders must be numbered $1..$n without gaps
+    explicit QueryTemplate(Document q) : query(std::move(q)) {
+        std::vector<bool> seen;
+        for (const auto& [key, v] : query) {
+            if (v) collect(*v, seen);
+        }
+        for (size_t i = 0; i < seen.size(); ++i) {
+            if (!seen[i]) throw std::runtime_error("MISSING_PLACEHOLDER $" + std::to_string(i + 1));
+        }
+        params = seen.size();
+    }
+
+    size_t paramCount() const { return params; }
+
+    // Arguments are values: an object with $ keys is refused, operators belong in the template
+    Document bind(const Array& args) const {
+        if (args.size() != params) throw std::runtime_error("PARAM_COUNT (expected " + std::to_string(params) + ")");
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (operatorObject(args[i])) throw std::runtime_error("OPERATOR_PARAM $" + std::to_string(i + 1));
+        }
+
+        Document out;
+        for (const auto& [key, v] : query) out.emplace(key, bind(v, args));
+        return out;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include "document.hpp"
+#include "query_program.hpp"
+#include "result_order.hpp"
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <algorithm>
+#include <unordered_map>
+
+namespace fluxdb {
+
+// Opt-in FIND result cache (CONFIG RESULT_CACHE <mb>): rendered responses keyed by the normalized
+// query + options, LRU under a byte budget. A write drops only the entries whose result it could change
+class ResultCache {
+public:
+    // What a cached result depends on, checked against every write
+    struct Dependency {
+        std::shared_ptr<const QueryProgram> program;
+        std::vector<std::string> fields; // filtered, projected and sorted fields
+        bool wholeDocument = true;       // no projection: any change to a matching doc shows
+        bool anyWrite = false;           // ranked / approximate ($text, $phrase, $near): every write can reorder
+    };
+
+private:
+    struct Entry {
+        std::string key;
+        std::string response;
+        Dependency dep;
+        size_t bytes;
+    };
+
+    const size_t ENTRY_OVERHEAD = 192; // list/map nodes, program, field names (rough)
+
+    mutable std::mutex mtx;
+    std::list<Entry> lru; // front = most recently used
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+    std::atomic<size_t> budget{ 0 };
+    size_t used = 0;
+
+    // bumped by every write: a result computed across a write is not stored (it may be stale)
+    uint64_t writes = 0;
+    uint64_t hits = 0, misses = 0, invalidations = 0, evictions = 0;
+
+    static bool sameValue(const std::shared_ptr<Value>& a, const std::shared_ptr<Value>& b) {
+        if (a == b) return true;
+        if (!a || !b || a->type != b->type) return false;
+        if (ValueLess::getRank(*a) == 3) return a->ToJson() == b->ToJson();
+        return *a == *b;
+    }
+
+    static std::vector<std::string> changedFields(const Document& before, const Document& after) {
+        std::vector<std::string> changed;
+        for (const auto& [key, val] : before) {
+            auto it = after.find(key);
+            if (it == after.end() || !sameValue(val, it->second)) changed.push_back(key);
+        }
+        for (const auto& [key, val] : after) {
+            if (!before.count(key)) changed.push_back(key);
+        }
+        return changed;
+    }
+
+    static bool affects(const Dependency& dep, const Document* before, const Document* after,
+                        const std::vector<std::string>& changed) {
+        if (dep.anyWrite) return true;
+        bool was = before && dep.program->matches(*before);
+        bool is = after && dep.program->matches(*after);
+        if (!was && !is) return false;
+
+        if (before && after) {
+            if (changed.empty()) return false;
+            if (!dep.wholeDocument && std::none_of(changed.begin(), changed.end(), [&](const std::string& f) {
+                    return std::find(dep.fields.begin(), dep.fields.end(), f) != dep.fields.end();
+                })) return false;
+        }
+        return true;
+    }
+
+    void evictTo(size_t limit) {
+        while (used > limit && !lru.empty()) {
+            used -= lru.back().bytes;
+            entries.erase(lru.back().key);
+            lru.pop_back();
+            evictions++;
+        }
+    }
+
+    // Exact and key-order independent (Value::ToJson rounds doubles and follows map order)
+    static void canonical(const Value& v, std::string& out) {
+        switch (v.type) {
+            case Type::Int: out += "i" + std::to_string(v.asInt()); break;
+            case Type::Double: {
+                char buf[32];
+                std::snprintf(buf, sizeof(buf), "d%.17g", v.getNumeric());
+                out += buf;
+                break;
+            }
+            case Type::Bool: out += v.asBool() ? "T" : "F"; break;
+            case Type::String: out += "s" + std::to_string(v.asString().size()) + ":" + v.asString(); break;
+            case Type::Object: canonical(v.asObject(), out); break;
+            case Type::Array:
+                out += "[";
+                for (const auto& item : v.asArray()) {
+                    if (item) canonical(*item, out);
+                    out += ",";
+                }
+                out += "]";
+                break;
+        }
+    }
+
+    static void canonical(const Document& doc, std::string& out) {
+        std::vector<const std::string*> keys;
+        for (const auto& [key, val] : doc) keys.push_back(&key);
+        std::sort(keys.begin(), keys.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+
+        out += "{";
+        for (const std::string* key : keys) {
+            out += std::to_string(key->size()) + ":" + *key + "=";
+            if (const auto& val = doc.at(*key)) canonical(*val, out);
+            out += ",";
+        }
+        out += "}";
+    }
+
+    static void collectFields(const Document& query, Dependency& dep) {
+        for (const auto& [key, constraint] : query) {
+            if (!key.empty() && key[0] == '$') { // $or / $and branches
+                if (constraint && constraint->type == Type::Array) {
+                    for (const auto& branch : constraint->asArray()) {
+                        if (branch && branch->type == Type::Object) collectFields(branch->asObject(), dep);
+                    }
+                }
+                continue;
+            }
+            dep.fields.push_back(key);
+            if (constraint && constraint->type == Type::Object) {
+                for (const char* op : { "$text", "$phrase", "$near" }) {
+                    if (constraint->asObject().count(op)) dep.anyWrite = true;
+                }
+            }
+        }
+    }
+
+public:
+    static std::string makeKey(const Document& query, const std::vector<std::string>& fields,
+                               const ResultOrder& order, size_t skip, size_t limit) {
+        std::string key;
+        canonical(query, key);
+        key += "|f";
+        for (const auto& f : fields) key += std::to_string(f.size()) + ":" + f;
+        key += "|s";
+        for (const auto& k : order.getKeys()) key += std::to_string(k.field.size()) + ":" + k.field + (k.descending ? "-" : "+");
+        key += "|" + std::to_string(skip) + "|" + std::to_string(limit);
+        return key;
+    }
+
+    static Dependency describe(const Document& query, std::shared_ptr<const QueryProgram> program,
+                               const std::vector<std::string>& fields, const ResultOrder& order) {
+        Dependency dep;
+        dep.program = std::move(program);
+        collectFields(query, dep);
+        dep.wholeDocument = fields.empty();
+        dep.fields.insert(dep.fields.end(), fields.begin(), fields.end());
+        for (const auto& k : order.getKeys()) dep.fields.push_back(k.field);
+        return dep;
+    }
+
+    bool enabled() const { return budget.load() > 0; }
+
+    void setBudget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mtx);
+        budget = bytes;
+        evictTo(bytes);
+    }
+
+    // Taken before the result is computed, handed back to put()
+    uint64_t ticket() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return writes;
+    }
+
+    bool get(const std::string& key, std::string& out) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            misses++;
+            return false;
+        }
+        lru.splice(lru.begin(), lru, it->second);
+        out = it->second->response;
+        hits++;
+        return true;
+    }
+
+    void put(const std::string& key, uint64_t ticket, const std::string& response, Dependency dep) {
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t bytes = key.size() * 2 + response.size() + ENTRY_OVERHEAD;
+        if (writes != ticket || bytes > budget) return;
+
+        if (auto it = entries.find(key); it != entries.end()) {
+            used -= it->second->bytes;
+            lru.erase(it->second);
+            entries.erase(it);
+        }
+        lru.push_front({ key, response, std::move(dep), bytes });
+        entries[key] = lru.begin();
+        used += bytes;
+        evictTo(budget);
+    }
+
+    // Called under the collection's write lock, while both versions of the document are readable
+    void onWrite(const Document* before, const Document* after) {
+        std::lock_guard<std::mutex> lock(mtx);
+        writes++;
+        if (lru.empty()) return;
+
+        std::vector<std::string> changed;
+        if (before && after) changed = changedFields(*before, *after);
+
+        for (auto it = lru.begin(); it != lru.end();) {
+            if (!affects(it->dep, before, after, changed)) {
+                ++it;
+                continue;
+            }
+            used -= it->bytes;
+            entries.erase(it->key);
+            it = lru.erase(it);
+            invalidations++;
+        }
+    }
+
+    // FLUSHDB, index changes (access paths decide the order of unsorted results)
+    void invalidateAll() {
+        std::lock_guard<std::mutex> lock(mtx);
+        writes++;
+        invalidations += lru.size();
+        lru.clear();
+        entries.clear();
+        used = 0;
+    }
+
+    std::string toJson() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        uint64_t lookups = hits + misses;
+        char rate[32];
+        std::snprintf(rate, sizeof(rate), "%.4f", lookups ? static_cast<double>(hits) / lookups : 0.0);
+
+        std::string json = "{";
+        json += "\"enabled\": " + std::string(budget > 0 ? "true" : "false") + ", ";
+        json += "\"budget_bytes\": " + std::to_string(budget.load()) + ", ";
+        json += "\"bytes\": " + std::to_string(used) + ", ";
+        json += "\"entries\": " + std::to_string(lru.size()) + ", ";
+        json += "\"hits\": " + std::to_string(hits) + ", ";
+        json += "\"misses\": " + std::to_string(misses) + ", ";
+        json += "\"hit_rate\": " + std::string(rate) + ", ";
+        json += "\"invalidations\": " + std::to_string(invalidations) + ", ";
+        json += "\"evictions\": " + std::to_string(evictions);
+        json += "}";
+        return json;
+    }
+};
+
+}
+
+#endif
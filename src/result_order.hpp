@@ -0,0 +1,147 @@
+#ifndef RESULT_ORDER_HPP
+#define RESULT_ORDER_HPP
+
+#include "document.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+namespace fluxdb {
+
+// FIND {"sort": ...}: ValueLess order on one or more fields. Documents lacking a sort
+// field come last in either direction, ties are broken by id
+class ResultOrder {
+public:
+    struct Key {
+        std::string field;
+        bool descending = false;
+    };
+    using Row = std::vector<std::shared_ptr<Value>>; // one per key, null = field missing
+
+private:
+    std::vector<Key> keys;
+
+    // <0 when a goes first
+    static int compare(const Value* a, const Value* b, bool descending) {
+        if (!a || !b) return (a ? -1 : 0) + (b ? 1 : 0);
+        ValueLess less;
+        int c = less(*a, *b) ? -1 : (less(*b, *a) ? 1 : 0);
+        return descending ? -c : c;
+    }
+
+    static const Value* field(const Document& doc, const std::string& name) {
+        auto it = doc.find(name);
+        return it != doc.end() ? it->second.get() : nullptr;
+    }
+
+public:
+    ResultOrder() = default;
+    explicit ResultOrder(std::vector<Key> k) : keys(std::move(k)) {}
+
+    // {"created_at": -1} or [{"a": 1}, {"b": -1}] (an object has no key order, so one key only)
+    static bool parse(const Value& spec, ResultOrder& order) {
+        std::vector<Key> parsed;
+        auto add = [&](const Document& d) {
+            if (d.size() != 1) return false;
+            const auto& [field, dir] = *d.begin();
+            if (!dir || !dir->isNumber() || dir->getNumeric() == 0) return false;
+            parsed.push_back({ field, dir->getNumeric() < 0 });
+            return true;
+        };
+
+        if (spec.type == Type::Object) {
+            if (!add(spec.asObject())) return false;
+        } else if (spec.type == Type::Array && !spec.asArray().empty()) {
+            for (const auto& k : spec.asArray()) {
+                if (!k || k->type != Type::Object || !add(k->asObject())) return false;
+            }
+        } else return false;
+
+        order = ResultOrder(std::move(parsed));
+        return true;
+    }
+
+    bool empty() const { return keys.empty(); }
+    const std::vector<Key>& getKeys() const { return keys; }
+
+    Row extract(const Document& doc) const {
+        Row row;
+        row.reserve(keys.size());
+        for (const auto& k : keys) {
+            auto it = doc.find(k.field);
+            row.push_back(it != doc.end() ? it->second : nullptr);
+        }
+        return row;
+    }
+
+    bool before(const Row& a, uint64_t idA, const Row& b, uint64_t idB) const {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            int c = compare(a[i].get(), b[i].get(), keys[i].descending);
+            if (c) return c < 0;
+        }
+        return idA < idB;
+    }
+
+    // Same, straight off the document (no Row copy for rows that lose)
+    bool before(const Document& doc, uint64_t id, const Row& b, uint64_t idB) const {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            int c = compare(field(doc, keys[i].field), b[i].get(), keys[i].descending);
+            if (c) return c < 0;
+        }
+        return id < idB;
+    }
+};
+
+// Keeps the first k rows of a ResultOrder: a max-heap whose top is the current worst
+class TopK {
+private:
+    using Entry = std::pair<ResultOrder::Row, uint64_t>;
+
+    const ResultOrder* order;
+    size_t k;
+    std::vector<Entry> heap;
+
+    bool worse(const Entry& a, const Entry& b) const { return order->before(a.first, a.second, b.first, b.second); }
+
+    void push(Entry&& e) {
+        auto cmp = [this](const Entry& a, const Entry& b) { return worse(a, b); };
+        if (heap.size() < k) {
+            heap.push_back(std::move(e));
+            std::push_heap(heap.begin(), heap.end(), cmp);
+        } else if (worse(e, heap.front())) {
+            std::pop_heap(heap.begin(), heap.end(), cmp);
+            heap.back() = std::move(e);
+            std::push_heap(heap.begin(), heap.end(), cmp);
+        }
+    }
+
+public:
+    TopK(const ResultOrder& o, size_t limit) : order(&o), k(limit) {}
+
+    void offer(uint64_t id, const Document& doc) {
+        if (k == 0) return;
+        if (heap.size() >= k && !order->before(doc, id, heap.front().first, heap.front().second)) return;
+        push({ order->extract(doc), id });
+    }
+
+    void merge(TopK&& other) {
+        for (auto& e : other.heap) push(std::move(e));
+        other.heap.clear();
+    }
+
+    // Ids, best first
+    std::vector<uint64_t> take() {
+        std::sort(heap.begin(), heap.end(), [this](const Entry& a, const Entry& b) { return worse(a, b); });
+        std::vector<uint64_t> ids;
+        ids.reserve(heap.size());
+        for (const auto& e : heap) ids.push_back(e.second);
+        heap.clear();
+        return ids;
+    }
+};
+
+}
+
+#endif
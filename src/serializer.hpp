@@ -2,29 +2,90 @@
 #define SERIALIZER_HPP
 
 #include "document.hpp"
+#include "byte_sink.hpp"
 #include <iostream>
 #include <vector>
 #include <cstring> 
 #include <fstream>
+#include <cmath>
+#include <cstdint>
 
 namespace fluxdb {
 
+// Document encodings; files record which one their documents use (snapshot header, segment
+// version, WAL header version)
+constexpr uint32_t ENCODING_V1 = 1; // fixed 8-byte ints, u32 counts, u16 string lengths
+constexpr uint32_t ENCODING_V2 = 2; // varints, short forms for small values
+constexpr uint32_t ENCODING_CURRENT = ENCODING_V2;
+
+// Unsigned LEB128: 7 bits per byte, low group first, high bit set = more follow. Signed values
+// are zig-zag mapped first (0, -1, 1, -2 ... -> 0, 1, 2, 3 ...) so small negatives stay short
+namespace varint {
+
+constexpr size_t MAX_BYTES = 10;
+
+inline uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+template <typename Buffer>
+inline void put(Buffer& out, uint64_t v) {
+    using Byte = typename Buffer::value_type;
+    for (; v >= 0x80; v >>= 7) out.push_back(static_cast<Byte>(v | 0x80));
+    out.push_back(static_cast<Byte>(v));
+}
+
+// false if p[pos..end) is cut short or runs past MAX_BYTES; pos moves past the varint
+inline bool get(const uint8_t* p, size_t end, size_t& pos, uint64_t& v) {
+    v = 0;
+    for (size_t i = 0, shift = 0; i < MAX_BYTES && pos < end; ++i, shift += 7) {
+        uint8_t b = p[pos++];
+        v |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+}
+
+// ENCODING_V2: document = count | { key | value }, array = count | { value }, counts and
+// lengths as varints. A value starts with a tag byte: 0x80-0xFF is an int 0..127 (the low 7
+// bits), 0x40-0x7F a string of up to 63 bytes (length in the low 6 bits), below that a type
+// tag followed by its payload
+namespace tag {
+constexpr uint8_t INT = 0x00;          // zig-zag varint
+constexpr uint8_t DOUBLE = 0x01;       // 8 bytes
+constexpr uint8_t BOOL_FALSE = 0x02;   // no payload
+constexpr uint8_t BOOL_TRUE = 0x03;
+constexpr uint8_t STRING = 0x04;       // varint length | bytes
+constexpr uint8_t OBJECT = 0x05;
+constexpr uint8_t ARRAY = 0x06;
+constexpr uint8_t WHOLE_DOUBLE = 0x07; // a double holding an integer: zig-zag varint
+constexpr uint8_t SHORT_STRING = 0x40;
+constexpr uint8_t SMALL_INT = 0x80;
+}
+
+// Writes ENCODING_V2 (older encodings are only read) straight into a sink: the WAL batch,
+// a snapshot block, a file or a client's output buffer. serialize() is the standalone form,
+// into a buffer of its own that is reused across calls
 class Serializer {
 private:
-    std::vector<uint8_t> buffer;
+    BufferSink buffer;
+    BufferSink* out = &buffer;
+    size_t expected = 64; // running average of encoded document sizes
+
+    static constexpr uint32_t FILE_MAGIC = 0x43445846; // "FXDC", dumpToFile's header
 
 public:
     void writeByte(uint8_t b) {
-        buffer.push_back(b);
+        out->put(b);
     }
 
     void writeBytes(const void* data, size_t size) {
-        const uint8_t* ptr = static_cast<const uint8_t*>(data);
-        buffer.insert(buffer.end(), ptr, ptr + size);
+        out->write(data, size);
     }
 
-    void writeInt64(int64_t v) {
-        writeBytes(&v, sizeof(v));
+    void writeVarint(uint64_t v) {
+        varint::put(out->bytes(), v);
     }
 
     void writeDouble(double v) {
@@ -32,64 +93,105 @@ public:
     }
 
     void writeString(const std::string& s) {
-        uint16_t len = static_cast<uint16_t>(s.size()); // length of the string, max = 65k
-        writeBytes(&len, sizeof(len));
-
-        writeBytes(s.data(), len); // string data
+        writeVarint(s.size());
+        writeBytes(s.data(), s.size());
     }
 
-    void writeArray(const Array& arr) {
-        uint32_t count = static_cast<uint32_t>(arr.size());
-        writeBytes(&count, sizeof(count));
-
-        // no Keys
-        for (const auto& valPtr : arr) {
-            const Value& v = *valPtr;
-            
-            writeByte(static_cast<uint8_t>(v.type));
-
-            switch (v.type) {
-                case Type::Int:    writeInt64(v.asInt()); break;
-                case Type::Double: writeDouble(v.asDouble()); break;
-                case Type::Bool:   writeByte(v.asBool() ? 1 : 0); break;
-                case Type::String: writeString(v.asString()); break;
-                
-                case Type::Object: writeDocumentMap(v.asObject()); break;
-                case Type::Array:  writeArray(v.asArray()); break; // Double Recursion
+    void writeValue(const Value& v) {
+        switch (v.type) {
+            case Type::Int: {
+                int64_t i = v.asInt();
+                if (i >= 0 && i < 0x80) {
+                    writeByte(static_cast<uint8_t>(tag::SMALL_INT | i));
+                } else {
+                    writeByte(tag::INT);
+                    writeVarint(varint::zigzag(i));
+                }
+                break;
+            }
+            case Type::Double: {
+                // integral values round-trip through int64 exactly up to 2^53; -0.0 doesn't
+                double d = v.asDouble();
+                if (d >= -9007199254740992.0 && d <= 9007199254740992.0 && d == static_cast<double>(static_cast<int64_t>(d)) &&
+                    !(d == 0 && std::signbit(d))) {
+                    writeByte(tag::WHOLE_DOUBLE);
+                    writeVarint(varint::zigzag(static_cast<int64_t>(d)));
+                } else {
+                    writeByte(tag::DOUBLE);
+                    writeDouble(d);
+                }
+                break;
             }
+            case Type::Bool:
+                writeByte(v.asBool() ? tag::BOOL_TRUE : tag::BOOL_FALSE);
+                break;
+            case Type::String: {
+                const std::string& s = v.asString();
+                if (s.size() < 0x40) {
+                    writeByte(static_cast<uint8_t>(tag::SHORT_STRING | s.size()));
+                    writeBytes(s.data(), s.size());
+                } else {
+                    writeByte(tag::STRING);
+                    writeString(s);
+                }
+                break;
+            }
+            case Type::Object:
+                writeByte(tag::OBJECT);
+                writeDocumentMap(v.asObject()); // recursive call
+                break;
+            case Type::Array:
+                writeByte(tag::ARRAY);
+                writeArray(v.asArray());
+                break;
         }
     }
 
-    void writeDocumentMap(const Document& doc) {
-        uint32_t count = static_cast<uint32_t>(doc.size());
-        writeBytes(&count, sizeof(count));
+    void writeArray(const Array& arr) {
+        writeVarint(arr.size());
+        for (const auto& valPtr : arr) writeValue(*valPtr); // no Keys
+    }
 
+    void writeDocumentMap(const Document& doc) {
+        writeVarint(doc.size());
         for (const auto& [key, valPtr] : doc) {
-            writeString(key);          
-            
-            const Value& v = *valPtr;
-            writeByte(static_cast<uint8_t>(v.type)); 
-
-            switch (v.type) {
-                case Type::Int:    writeInt64(v.asInt()); break;
-                case Type::Double: writeDouble(v.asDouble()); break;
-                case Type::Bool:   writeByte(v.asBool() ? 1 : 0); break;
-                case Type::String: writeString(v.asString()); break;
-                case Type::Object: 
-                    writeDocumentMap(v.asObject()); // recursive call
-                    break; 
-                case Type::Array:
-                    writeArray(v.asArray()); break;
-            }
+            writeString(key);
+            writeValue(*valPtr);
         }
     }
 
-    std::vector<uint8_t> serialize(const Document& doc) {
-        buffer.clear();
+    // Appends doc to sink
+    void write(BufferSink& sink, const Document& doc) {
+        size_t start = sink.size();
+        struct Target {
+            Serializer& s;
+            ~Target() { s.out = &s.buffer; } // also when an allocation throws mid-document
+        } target{ *this };
+        out = &sink;
         writeDocumentMap(doc);
-        return buffer;
+        expected = (expected * 7 + (sink.size() - start)) / 8;
+    }
+
+    // id | size | doc, the record of snapshots, segments and EXPORT; the size is filled in
+    // once the document is written
+    void writeRecord(BufferSink& sink, uint64_t id, const Document& doc) {
+        varint::put(sink.bytes(), id);
+        BufferSink::LengthMark mark = sink.openLength(expected);
+        write(sink, doc);
+        sink.closeLength(mark);
     }
 
+    // What a document usually takes, for sizing buffers up front
+    size_t expectedSize() const { return expected; }
+
+    // doc alone; valid until the next call
+    const std::vector<char>& serialize(const Document& doc) {
+        buffer.clear();
+        write(buffer, doc);
+        return buffer.bytes();
+    }
+
+    // magic | encoding | document
     void dumpToFile(const std::string& filename) {
         std::ofstream file(filename, std::ios::binary | std::ios::out);
         
@@ -97,33 +199,48 @@ public:
             throw std::runtime_error("Could not open file for writing: " + filename);
         }
 
+        uint32_t magic = FILE_MAGIC, encoding = ENCODING_CURRENT;
+        file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+        file.write(reinterpret_cast<const char*>(&encoding), sizeof(encoding));
         // vector.data() gives us the raw array pointer
-        file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size()); // Convert uint8_t pointer to const char* bcz write() expects char* 
+        file.write(buffer.data(), buffer.size());
         file.close();
         
         std::cout << "[Serializer] Saved " << buffer.size() << " bytes to " << filename << "\n";
     }
+
+    static bool isFileHeader(const std::vector<uint8_t>& buf, uint32_t& encoding) {
+        uint32_t magic;
+        if (buf.size() < 8) return false;
+        std::memcpy(&magic, buf.data(), 4);
+        std::memcpy(&encoding, buf.data() + 4, 4);
+        return magic == FILE_MAGIC && (encoding == ENCODING_V1 || encoding == ENCODING_V2);
+    }
 };
 
 class Deserializer {
 private:
-    const std::vector<uint8_t>& buffer;
+    const uint8_t* buffer;
+    size_t size;
     size_t pos = 0; 
+    uint32_t encoding;
 
 public:
-    Deserializer(const std::vector<uint8_t>& buf) : buffer(buf) {}
+    Deserializer(const std::vector<uint8_t>& buf, uint32_t enc = ENCODING_CURRENT) : buffer(buf.data()), size(buf.size()), encoding(enc) {}
+    // Reads in place, e.g. straight out of a mapped file
+    Deserializer(const uint8_t* data, size_t n, uint32_t enc = ENCODING_CURRENT) : buffer(data), size(n), encoding(enc) {}
 
     uint8_t readByte() {
-        if (pos >= buffer.size()) throw std::runtime_error("Unexpected EOF");
+        if (pos >= size) throw std::runtime_error("Unexpected EOF");
         return buffer[pos++];
     }
 
     // helper to read raw bytes into a variable
     template <typename T>
     T readRaw() {
-        if (pos + sizeof(T) > buffer.size()) throw std::runtime_error("Unexpected EOF");
+        if (pos + sizeof(T) > size) throw std::runtime_error("Unexpected EOF");
         T val;
-        std::memcpy(&val, &buffer[pos], sizeof(T));
+        std::memcpy(&val, buffer + pos, sizeof(T));
         pos += sizeof(T);
         return val;
     }
@@ -131,81 +248,115 @@ public:
     int64_t readInt64() { return readRaw<int64_t>(); }
     double readDouble() { return readRaw<double>(); }
 
-    std::string readString() {
-        // read Length (uint16_t)
-        uint16_t len = readRaw<uint16_t>();
-        
-        // read Chars
-        if (pos + len > buffer.size()) throw std::runtime_error("Unexpected EOF inside string");
-        std::string s(reinterpret_cast<const char*>(&buffer[pos]), len);
+    uint64_t readVarint() {
+        uint64_t v;
+        if (!varint::get(buffer, size, pos, v)) throw std::runtime_error("Bad varint");
+        return v;
+    }
+
+    std::string readBytes(uint64_t len) {
+        if (len > size - pos) throw std::runtime_error("Unexpected EOF inside string");
+        std::string s(reinterpret_cast<const char*>(buffer + pos), len);
         pos += len;
         return s;
     }
 
+    std::string readString() { return readBytes(readVarint()); }
+
+    // Every element takes at least one byte, so a count past the end is corrupt
+    // (and would otherwise reserve gigabytes)
+    uint64_t readCount() {
+        uint64_t count = readVarint();
+        if (count > size - pos) throw std::runtime_error("Element count past end of buffer");
+        return count;
+    }
+
+    std::shared_ptr<Value> readValue() {
+        uint8_t t = readByte();
+        if (t & tag::SMALL_INT) return std::make_shared<Value>(static_cast<int64_t>(t & 0x7F));
+        if (t & tag::SHORT_STRING) return std::make_shared<Value>(readBytes(t & 0x3F));
+        switch (t) {
+            case tag::INT:          return std::make_shared<Value>(varint::unzigzag(readVarint()));
+            case tag::DOUBLE:       return std::make_shared<Value>(readDouble());
+            case tag::BOOL_FALSE:   return std::make_shared<Value>(false);
+            case tag::BOOL_TRUE:    return std::make_shared<Value>(true);
+            case tag::STRING:       return std::make_shared<Value>(readString());
+            case tag::OBJECT:       return std::make_shared<Value>(readDocumentMap());
+            case tag::ARRAY:        return std::make_shared<Value>(readArray());
+            case tag::WHOLE_DOUBLE: return std::make_shared<Value>(static_cast<double>(varint::unzigzag(readVarint())));
+            default:                throw std::runtime_error("Unknown type tag");
+        }
+    }
+
     Array readArray() {
         Array arr;
-        
-        uint32_t count = readRaw<uint32_t>();
+        uint64_t count = readCount();
         arr.reserve(count);
-
-        for (uint32_t i = 0; i < count; ++i) {
-            // no Key to read
-            Type type = static_cast<Type>(readByte());
-
-            switch (type) {
-                case Type::Int:    
-                    arr.push_back(std::make_shared<Value>(readInt64())); break;
-                case Type::Double: 
-                    arr.push_back(std::make_shared<Value>(readDouble())); break;
-                case Type::Bool:   
-                    arr.push_back(std::make_shared<Value>(readByte() != 0)); break;
-                case Type::String: 
-                    arr.push_back(std::make_shared<Value>(readString())); break;
-                
-                case Type::Object:
-                    arr.push_back(std::make_shared<Value>(readDocumentMap())); break;
-                case Type::Array:
-                    arr.push_back(std::make_shared<Value>(readArray())); break;
-            }
-        }
+        for (uint64_t i = 0; i < count; ++i) arr.push_back(readValue()); // no Key to read
         return arr;
     }
 
     Document readDocumentMap() {
         Document doc;
+        uint64_t count = readCount();
+        doc.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            std::string key = readString();
+            doc[key] = readValue();
+        }
+        return doc;
+    }
+
+    // --- ENCODING_V1 (files written before v2) ---
+
+    std::string readStringV1() {
+        // read Length (uint16_t)
+        uint16_t len = readRaw<uint16_t>();
+        return readBytes(len);
+    }
 
+    uint32_t readCountV1() {
         uint32_t count = readRaw<uint32_t>();
+        if (count > size - pos) throw std::runtime_error("Element count past end of buffer");
+        return count;
+    }
+
+    std::shared_ptr<Value> readValueV1() {
+        Type type = static_cast<Type>(readByte());
+        switch (type) {
+            case Type::Int:    return std::make_shared<Value>(readInt64());
+            case Type::Double: return std::make_shared<Value>(readDouble());
+            case Type::Bool:   return std::make_shared<Value>(readByte() != 0);
+            case Type::String: return std::make_shared<Value>(readStringV1());
+            case Type::Object: return std::make_shared<Value>(readDocumentMapV1());
+            case Type::Array:  return std::make_shared<Value>(readArrayV1());
+            default:           throw std::runtime_error("Unknown type tag");
+        }
+    }
 
+    Array readArrayV1() {
+        Array arr;
+        uint32_t count = readCountV1();
+        arr.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) arr.push_back(readValueV1());
+        return arr;
+    }
+
+    Document readDocumentMapV1() {
+        Document doc;
+        uint32_t count = readCountV1();
         for (uint32_t i = 0; i < count; ++i) {
-            std::string key = readString();
-            Type type = static_cast<Type>(readByte());
-
-            switch (type) {
-                case Type::Int:    
-                    doc[key] = std::make_shared<Value>(readInt64()); break;
-                case Type::Double: 
-                    doc[key] = std::make_shared<Value>(readDouble()); break;
-                case Type::Bool:   
-                    doc[key] = std::make_shared<Value>(readByte() != 0); break;
-                case Type::String: 
-                    doc[key] = std::make_shared<Value>(readString()); break;
-                
-                case Type::Object:
-                    // read the inner map, wrap it in a Value, and store it
-                    doc[key] = std::make_shared<Value>(readDocumentMap());
-                    break; 
-                
-                case Type::Array:
-                    doc[key] = std::make_shared<Value>(readArray()); break;
-            }
+            std::string key = readStringV1();
+            doc[key] = readValueV1();
         }
         return doc;
     }
 
     Document deserialize() {
-        return readDocumentMap();
+        return encoding == ENCODING_V1 ? readDocumentMapV1() : readDocumentMap();
     }
     
+    // Files from dumpToFile; ones without its header are headerless ENCODING_V1 dumps
     static Document loadFromFile(const std::string& filename) {
         std::ifstream file(filename, std::ios::binary | std::ios::ate); // open at end to get size
         if (!file.is_open()) throw std::runtime_error("File not found: " + filename);
@@ -218,7 +369,12 @@ public:
              throw std::runtime_error("Read error");
         }
 
-        Deserializer reader(buf);
+        uint32_t encoding = ENCODING_V1;
+        if (Serializer::isFileHeader(buf, encoding)) {
+            Deserializer reader(buf.data() + 8, buf.size() - 8, encoding);
+            return reader.deserialize();
+        }
+        Deserializer reader(buf, ENCODING_V1);
         return reader.deserialize();
     }
 };
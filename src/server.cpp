@@ -49,7 +49,8 @@ void handle_client(SOCKET clientSocket) {
         int bytes = recv(clientSocket, buffer, sizeof(buffer), 0);
         
         if (bytes == SOCKET_ERROR) {
-            if (WSAGetLastError() == WSAETIMEDOUT) continue; 
+            int err = WSAGetLastError();
+            if (err == WSAETIMEDOUT || err == WSAEINTR) continue; // interrupted: not the client's doing
             break;
         }
         if (bytes == 0) break; 
@@ -69,7 +70,7 @@ void handle_client(SOCKET clientSocket) {
             } catch (const std::exception& e) {
                 response = "ERROR INTERNAL\n";
             }
-            send(clientSocket, response.c_str(), response.size(), 0);
+            if (!response.empty()) send(clientSocket, response.c_str(), response.size(), 0); // EXPORT sends its own
         }
     }
     pubsub_ptr->unsubscribeAll(clientSocket);
@@ -0,0 +1,48 @@
+#ifndef SOCKET_SINK_HPP
+#define SOCKET_SINK_HPP
+
+#include "byte_sink.hpp"
+#include <winsock2.h>
+
+namespace fluxdb {
+
+// Output buffer of a client connection: binary responses are encoded into it and sent in
+// flush_at sized pieces (checked between records), so a large response never sits in memory
+// whole. After a failed send the rest is dropped, failed() tells the caller to stop
+class SocketSink : public BufferSink {
+private:
+    SOCKET socket;
+    size_t flush_at;
+    bool broken = false;
+
+public:
+    explicit SocketSink(SOCKET s, size_t flushAt = 64 * 1024) : socket(s), flush_at(flushAt) {
+        reserve(flushAt);
+    }
+
+    void flushIfFull() {
+        if (size() >= flush_at) flush();
+    }
+
+    bool flush() {
+        const char* p = data();
+        size_t left = broken ? 0 : size();
+        while (left > 0) {
+            int n = send(socket, p, static_cast<int>(std::min<size_t>(left, 1 << 30)), 0);
+            if (n <= 0) {
+                broken = true;
+                break;
+            }
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        clear();
+        return !broken;
+    }
+
+    bool failed() const { return broken; }
+};
+
+}
+
+#endif
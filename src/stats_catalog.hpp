@@ -0,0 +1,324 @@
+#ifndef STATS_CATALOG_HPP
+#define STATS_CATALOG_HPP
+
+#include "document.hpp"
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <array>
+#include <random>
+#include <algorithm>
+#include <optional>
+#include <cmath>
+
+namespace fluxdb {
+
+// HyperLogLog distinct counter, 2^10 registers (~3% error). Insert only: deletes don't shrink it
+class HyperLogLog {
+private:
+    static constexpr int P = 10;
+    static constexpr size_t M = size_t(1) << P;
+    std::array<uint8_t, M> registers{};
+
+    static uint64_t mix(uint64_t x) { // splitmix64 finalizer, ValueHasher alone is too weak
+        x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+public:
+    void add(const Value& v) {
+        uint64_t h = mix(ValueHasher{}(v));
+        size_t idx = h >> (64 - P);
+        uint64_t rest = (h << P) | (uint64_t(1) << (P - 1)); // guard bit caps the rank
+        uint8_t rank = 1;
+        while (!(rest & (uint64_t(1) << 63))) { rank++; rest <<= 1; }
+        registers[idx] = std::max(registers[idx], rank);
+    }
+
+    uint64_t estimate() const {
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t r : registers) {
+            sum += std::ldexp(1.0, -r);
+            if (r == 0) zeros++;
+        }
+        double m = static_cast<double>(M);
+        double e = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+        if (e <= 2.5 * m && zeros > 0) e = m * std::log(m / zeros); // linear counting for small sets
+        return static_cast<uint64_t>(e + 0.5);
+    }
+
+    void merge(const HyperLogLog& other) {
+        for (size_t i = 0; i < M; ++i) registers[i] = std::max(registers[i], other.registers[i]);
+    }
+
+    void clear() { registers.fill(0); }
+};
+
+struct FieldStats {
+    uint64_t present = 0;                  // docs carrying the field
+    std::array<uint64_t, 6> type_counts{}; // indexed by Type
+    HyperLogLog distinct;
+    std::optional<Value> min, max;
+    bool bounds_stale = false;             // an extreme was deleted
+
+    // reservoir sample (Algorithm R) feeding the histogram
+    std::vector<std::pair<uint64_t, Value>> sample;
+    uint64_t sampled_seen = 0;
+
+    std::vector<Value> histogram;          // equi-depth bucket boundaries
+    uint64_t changes_since_refresh = 0;
+};
+
+// Per-field statistics, maintained incrementally by StorageEngine on every write
+class StatsCatalog {
+private:
+    std::unordered_map<std::string, FieldStats> fields;
+    std::mt19937_64 rng{ 0x5eed };
+
+    static constexpr size_t SAMPLE_SIZE = 512;
+    static constexpr size_t BUCKETS = 16;
+
+    static bool isScalar(const Value& v) {
+        return v.isNumber() || v.type == Type::Bool || v.type == Type::String;
+    }
+
+    static bool same(const Value& a, const Value& b) {
+        ValueLess less;
+        return !less(a, b) && !less(b, a);
+    }
+
+    void refresh(FieldStats& fs) {
+        std::vector<Value> values;
+        values.reserve(fs.sample.size());
+        for (const auto& [id, v] : fs.sample) values.push_back(v);
+        std::sort(values.begin(), values.end(), ValueLess());
+
+        fs.histogram.clear();
+        if (!values.empty()) {
+            size_t buckets = std::min(BUCKETS, values.size());
+            for (size_t b = 1; b <= buckets; ++b) {
+                fs.histogram.push_back(values[(b * values.size()) / buckets - 1]);
+            }
+            if (fs.bounds_stale) { // best effort from the sample, StorageEngine fixes it from a sorted index
+                fs.min = values.front();
+                fs.max = values.back();
+            }
+        }
+        if (values.empty() && fs.bounds_stale) {
+            fs.min.reset();
+            fs.max.reset();
+        }
+        fs.changes_since_refresh = 0;
+    }
+
+    void maybeRefresh(FieldStats& fs) {
+        // re-bucket after ~10% churn
+        if (fs.changes_since_refresh >= std::max<uint64_t>(1, fs.present / 10)) refresh(fs);
+    }
+
+public:
+    void addDocument(uint64_t docId, const Document& doc) {
+        for (const auto& [key, valPtr] : doc) {
+            if (!valPtr) continue;
+            const Value& v = *valPtr;
+            FieldStats& fs = fields[key];
+
+            fs.present++;
+            fs.type_counts[static_cast<size_t>(v.type)]++;
+            fs.changes_since_refresh++;
+
+            if (isScalar(v)) {
+                fs.distinct.add(v);
+                if (!fs.min || v < *fs.min) fs.min = v;
+                if (!fs.max || v > *fs.max) fs.max = v;
+
+                fs.sampled_seen++;
+                if (fs.sample.size() < SAMPLE_SIZE) {
+                    fs.sample.emplace_back(docId, v);
+                } else {
+                    uint64_t slot = rng() % fs.sampled_seen;
+                    if (slot < SAMPLE_SIZE) fs.sample[slot] = { docId, v };
+                }
+            }
+            maybeRefresh(fs);
+        }
+    }
+
+    void removeDocument(uint64_t docId, const Document& doc) {
+        for (const auto& [key, valPtr] : doc) {
+            if (!valPtr) continue;
+            auto it = fields.find(key);
+            if (it == fields.end()) continue;
+
+            const Value& v = *valPtr;
+            FieldStats& fs = it->second;
+
+            if (fs.present > 0) fs.present--;
+            auto& tc = fs.type_counts[static_cast<size_t>(v.type)];
+            if (tc > 0) tc--;
+            fs.changes_since_refresh++;
+
+            bool extreme = false;
+            if (isScalar(v)) {
+                extreme = (fs.min && same(v, *fs.min)) || (fs.max && same(v, *fs.max));
+                if (extreme) fs.bounds_stale = true;
+
+                auto sit = std::find_if(fs.sample.begin(), fs.sample.end(), [&](const auto& e) { return e.first == docId; });
+                if (sit != fs.sample.end()) {
+                    *sit = std::move(fs.sample.back());
+                    fs.sample.pop_back();
+                }
+                if (fs.sampled_seen > 0) fs.sampled_seen--;
+            }
+
+            if (fs.present == 0) {
+                fields.erase(it);
+                continue;
+            }
+            if (extreme) refresh(fs); // re-estimate the bounds right away
+            else maybeRefresh(fs);
+        }
+    }
+
+    void clear() { fields.clear(); }
+
+    // Folds in a catalog built over other documents (parallel snapshot load). Counters add up,
+    // the two reservoirs are drawn from in proportion to what each has seen
+    void merge(StatsCatalog&& other) {
+        for (auto& [name, from] : other.fields) {
+            auto [it, fresh] = fields.try_emplace(name, std::move(from));
+            if (fresh) continue;
+            FieldStats& fs = it->second;
+
+            fs.present += from.present;
+            for (size_t t = 0; t < fs.type_counts.size(); ++t) fs.type_counts[t] += from.type_counts[t];
+            fs.distinct.merge(from.distinct);
+            if (from.min && (!fs.min || *from.min < *fs.min)) fs.min = from.min;
+            if (from.max && (!fs.max || *from.max > *fs.max)) fs.max = from.max;
+            fs.bounds_stale = fs.bounds_stale || from.bounds_stale;
+
+            auto a = std::move(fs.sample), b = std::move(from.sample);
+            std::shuffle(a.begin(), a.end(), rng);
+            std::shuffle(b.begin(), b.end(), rng);
+            uint64_t na = fs.sampled_seen, nb = from.sampled_seen;
+            size_t ia = 0, ib = 0;
+            fs.sample.clear();
+            while (fs.sample.size() < SAMPLE_SIZE && (ia < a.size() || ib < b.size())) {
+                bool takeA = ib == b.size() || (ia < a.size() && rng() % (na + nb) < na);
+                if (takeA) {
+                    fs.sample.push_back(std::move(a[ia++]));
+                    na--;
+                } else {
+                    fs.sample.push_back(std::move(b[ib++]));
+                    nb--;
+                }
+            }
+            fs.sampled_seen += from.sampled_seen;
+        }
+        for (auto& [name, fs] : fields) refresh(fs);
+    }
+
+    // Fields whose min/max must be recomputed (StorageEngine asks the sorted index)
+    std::vector<std::string> staleBounds() const {
+        std::vector<std::string> out;
+        for (const auto& [name, fs] : fields) {
+            if (fs.bounds_stale) out.push_back(name);
+        }
+        return out;
+    }
+
+    void setBounds(const std::string& field, const Value& min, const Value& max) {
+        auto it = fields.find(field);
+        if (it == fields.end()) return;
+        it->second.min = min;
+        it->second.max = max;
+        it->second.bounds_stale = false;
+    }
+
+    const FieldStats* get(const std::string& field) const {
+        auto it = fields.find(field);
+        return it != fields.end() ? &it->second : nullptr;
+    }
+
+    std::vector<std::string> fieldNames() const {
+        std::vector<std::string> names;
+        for (const auto& [name, fs] : fields) names.push_back(name);
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    // --- Planner estimates (rows) ---
+
+    double estimateEquality(const std::string& field) const {
+        const FieldStats* fs = get(field);
+        if (!fs || fs->present == 0) return 0;
+        uint64_t ndv = std::max<uint64_t>(1, fs->distinct.estimate());
+        return static_cast<double>(fs->present) / static_cast<double>(ndv);
+    }
+
+    // Fraction of histogram buckets overlapping [lower, upper], scaled by presence
+    double estimateRange(const std::string& field, const std::optional<Value>& lower, const std::optional<Value>& upper) const {
+        const FieldStats* fs = get(field);
+        if (!fs || fs->present == 0) return 0;
+        if (fs->histogram.empty()) return static_cast<double>(fs->present);
+
+        size_t hit = 0;
+        const Value* prev = nullptr;
+        for (const Value& boundary : fs->histogram) {
+            // bucket = (prev, boundary]
+            bool aboveLower = !lower || !(boundary < *lower);
+            bool belowUpper = !upper || !prev || *prev < *upper;
+            if (aboveLower && belowUpper) hit++;
+            prev = &boundary;
+        }
+        return static_cast<double>(fs->present) * hit / fs->histogram.size();
+    }
+
+    // {"field": {"present": .., "absent_ratio": .., "distinct": .., "types": {..}, "min": .., "max": .., "histogram": [..]}}
+    std::string toJson(uint64_t totalDocs) const {
+        static const char* TYPE_NAMES[] = { "int", "double", "bool", "string", "object", "array" };
+
+        std::string json = "{";
+        auto names = fieldNames();
+        for (size_t i = 0; i < names.size(); ++i) {
+            const FieldStats& fs = fields.at(names[i]);
+            double absent = totalDocs ? 1.0 - static_cast<double>(fs.present) / totalDocs : 0.0;
+
+            json += "\"" + names[i] + "\": {";
+            json += "\"present\": " + std::to_string(fs.present) + ", ";
+            json += "\"absent_ratio\": " + Value(absent).ToJson() + ", ";
+            json += "\"distinct\": " + std::to_string(fs.distinct.estimate()) + ", ";
+
+            json += "\"types\": {";
+            bool first = true;
+            for (size_t t = 0; t < fs.type_counts.size(); ++t) {
+                if (!fs.type_counts[t]) continue;
+                if (!first) json += ", ";
+                json += "\"" + std::string(TYPE_NAMES[t]) + "\": " + std::to_string(fs.type_counts[t]);
+                first = false;
+            }
+            json += "}";
+
+            if (fs.min) json += ", \"min\": " + fs.min->ToJson();
+            if (fs.max) json += ", \"max\": " + fs.max->ToJson();
+            if (fs.bounds_stale) json += ", \"bounds_estimated\": true";
+
+            json += ", \"histogram\": [";
+            for (size_t b = 0; b < fs.histogram.size(); ++b) {
+                json += fs.histogram[b].ToJson();
+                if (b < fs.histogram.size() - 1) json += ", ";
+            }
+            json += "]}";
+            if (i < names.size() - 1) json += ", ";
+        }
+        json += "}";
+        return json;
+    }
+};
+
+}
+
+#endif
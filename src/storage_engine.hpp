@@ -3,12 +3,20 @@
 
 #include "document.hpp"
 #include "index_manager.hpp"
+#include "stats_catalog.hpp"
+#include "document_store.hpp"
+#include "thread_pool.hpp"
 #include <unordered_map>
 #include <vector>
 #include <string>
 #include <cmath>
 #include <iostream>
 #include <set>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
 
 namespace fluxdb {
 
@@ -16,15 +24,33 @@ using Id = std::uint64_t;
 
 class StorageEngine {
 private:
-    std::unordered_map<Id, Document> db;
+    DocumentStore db;
     IndexManager indexer;
+    StatsCatalog stats;
     Id next_id = 1;
+    size_t memory_budget = 0; // paged mode, 0 = off
+
+    // findCovered walks a projected field's index only when the matches are at least
+    // 1/COVER_WALK_RATIO of its entries
+    static constexpr size_t COVER_WALK_RATIO = 8;
+
+    // planCandidates stops intersecting once the candidates are fewer than 1/INTERSECT_RATIO
+    // of the next lookup's estimated rows: re-checking them is cheaper than fetching those ids
+    static constexpr double INTERSECT_RATIO = 4;
 
     // Adaptive State
     bool adaptive_mode = false;
     std::unordered_map<std::string, int> miss_counter;
     std::unordered_map<std::string, bool> needs_sorted_index;
 
+    // a deleted min/max is exact again when a sorted index can tell us
+    void fixStaleBounds() {
+        for (const auto& field : stats.staleBounds()) {
+            Value min(0), max(0);
+            if (indexer.sortedBounds(field, min, max)) stats.setBounds(field, min, max);
+        }
+    }
+
     int getDynamicThreshold() {
         size_t count = db.size();
         if (count < 100) return 2;
@@ -32,20 +58,49 @@ private:
     }
 
 public:
-    // --- CRUD --- no locks
+    // --- CRUD --- no locks. In paged mode every write ends with a trim(), the documents it
+    // handed out are not used past it
     
     const Document* get(Id id) const {
-        auto it = db.find(id);
-        if (it != db.end()) return &it->second;
-        return nullptr;
+        return db.find(id);
+    }
+
+    // Under a shared lock: an evicted page is kept alive by hold instead of the store
+    const Document* get(Id id, DocumentStore::Hold& hold) const {
+        return db.find(id, hold);
     }
 
     void insert(Id id, const Document& doc) {
         indexer.addDocument(id, doc);
+        stats.addDocument(id, doc);
         db.emplace(id, doc);
         if (id >= next_id) next_id = id + 1;
+        db.trim();
     }
     
+    void insert(Id id, Document&& doc) {
+        indexer.addDocument(id, doc);
+        stats.addDocument(id, doc);
+        db.emplace(id, std::move(doc));
+        if (id >= next_id) next_id = id + 1;
+        db.trim();
+    }
+
+    // Bulk load of new ids: every index takes the whole batch in one pass
+    void insertMany(std::vector<std::pair<Id, Document>>&& batch) {
+        std::vector<std::pair<Id, const Document*>> refs;
+        refs.reserve(batch.size());
+        for (const auto& [id, doc] : batch) refs.emplace_back(id, &doc);
+        indexer.addDocuments(refs);
+
+        for (auto& [id, doc] : batch) {
+            stats.addDocument(id, doc);
+            db.emplace(id, std::move(doc));
+            if (id >= next_id) next_id = id + 1;
+        }
+        db.trim();
+    }
+
     // For auto-increment
     Id insert(const Document& doc) {
         Id id = next_id++;
@@ -54,27 +109,150 @@ public:
     }
 
     bool update(Id id, const Document& doc) {
-        auto it = db.find(id);
-        if (it == db.end()) return false;
+        Document* current = db.find(id);
+        if (!current) return false;
         
-        indexer.removeDocument(id, it->second);
-        it->second = doc;
+        indexer.removeDocument(id, *current);
+        stats.removeDocument(id, *current);
+        *current = doc;
         indexer.addDocument(id, doc);
+        stats.addDocument(id, doc);
+        fixStaleBounds();
+        db.trim();
         return true;
     }
 
+    // Ids must exist and be unique within the batch; stale bounds are fixed once at the end
+    void updateMany(std::vector<std::pair<Id, Document>>&& batch) {
+        std::vector<std::pair<Id, const Document*>> refs;
+        refs.reserve(batch.size());
+        for (auto& [id, doc] : batch) {
+            Document* current = db.find(id);
+            indexer.removeDocument(id, *current);
+            stats.removeDocument(id, *current);
+            *current = std::move(doc);
+            stats.addDocument(id, *current);
+            refs.emplace_back(id, current);
+        }
+        indexer.addDocuments(refs);
+        fixStaleBounds();
+        db.trim();
+    }
+
     bool remove(Id id) {
-        auto it = db.find(id);
-        if (it == db.end()) return false;
+        const Document* current = get(id);
+        if (!current) return false;
         
-        indexer.removeDocument(id, it->second);
-        db.erase(it);
+        indexer.removeDocument(id, *current);
+        stats.removeDocument(id, *current);
+        db.erase(id);
+        fixStaleBounds();
+        db.trim();
         return true;
     }
 
+    // --- WAL replay --- indexes stay current, statistics wait for rebuildStats(): a replayed
+    // update would otherwise re-bucket the field's sample every time it drops a min/max
+    void replayPut(Id id, Document&& doc) {
+        if (Document* current = db.find(id)) {
+            indexer.removeDocument(id, *current);
+            *current = std::move(doc);
+            indexer.addDocument(id, *current);
+        } else {
+            indexer.addDocument(id, doc);
+            db.emplace(id, std::move(doc));
+        }
+        if (id >= next_id) next_id = id + 1;
+        db.trim();
+    }
+
+    void replayRemove(Id id) {
+        const Document* current = get(id);
+        if (!current) return;
+        indexer.removeDocument(id, *current);
+        db.erase(id);
+        db.trim();
+    }
+
+    void rebuildStats() {
+        stats.clear();
+        for (auto it = db.begin(); it != db.end(); ++it) stats.addDocument(it->first, it->second);
+        fixStaleBounds();
+    }
+
+    // --- Snapshot load --- fill(block, put) runs for every block on the pool; put(id, doc) may
+    // only be given ids of the block's own pages (ids below maxId), so threads never share a
+    // page. Each thread keeps its own statistics, merged at the end. Indexes come afterwards
+    // through createIndexes(). A paged store takes the newest blocks first: they fill the
+    // budget, older pages go to the page file as they complete
+    template <typename Fill>
+    void bulkLoad(Id maxId, size_t blocks, Fill&& fill) {
+        clear();
+        db.prepareLoad(maxId);
+
+        ThreadPool& pool = ThreadPool::instance();
+        std::vector<StatsCatalog> partial(pool.size());
+        std::atomic<size_t> next{ 0 };
+        std::exception_ptr error;
+        std::mutex error_lock;
+
+        bool newestFirst = db.paged();
+        pool.run(blocks, [&](size_t slot) {
+            const Id NONE = ~Id(0);
+            Id open = NONE; // page being filled
+            auto put = [&](Id id, Document&& doc) {
+                if (DocumentStore::pageStart(id) != open) {
+                    if (open != NONE) db.loaded(open);
+                    open = DocumentStore::pageStart(id);
+                }
+                partial[slot].addDocument(id, doc);
+                db.load(id, std::move(doc));
+            };
+            for (size_t i; (i = next++) < blocks;) {
+                try {
+                    fill(newestFirst ? blocks - 1 - i : i, put);
+                    if (open != NONE) db.loaded(open);
+                    open = NONE;
+                } catch (...) {
+                    std::lock_guard<std::mutex> lk(error_lock);
+                    if (!error) error = std::current_exception();
+                    next = blocks;
+                }
+            }
+        });
+
+        db.finishLoad();
+        if (error) std::rethrow_exception(error);
+        for (auto& p : partial) stats.merge(std::move(p));
+        next_id = std::max(next_id, maxId);
+    }
+
+    // Several indexes over the loaded documents, one field per pool thread. Only the indexes
+    // built here are filled: one that exists already (or a loaded graph) holds the docs
+    void createIndexes(const std::vector<IndexDef>& defs) {
+        std::vector<std::pair<std::string, unsigned>> fields; // field -> mask of new index types
+        for (const auto& def : defs) {
+            if (!indexer.createIndex(def.field, def.type, def.options)) continue;
+            auto it = std::find_if(fields.begin(), fields.end(), [&](const auto& f) { return f.first == def.field; });
+            if (it == fields.end()) fields.emplace_back(def.field, 1u << def.type);
+            else it->second |= 1u << def.type;
+        }
+        if (fields.empty() || db.empty()) return;
+
+        // a paged store is indexed a quarter of its budget at a time
+        db.forEachChunk(memory_budget / 4, [&](const std::vector<std::pair<Id, const Document*>>& refs) {
+            std::atomic<size_t> next{ 0 };
+            ThreadPool::instance().run(fields.size(), [&](size_t) {
+                for (size_t f; (f = next++) < fields.size();) indexer.addField(fields[f].first, refs, fields[f].second);
+            });
+        });
+        db.trim();
+    }
+
     void clear() {
         db.clear();
         indexer.clear();
+        stats.clear();
         next_id = 1;
     }
     
@@ -86,15 +264,56 @@ public:
     auto begin() const { return db.begin(); }
     auto end() const { return db.end(); }
 
-    // --- SEARCH & INDEXING ---
+    // What a checkpoint writes. Taking it costs O(pages), not O(docs): the store's pages are
+    // shared copy-on-write, vector graphs are copied
+    struct Frozen {
+        DocumentStore docs;
+        Id next_id;
+        std::vector<IndexDef> indexes;
+        std::unordered_map<std::string, HnswIndex> graphs;
+    };
+
+    Frozen freeze() const {
+        Frozen state{ db, next_id, indexer.getDefinitions(), {} };
+        for (const auto& def : state.indexes) {
+            if (def.type != 4) continue;
+            if (const HnswIndex* graph = indexer.getVectorIndex(def.field)) state.graphs.emplace(def.field, *graph);
+        }
+        return state;
+    }
 
-    void createIndex(const std::string& field, int type) {
-        indexer.createIndex(field, type);
-        // backfill
-        for (const auto& [id, doc] : db) {
-            auto it = doc.find(field);
-            if (it != doc.end()) indexer.addToIndex(field, id, *it->second);
+    // Incremental checkpoints: the store tracks what changed since the last one
+    void clearDirty() { db.clearDirty(); }
+    void markAllDirty() { db.markAllDirty(); }
+
+    // --- PAGED MODE --- about `bytes` of documents stay in memory, the rest in a page file at
+    // pagePath (0 = everything in memory). False if the page file can't be created
+    bool setMemoryBudget(const std::string& pagePath, size_t bytes) {
+        if (bytes == 0) {
+            db.setPaging(nullptr, 0);
+            memory_budget = 0;
+            return true;
         }
+        std::shared_ptr<PageFile> file = db.paged() ? db.pageFile() : PageFile::open(pagePath);
+        if (!file) return false;
+        db.setPaging(std::move(file), bytes);
+        memory_budget = bytes;
+        db.trim();
+        return true;
+    }
+
+    size_t getMemoryBudget() const { return memory_budget; }
+    bool wantsTrim() const { return db.wantsTrim(); }
+    void trim() { db.trim(); }
+    std::string pagingJson() const { return db.pagingJson(); }
+
+    // Morsel access for parallel scans
+    const DocumentStore& documents() const { return db; }
+
+    // --- SEARCH & INDEXING ---
+
+    void createIndex(const std::string& field, int type, const Document& options = {}) {
+        createIndexes({ { field, type, options } });
     }
     
     std::vector<Id> find(const std::string& field, const Value& val) {
@@ -105,10 +324,329 @@ public:
         return indexer.searchSorted(field, min, max);
     }
     
+    std::vector<std::pair<Id, double>> searchText(const std::string& field, const std::string& query, bool phrase) const {
+        return indexer.searchText(field, query, phrase);
+    }
+
+    // false when the field has no sorted index
+    bool findPrefix(const std::string& field, const std::string& prefix, std::vector<Id>& out) const {
+        if (!indexer.hasSortedIndex(field)) return false;
+        out = indexer.searchPrefix(field, prefix);
+        return true;
+    }
+
+    bool findTrigrams(const std::string& field, const std::vector<std::string>& runs, std::vector<Id>& out) const {
+        return indexer.searchTrigrams(field, runs, out);
+    }
+
+    bool findNearest(const std::string& field, const Value& query, size_t k, size_t ef,
+                     std::vector<std::pair<Id, float>>& out) const {
+        return indexer.searchNearest(field, query, k, ef, out);
+    }
+
+    template <typename Fn>
+    bool forEachSortedRun(const std::string& field, bool descending, Fn&& fn) const {
+        return indexer.forEachSortedRun(field, descending, std::forward<Fn>(fn));
+    }
+
+    const std::vector<IndexDef>& getIndexDefinitions() const {
+        return indexer.getDefinitions();
+    }
+
+    const HnswIndex* getVectorIndex(const std::string& field) const {
+        return indexer.getVectorIndex(field);
+    }
+
+    bool loadVectorIndex(const std::string& field, const Document& options, std::istream& in) {
+        return indexer.loadVectorIndex(field, options, in);
+    }
+
     bool hasIndex(const std::string& field) const {
         return indexer.hasIndex(field);
     }
 
+    bool hasTextIndex(const std::string& field) const {
+        return indexer.hasTextIndex(field);
+    }
+
+    bool hasSortedIndex(const std::string& field) const {
+        return indexer.hasSortedIndex(field);
+    }
+
+    bool hasTrigramIndex(const std::string& field) const {
+        return indexer.hasTrigramIndex(field);
+    }
+
+    // --- COVERED QUERIES ---
+
+    // Turns {"$gt":..,"$lte":..} into scan bounds, false if an operator can't be served by a sorted index
+    static bool extractRange(const Document& ops, RangeBounds& bounds) {
+        ValueLess less;
+        for (const auto& [op, crit] : ops) {
+            if (!crit) continue;
+            const Value& v = *crit;
+
+            if (op == "$gt" || op == "$gte") {
+                bool incl = (op == "$gte");
+                if (!bounds.lower || less(*bounds.lower, v) || (!less(v, *bounds.lower) && !incl)) {
+                    bounds.lower = v;
+                    bounds.lowerInclusive = incl;
+                }
+            }
+            else if (op == "$lt" || op == "$lte") {
+                bool incl = (op == "$lte");
+                if (!bounds.upper || less(v, *bounds.upper) || (!less(*bounds.upper, v) && !incl)) {
+                    bounds.upper = v;
+                    bounds.upperInclusive = incl;
+                }
+            }
+            else return false;
+        }
+        return true;
+    }
+
+    // Answers query + projection from the indexes alone (db is never touched).
+    // Returns false when a filtered or projected field is not covered by an index.
+    bool findCovered(const Document& query, const std::vector<std::string>& fields,
+                     std::vector<std::pair<Id, Document>>& out) const {
+        if (fields.empty()) return false;
+        for (const auto& f : fields) {
+            if (!indexer.hasIndex(f)) return false;
+        }
+
+        std::vector<Id> ids;
+        bool first = true;
+
+        for (const auto& [field, constraint] : query) {
+            if (!constraint) continue;
+            std::vector<Id> hits;
+
+            if (constraint->type != Type::Object) {
+                if (indexer.hasHashIndex(field)) {
+                    hits = indexer.searchHash(field, *constraint);
+                } else if (indexer.hasSortedIndex(field)) {
+                    RangeBounds exact;
+                    exact.lower = *constraint;
+                    exact.upper = *constraint;
+                    hits = indexer.searchRange(field, exact);
+                } else return false;
+            } else {
+                RangeBounds bounds;
+                if (!indexer.hasSortedIndex(field) || !extractRange(constraint->asObject(), bounds)) return false;
+                hits = indexer.searchRange(field, bounds);
+            }
+
+            std::sort(hits.begin(), hits.end());
+            hits.erase(std::unique(hits.begin(), hits.end()), hits.end()); // rows[id] is moved out once
+            if (first) {
+                ids = std::move(hits);
+                first = false;
+            } else {
+                std::vector<Id> both;
+                std::set_intersection(ids.begin(), ids.end(), hits.begin(), hits.end(), std::back_inserter(both));
+                ids = std::move(both);
+            }
+        }
+
+        if (first) return false; // empty filter = full scan, not worth walking every index
+
+        // a projected field that isn't an equality filter costs a walk of its whole index; for
+        // a handful of matches fetching the documents is cheaper
+        for (const auto& f : fields) {
+            auto q = query.find(f);
+            bool equality = q != query.end() && q->second && q->second->type != Type::Object;
+            if (!equality && ids.size() * COVER_WALK_RATIO < indexer.entryCount(f)) return false;
+        }
+
+        std::unordered_map<Id, Document> rows;
+        rows.reserve(ids.size());
+        for (Id id : ids) rows[id];
+
+        for (const auto& f : fields) {
+            auto q = query.find(f);
+            if (q != query.end() && q->second && q->second->type != Type::Object) {
+                // equality filter: the value is the constraint itself
+                for (auto& [id, row] : rows) row[f] = std::make_shared<Value>(*q->second);
+                continue;
+            }
+            indexer.forEachEntry(f, [&](const Value& val, uint64_t docId) {
+                auto r = rows.find(docId);
+                if (r != rows.end()) r->second[f] = std::make_shared<Value>(val);
+            });
+        }
+
+        out.reserve(out.size() + ids.size());
+        for (Id id : ids) out.emplace_back(id, std::move(rows[id]));
+        return true;
+    }
+
+    // --- INDEX PLANNING ---
+
+    // Equality through whichever point index the field has; false when it has none
+    bool lookupEqual(const std::string& field, const Value& val, std::vector<Id>& out) const {
+        std::vector<Id> hits;
+        if (indexer.hasHashIndex(field)) {
+            hits = indexer.searchHash(field, val);
+        } else if (indexer.hasSortedIndex(field)) {
+            RangeBounds exact;
+            exact.lower = val;
+            exact.upper = val;
+            hits = indexer.searchRange(field, exact);
+        } else return false;
+        out.insert(out.end(), hits.begin(), hits.end());
+        return true;
+    }
+
+    // Candidate ids (sorted, a superset: callers re-check every doc) from hash/sorted indexes.
+    // Equality and $in are (unions of) point lookups, ranges are index scans, $or is a union
+    // over its branches and $and/top-level keys intersect. Top-level lookups run in order of
+    // the stats catalog's row estimates, most selective first, and the larger ones are skipped
+    // once few candidates are left. Returns false when the query has nothing indexable
+    bool planCandidates(const Document& query, std::vector<Id>& out) const {
+        std::vector<Id> ids;
+        bool narrowed = false;
+        auto narrow = [&](std::vector<Id>& hits) {
+            std::sort(hits.begin(), hits.end());
+            hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+            if (!narrowed) {
+                ids = std::move(hits);
+                narrowed = true;
+            } else {
+                std::vector<Id> both;
+                std::set_intersection(ids.begin(), ids.end(), hits.begin(), hits.end(), std::back_inserter(both));
+                ids = std::move(both);
+            }
+        };
+
+        struct Access {
+            double rows; // estimated
+            std::string field;
+            std::vector<const Value*> keys; // equality / $in; none = the range
+            RangeBounds range;
+        };
+        std::vector<Access> accesses;
+
+        for (const auto& [field, constraint] : query) {
+            if (!constraint) continue;
+
+            if (field == "$or" || field == "$and") {
+                if (constraint->type != Type::Array) continue;
+                bool all = !constraint->asArray().empty();
+                std::vector<Id> merged;
+                for (const auto& branch : constraint->asArray()) {
+                    std::vector<Id> hits;
+                    if (!branch || branch->type != Type::Object || !planCandidates(branch->asObject(), hits)) {
+                        all = false;
+                        continue;
+                    }
+                    if (field == "$and") narrow(hits);
+                    else merged.insert(merged.end(), hits.begin(), hits.end());
+                }
+                if (field == "$or" && all) narrow(merged); // one unindexed branch = full scan
+                continue;
+            }
+
+            bool pointIndex = indexer.hasHashIndex(field) || indexer.hasSortedIndex(field);
+            if (constraint->type != Type::Object) {
+                if (pointIndex) accesses.push_back({ stats.estimateEquality(field), field, { constraint.get() }, {} });
+                continue;
+            }
+
+            const Document& ops = constraint->asObject();
+            auto in = ops.find("$in");
+            if (pointIndex && in != ops.end() && in->second && in->second->type == Type::Array) {
+                Access access{ 0, field, {}, {} };
+                for (const auto& e : in->second->asArray()) {
+                    if (e) access.keys.push_back(e.get());
+                }
+                access.rows = stats.estimateEquality(field) * static_cast<double>(access.keys.size());
+                if (access.keys.empty()) { // $in [] matches nothing
+                    std::vector<Id> none;
+                    narrow(none);
+                } else {
+                    accesses.push_back(std::move(access));
+                }
+                continue;
+            }
+
+            if (indexer.hasSortedIndex(field)) {
+                Document bounds;
+                for (const char* op : { "$gt", "$gte", "$lt", "$lte" }) {
+                    if (auto it = ops.find(op); it != ops.end()) bounds[op] = it->second;
+                }
+                RangeBounds range;
+                if (!bounds.empty() && extractRange(bounds, range)) {
+                    double rows = stats.estimateRange(field, range.lower, range.upper);
+                    accesses.push_back({ rows, field, {}, std::move(range) });
+                }
+            }
+        }
+
+        std::stable_sort(accesses.begin(), accesses.end(), [](const Access& a, const Access& b) { return a.rows < b.rows; });
+        for (const Access& access : accesses) {
+            if (narrowed && static_cast<double>(ids.size()) * INTERSECT_RATIO <= access.rows) break;
+            std::vector<Id> hits;
+            if (access.keys.empty()) hits = indexer.searchRange(access.field, access.range);
+            for (const Value* key : access.keys) lookupEqual(access.field, *key, hits);
+            narrow(hits);
+        }
+        if (!narrowed) return false;
+
+        out = std::move(ids);
+        return true;
+    }
+
+    // --- COUNTING ---
+
+    // Exact count from index sizes alone (no document is read): {} or one field with
+    // equality, $in or a range. False when the query needs documents
+    bool countIndexed(const Document& query, size_t& out) const {
+        if (query.empty()) {
+            out = db.size();
+            return true;
+        }
+        if (query.size() != 1) return false;
+
+        const auto& [field, constraint] = *query.begin();
+        if (!constraint || field[0] == '$' || !indexer.hasIndex(field)) return false;
+
+        auto scalar = [](const Value& v) { return v.type != Type::Object && v.type != Type::Array; };
+
+        if (constraint->type != Type::Object) {
+            if (!scalar(*constraint)) { // arrays never compare equal
+                out = 0;
+                return true;
+            }
+            return indexer.countEqual(field, *constraint, out);
+        }
+
+        const Document& ops = constraint->asObject();
+        auto in = ops.find("$in");
+        if (ops.size() == 1 && in != ops.end() && in->second && in->second->type == Type::Array) {
+            std::vector<Value> keys; // 1 and 1.0 (or a repeated key) must count once
+            for (const auto& e : in->second->asArray()) {
+                if (e && scalar(*e)) keys.push_back(*e);
+            }
+            std::sort(keys.begin(), keys.end(), ValueLess());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+            out = 0;
+            for (const auto& k : keys) {
+                size_t n = 0;
+                indexer.countEqual(field, k, n);
+                out += n;
+            }
+            return true;
+        }
+
+        RangeBounds bounds;
+        return extractRange(ops, bounds) && indexer.countRange(field, bounds, out);
+    }
+
+    bool distinctIndexed(const std::string& field, std::vector<Value>& out) const {
+        return indexer.distinctKeys(field, out);
+    }
+
     // --- ADAPTIVE LOGIC ---
     
     void setAdaptive(bool enabled) { adaptive_mode = enabled; }
@@ -131,16 +669,11 @@ public:
         }
     }
     
-    // --- SCHEMA SAMPLING ---
-    std::vector<std::string> getSampleFields() const {
-        std::set<std::string> fields;
-        int limit = 50;
-        int count = 0;
-        for (const auto& [id, doc] : db) {
-            for (const auto& [key, val] : doc) fields.insert(key);
-            if (++count >= limit) break;
-        }
-        return std::vector<std::string>(fields.begin(), fields.end());
+    // --- STATISTICS ---
+    const StatsCatalog& getStats() const { return stats; }
+
+    std::vector<std::string> getFields() const {
+        return stats.fieldNames();
     }
 };
 
@@ -0,0 +1,264 @@
+#ifndef TEXT_INDEX_HPP
+#define TEXT_INDEX_HPP
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cctype>
+
+namespace fluxdb {
+
+// term + its position in the source text (stopwords still advance the position)
+struct Token {
+    std::string term;
+    uint32_t position;
+};
+
+class Tokenizer {
+private:
+    std::unordered_set<std::string> stopwords;
+
+public:
+    Tokenizer() : stopwords(defaultStopwords()) {}
+    explicit Tokenizer(std::unordered_set<std::string> words) : stopwords(std::move(words)) {}
+
+    static std::unordered_set<std::string> defaultStopwords() {
+        return { "a", "an", "and", "are", "as", "at", "be", "by", "for", "from", "has", "in",
+                 "is", "it", "its", "of", "on", "or", "that", "the", "to", "was", "were", "with" };
+    }
+
+    // Lowercased alphanumeric runs, non ASCII bytes are kept as word characters (UTF-8 passthrough)
+    std::vector<Token> tokenize(const std::string& text) const {
+        std::vector<Token> tokens;
+        std::string current;
+        uint32_t position = 0;
+
+        auto flush = [&]() {
+            if (current.empty()) return;
+            if (!stopwords.count(current)) tokens.push_back({ current, position });
+            position++;
+            current.clear();
+        };
+
+        for (unsigned char c : text) {
+            if (std::isalnum(c) || c >= 0x80) {
+                current += static_cast<char>(std::tolower(c));
+            } else {
+                flush();
+            }
+        }
+        flush();
+        return tokens;
+    }
+
+    // Scan fallback for unindexed fields: all terms present (or consecutive when phrase)
+    bool matches(const std::string& text, const std::string& query, bool phrase) const {
+        return matchTokens(tokenize(text), tokenize(query), phrase);
+    }
+
+    // Same check with the query already tokenized (compiled predicates)
+    static bool matchTokens(const std::vector<Token>& text, const std::vector<Token>& q, bool phrase) {
+        if (q.empty()) return false;
+
+        std::unordered_map<std::string, std::vector<uint32_t>> positions;
+        for (const auto& t : text) positions[t.term].push_back(t.position);
+
+        for (const auto& t : q) {
+            if (!positions.count(t.term)) return false;
+        }
+        if (!phrase) return true;
+
+        for (uint32_t start : positions[q[0].term]) {
+            bool ok = true;
+            for (size_t i = 1; i < q.size() && ok; ++i) {
+                const auto& p = positions[q[i].term];
+                ok = std::binary_search(p.begin(), p.end(), start + (q[i].position - q[0].position));
+            }
+            if (ok) return true;
+        }
+        return false;
+    }
+};
+
+struct Posting {
+    uint64_t docId;
+    std::vector<uint32_t> positions; // sorted, tf = positions.size()
+};
+
+// Inverted index with positional postings, ranked by BM25
+class TextIndex {
+private:
+    Tokenizer tokenizer;
+    std::unordered_map<std::string, std::vector<Posting>> postings; // sorted by docId
+    std::unordered_map<uint64_t, uint32_t> doc_lengths;
+    uint64_t total_length = 0;
+
+    static constexpr double K1 = 1.2;
+    static constexpr double B  = 0.75;
+
+    static bool byDoc(const Posting& p, uint64_t docId) { return p.docId < docId; }
+
+    // Exponential probe then binary search, from 'from' onwards
+    static size_t gallop(const std::vector<Posting>& list, size_t from, uint64_t docId) {
+        size_t step = 1;
+        size_t hi = from;
+        while (hi < list.size() && list[hi].docId < docId) {
+            from = hi;
+            hi += step;
+            step <<= 1;
+        }
+        hi = std::min(hi + 1, list.size());
+        return std::lower_bound(list.begin() + from, list.begin() + hi, docId, byDoc) - list.begin();
+    }
+
+    // Galloping intersection, shortest list drives
+    static std::vector<std::vector<const Posting*>> intersect(std::vector<const std::vector<Posting>*> lists) {
+        std::vector<std::vector<const Posting*>> out; // out[i] = postings of each term for one doc
+        if (lists.empty()) return out;
+
+        std::vector<size_t> order(lists.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return lists[a]->size() < lists[b]->size(); });
+
+        std::vector<size_t> cursor(lists.size(), 0);
+        const auto& driver = *lists[order[0]];
+
+        for (const Posting& p : driver) {
+            std::vector<const Posting*> row(lists.size(), nullptr);
+            row[order[0]] = &p;
+            bool all = true;
+
+            for (size_t k = 1; k < order.size(); ++k) {
+                size_t li = order[k];
+                const auto& list = *lists[li];
+                cursor[li] = gallop(list, cursor[li], p.docId);
+                if (cursor[li] >= list.size()) return out; // one list exhausted, nothing more can match
+                if (list[cursor[li]].docId != p.docId) { all = false; break; }
+                row[li] = &list[cursor[li]];
+            }
+            if (all) out.push_back(std::move(row));
+        }
+        return out;
+    }
+
+    static bool hasPhrase(const std::vector<const Posting*>& row, const std::vector<Token>& q) {
+        for (uint32_t start : row[0]->positions) {
+            bool ok = true;
+            for (size_t i = 1; i < q.size() && ok; ++i) {
+                const auto& p = row[i]->positions;
+                ok = std::binary_search(p.begin(), p.end(), start + (q[i].position - q[0].position));
+            }
+            if (ok) return true;
+        }
+        return false;
+    }
+
+public:
+    TextIndex() = default;
+    explicit TextIndex(std::unordered_set<std::string> stopwords) : tokenizer(std::move(stopwords)) {}
+
+    const Tokenizer& getTokenizer() const { return tokenizer; }
+
+    void add(uint64_t docId, const std::string& text) {
+        std::vector<Token> tokens = tokenizer.tokenize(text);
+        if (tokens.empty()) return;
+
+        std::unordered_map<std::string, std::vector<uint32_t>> grouped;
+        for (const auto& t : tokens) grouped[t.term].push_back(t.position);
+
+        for (auto& [term, pos] : grouped) {
+            auto& list = postings[term];
+            if (list.empty() || list.back().docId < docId) {
+                list.push_back({ docId, std::move(pos) }); // ids are monotonic, common case
+            } else {
+                auto it = std::lower_bound(list.begin(), list.end(), docId, byDoc);
+                if (it != list.end() && it->docId == docId) {
+                    it->positions.insert(it->positions.end(), pos.begin(), pos.end());
+                    std::sort(it->positions.begin(), it->positions.end());
+                } else {
+                    list.insert(it, { docId, std::move(pos) });
+                }
+            }
+        }
+        doc_lengths[docId] += static_cast<uint32_t>(tokens.size());
+        total_length += tokens.size();
+    }
+
+    void remove(uint64_t docId, const std::string& text) {
+        std::vector<Token> tokens = tokenizer.tokenize(text);
+        if (tokens.empty()) return;
+
+        for (const auto& t : tokens) {
+            auto pit = postings.find(t.term);
+            if (pit == postings.end()) continue;
+
+            auto& list = pit->second;
+            auto it = std::lower_bound(list.begin(), list.end(), docId, byDoc);
+            if (it != list.end() && it->docId == docId) list.erase(it);
+            if (list.empty()) postings.erase(pit);
+        }
+
+        auto lit = doc_lengths.find(docId);
+        if (lit != doc_lengths.end()) {
+            total_length -= std::min<uint64_t>(total_length, lit->second);
+            doc_lengths.erase(lit);
+        }
+    }
+
+    // All query terms must be present (consecutive when phrase), best BM25 first
+    std::vector<std::pair<uint64_t, double>> search(const std::string& query, bool phrase) const {
+        std::vector<std::pair<uint64_t, double>> results;
+
+        std::vector<Token> q = tokenizer.tokenize(query);
+        if (q.empty()) return results;
+
+        if (!phrase) { // duplicate terms add nothing to a conjunctive match
+            std::unordered_set<std::string> seen;
+            q.erase(std::remove_if(q.begin(), q.end(), [&](const Token& t) { return !seen.insert(t.term).second; }), q.end());
+        }
+
+        std::vector<const std::vector<Posting>*> lists;
+        for (const auto& t : q) {
+            auto it = postings.find(t.term);
+            if (it == postings.end()) return results;
+            lists.push_back(&it->second);
+        }
+
+        double n = static_cast<double>(doc_lengths.size());
+        double avgdl = n > 0 ? static_cast<double>(total_length) / n : 1.0;
+
+        for (const auto& row : intersect(lists)) {
+            if (phrase && !hasPhrase(row, q)) continue;
+
+            uint64_t docId = row[0]->docId;
+            auto lit = doc_lengths.find(docId);
+            double dl = lit != doc_lengths.end() ? lit->second : avgdl;
+
+            double score = 0;
+            for (size_t i = 0; i < row.size(); ++i) {
+                double df = static_cast<double>(lists[i]->size());
+                double idf = std::log(1.0 + (n - df + 0.5) / (df + 0.5));
+                double tf = static_cast<double>(row[i]->positions.size());
+                score += idf * (tf * (K1 + 1)) / (tf + K1 * (1 - B + B * dl / avgdl));
+            }
+            results.push_back({ docId, score });
+        }
+
+        std::stable_sort(results.begin(), results.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+        return results;
+    }
+
+    void clear() {
+        postings.clear();
+        doc_lengths.clear();
+        total_length = 0;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <deque>
+#include <algorithm>
+
+namespace fluxdb {
+
+// Shared worker pool for scans/aggregations. The caller always works too, so a
+// task running inside the pool can't deadlock waiting on the pool
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex lock;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lk(lock);
+                cv.wait(lk, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t threads) {
+        for (size_t i = 0; i < threads; ++i) workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    static ThreadPool& instance() {
+        static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    size_t size() const { return workers.size() + 1; } // + caller
+
+    // Runs fn(workerSlot) on up to 'parallelism' threads (caller = slot 0) and waits.
+    // fn pulls its own morsels, so uneven work balances itself
+    void run(size_t parallelism, const std::function<void(size_t)>& fn) {
+        parallelism = std::max<size_t>(1, std::min(parallelism, size()));
+
+        std::atomic<size_t> pending{ parallelism - 1 };
+        std::mutex doneLock;
+        std::condition_variable doneCv;
+
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            for (size_t slot = 1; slot < parallelism; ++slot) {
+                tasks.push_back([&, slot] {
+                    fn(slot);
+                    std::lock_guard<std::mutex> dl(doneLock); // caller's frame must outlive this
+                    if (--pending == 0) doneCv.notify_one();
+                });
+            }
+        }
+        cv.notify_all();
+
+        fn(0);
+
+        std::unique_lock<std::mutex> dl(doneLock);
+        doneCv.wait(dl, [&] { return pending == 0; });
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef TRIGRAM_INDEX_HPP
+#define TRIGRAM_INDEX_HPP
+
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cctype>
+
+namespace fluxdb {
+
+// Literal parts every match of a regex must contain
+struct RegexLiterals {
+    std::string prefix;              // anchored literal prefix ("^abc..."), empty if none
+    std::vector<std::string> runs;   // required literal substrings
+};
+
+// Trigram index: lowercased 3-byte grams -> sorted doc ids, narrows $regex candidates
+class TrigramIndex {
+private:
+    std::unordered_map<uint32_t, std::vector<uint64_t>> postings;
+
+    static uint32_t pack(unsigned char a, unsigned char b, unsigned char c) {
+        return (static_cast<uint32_t>(std::tolower(a)) << 16) |
+               (static_cast<uint32_t>(std::tolower(b)) << 8)  |
+                static_cast<uint32_t>(std::tolower(c));
+    }
+
+public:
+    static std::vector<uint32_t> grams(const std::string& s) {
+        std::vector<uint32_t> out;
+        for (size_t i = 0; i + 3 <= s.size(); ++i) out.push_back(pack(s[i], s[i + 1], s[i + 2]));
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+        return out;
+    }
+
+    void add(uint64_t docId, const std::string& text) {
+        for (uint32_t g : grams(text)) {
+            auto& list = postings[g];
+            if (list.empty() || list.back() < docId) list.push_back(docId);
+            else {
+                auto it = std::lower_bound(list.begin(), list.end(), docId);
+                if (it == list.end() || *it != docId) list.insert(it, docId);
+            }
+        }
+    }
+
+    void remove(uint64_t docId, const std::string& text) {
+        for (uint32_t g : grams(text)) {
+            auto pit = postings.find(g);
+            if (pit == postings.end()) continue;
+            auto& list = pit->second;
+            auto it = std::lower_bound(list.begin(), list.end(), docId);
+            if (it != list.end() && *it == docId) list.erase(it);
+            if (list.empty()) postings.erase(pit);
+        }
+    }
+
+    // Docs containing every gram of every run (superset of the real matches)
+    std::vector<uint64_t> search(const std::vector<std::string>& runs) const {
+        std::vector<uint32_t> needed;
+        for (const auto& r : runs) {
+            auto g = grams(r);
+            needed.insert(needed.end(), g.begin(), g.end());
+        }
+        std::sort(needed.begin(), needed.end());
+        needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+        std::vector<const std::vector<uint64_t>*> lists;
+        for (uint32_t g : needed) {
+            auto it = postings.find(g);
+            if (it == postings.end()) return {};
+            lists.push_back(&it->second);
+        }
+        if (lists.empty()) return {};
+
+        std::sort(lists.begin(), lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+        std::vector<uint64_t> result = *lists[0];
+        for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+            std::vector<uint64_t> both;
+            std::set_intersection(result.begin(), result.end(), lists[i]->begin(), lists[i]->end(), std::back_inserter(both));
+            result = std::move(both);
+        }
+        return result;
+    }
+
+    void clear() { postings.clear(); }
+
+    // Conservative literal extraction, alternation or anything unusual gives up (= no narrowing)
+    static RegexLiterals analyze(const std::string& pattern) {
+        RegexLiterals lit;
+        if (pattern.find('|') != std::string::npos) return lit;
+
+        bool anchored = !pattern.empty() && pattern[0] == '^';
+        bool inPrefix = anchored;
+        std::string run;
+        int depth = 0;
+
+        auto endRun = [&]() {
+            if (run.size() >= 3) lit.runs.push_back(run);
+            run.clear();
+            inPrefix = false;
+        };
+
+        for (size_t i = anchored ? 1 : 0; i < pattern.size(); ++i) {
+            char c = pattern[i];
+            char literal = 0;
+
+            if (c == '\\' && i + 1 < pattern.size()) {
+                char e = pattern[++i];
+                if (std::isalnum(static_cast<unsigned char>(e))) { endRun(); continue; } // \d \w \b ...
+                literal = e;
+            }
+            else if (c == '(') { depth++; endRun(); continue; }
+            else if (c == ')') { depth--; endRun(); continue; }
+            else if (c == '[') {
+                endRun();
+                while (i < pattern.size() && pattern[i] != ']') i += (pattern[i] == '\\') ? 2 : 1;
+                continue;
+            }
+            else if (c == '?' || c == '*' || c == '{') {
+                // previous atom is optional: drop it from the run/prefix
+                if (!run.empty()) {
+                    run.pop_back();
+                    if (inPrefix && !lit.prefix.empty()) lit.prefix.pop_back();
+                }
+                endRun();
+                if (c == '{') while (i < pattern.size() && pattern[i] != '}') i++;
+                continue;
+            }
+            else if (c == '+') { endRun(); continue; } // atom kept once, repetition breaks adjacency
+            else if (c == '.' || c == '^' || c == '$') { endRun(); continue; }
+            else literal = c;
+
+            if (depth > 0) continue; // group contents may be optional
+            run += literal;
+            if (inPrefix) lit.prefix += literal;
+        }
+        endRun();
+        return lit;
+    }
+};
+
+}
+
+#endif
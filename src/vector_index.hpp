@@ -0,0 +1,464 @@
+#ifndef VECTOR_INDEX_HPP
+#define VECTOR_INDEX_HPP
+
+#include "document.hpp"
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <queue>
+#include <random>
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define FLUX_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLUX_SIMD_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FLUX_SIMD_NEON
+#endif
+
+namespace fluxdb {
+
+enum class Metric : uint8_t { Cosine = 0, Dot = 1, L2 = 2 };
+
+// --- Distance kernels (8/4 floats per step, scalar tail) ---
+namespace simd {
+
+inline float dot(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0.0f;
+#if defined(FLUX_SIMD_AVX2)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    sum = _mm_cvtss_f32(s);
+#elif defined(FLUX_SIMD_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    sum = _mm_cvtss_f32(acc);
+#elif defined(FLUX_SIMD_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; i + 4 <= n; i += 4) acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+    float32x2_t h = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(h, h), 0);
+#endif
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+inline float l2sq(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0.0f;
+#if defined(FLUX_SIMD_AVX2)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc = _mm256_fmadd_ps(d, d, acc);
+    }
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    sum = _mm_cvtss_f32(s);
+#elif defined(FLUX_SIMD_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    sum = _mm_cvtss_f32(acc);
+#elif defined(FLUX_SIMD_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t d = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        acc = vmlaq_f32(acc, d, d);
+    }
+    float32x2_t h = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(h, h), 0);
+#endif
+    for (; i < n; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+} // namespace simd
+
+inline bool parseMetric(const std::string& name, Metric& out) {
+    if (name == "cosine") out = Metric::Cosine;
+    else if (name == "dot") out = Metric::Dot;
+    else if (name == "l2") out = Metric::L2;
+    else return false;
+    return true;
+}
+
+// Numeric array -> floats, false for anything else
+inline bool toVector(const Value& v, std::vector<float>& out) {
+    if (v.type != Type::Array) return false;
+    const Array& arr = v.asArray();
+    out.clear();
+    out.reserve(arr.size());
+    for (const auto& e : arr) {
+        if (!e || !e->isNumber()) return false;
+        out.push_back(static_cast<float>(e->getNumeric()));
+    }
+    return !out.empty();
+}
+
+inline void normalize(std::vector<float>& v) {
+    float n = std::sqrt(simd::dot(v.data(), v.data(), v.size()));
+    if (n > 0) for (float& x : v) x /= n;
+}
+
+// smaller = closer for every metric (cosine vectors are stored normalized)
+inline float distance(Metric m, const float* a, const float* b, size_t n) {
+    switch (m) {
+        case Metric::L2:  return simd::l2sq(a, b, n);
+        case Metric::Dot: return -simd::dot(a, b, n);
+        default:          return 1.0f - simd::dot(a, b, n);
+    }
+}
+
+// Hierarchical Navigable Small World graph (Malkov & Yashunin), deletes are tombstones
+class HnswIndex {
+private:
+    struct Node {
+        uint64_t docId;
+        int level;
+        bool deleted = false;
+        std::vector<std::vector<uint32_t>> links; // per level
+    };
+
+    Metric metric = Metric::Cosine;
+    size_t M = 16;
+    size_t ef_construction = 200;
+    size_t ef_search = 64;
+    size_t dim = 0;
+
+    std::vector<Node> nodes;
+    std::vector<float> vectors;                    // nodes.size() * dim, contiguous
+    std::unordered_map<uint64_t, uint32_t> by_doc; // live node of a doc
+    size_t deleted_count = 0;
+
+    int64_t entry = -1;
+    int max_level = -1;
+    std::mt19937_64 rng{ 42 };
+
+    using Cand = std::pair<float, uint32_t>; // (distance, node)
+
+    const float* vec(uint32_t n) const { return vectors.data() + size_t(n) * dim; }
+    float dist(const float* q, uint32_t n) const { return distance(metric, q, vec(n), dim); }
+    size_t maxLinks(int level) const { return level == 0 ? 2 * M : M; }
+
+    uint32_t greedy(const float* q, uint32_t from, int top, int bottom) const {
+        uint32_t cur = from;
+        float curDist = dist(q, cur);
+        for (int lvl = top; lvl > bottom; --lvl) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (uint32_t nb : nodes[cur].links[lvl]) {
+                    float d = dist(q, nb);
+                    if (d < curDist) { curDist = d; cur = nb; changed = true; }
+                }
+            }
+        }
+        return cur;
+    }
+
+    // best-first beam search on one level, returns up to ef closest (deleted nodes still route)
+    std::vector<Cand> searchLayer(const float* q, uint32_t ep, size_t ef, int level) const {
+        std::unordered_set<uint32_t> visited{ ep };
+        std::priority_queue<Cand, std::vector<Cand>, std::greater<Cand>> frontier; // min-heap
+        std::priority_queue<Cand> best;                                            // max-heap
+
+        float d0 = dist(q, ep);
+        frontier.push({ d0, ep });
+        best.push({ d0, ep });
+
+        while (!frontier.empty()) {
+            Cand c = frontier.top();
+            if (c.first > best.top().first && best.size() >= ef) break;
+            frontier.pop();
+
+            for (uint32_t nb : nodes[c.second].links[level]) {
+                if (!visited.insert(nb).second) continue;
+                float d = dist(q, nb);
+                if (best.size() < ef || d < best.top().first) {
+                    frontier.push({ d, nb });
+                    best.push({ d, nb });
+                    if (best.size() > ef) best.pop();
+                }
+            }
+        }
+
+        std::vector<Cand> out;
+        out.reserve(best.size());
+        while (!best.empty()) { out.push_back(best.top()); best.pop(); }
+        std::reverse(out.begin(), out.end());
+        return out;
+    }
+
+    // neighbour selection heuristic: keep a candidate only if it's closer to q than to any kept one
+    std::vector<uint32_t> selectNeighbors(const std::vector<Cand>& sorted, size_t limit) const {
+        std::vector<uint32_t> kept;
+        for (const auto& [d, n] : sorted) {
+            if (kept.size() >= limit) break;
+            bool good = true;
+            for (uint32_t k : kept) {
+                if (distance(metric, vec(n), vec(k), dim) < d) { good = false; break; }
+            }
+            if (good) kept.push_back(n);
+        }
+        for (const auto& [d, n] : sorted) { // top up with the closest leftovers
+            if (kept.size() >= limit) break;
+            if (std::find(kept.begin(), kept.end(), n) == kept.end()) kept.push_back(n);
+        }
+        return kept;
+    }
+
+    void link(uint32_t from, uint32_t to, int level) {
+        auto& l = nodes[from].links[level];
+        l.push_back(to);
+        if (l.size() <= maxLinks(level)) return;
+
+        std::vector<Cand> c;
+        c.reserve(l.size());
+        for (uint32_t n : l) c.push_back({ distance(metric, vec(from), vec(n), dim), n });
+        std::sort(c.begin(), c.end());
+        l = selectNeighbors(c, maxLinks(level));
+    }
+
+    void insertNode(uint64_t docId, const std::vector<float>& v) {
+        uint32_t id = static_cast<uint32_t>(nodes.size());
+        std::uniform_real_distribution<double> uni(0.0, 1.0);
+        int level = static_cast<int>(-std::log(std::max(uni(rng), 1e-12)) / std::log(static_cast<double>(M)));
+
+        nodes.push_back({ docId, level, false, std::vector<std::vector<uint32_t>>(level + 1) });
+        vectors.insert(vectors.end(), v.begin(), v.end());
+        by_doc[docId] = id;
+
+        if (entry < 0) {
+            entry = id;
+            max_level = level;
+            return;
+        }
+
+        const float* q = vec(id);
+        uint32_t ep = greedy(q, static_cast<uint32_t>(entry), max_level, level);
+
+        for (int lvl = std::min(level, max_level); lvl >= 0; --lvl) {
+            auto cands = searchLayer(q, ep, ef_construction, lvl);
+            auto neighbors = selectNeighbors(cands, M);
+            for (uint32_t nb : neighbors) {
+                nodes[id].links[lvl].push_back(nb);
+                link(nb, id, lvl);
+            }
+            ep = cands.front().second;
+        }
+
+        if (level > max_level) {
+            max_level = level;
+            entry = id;
+        }
+    }
+
+    // graph is rebuilt from live nodes once tombstones dominate
+    void compact() {
+        std::vector<std::pair<uint64_t, std::vector<float>>> live;
+        for (uint32_t n = 0; n < nodes.size(); ++n) {
+            if (!nodes[n].deleted) live.push_back({ nodes[n].docId, std::vector<float>(vec(n), vec(n) + dim) });
+        }
+        nodes.clear();
+        vectors.clear();
+        by_doc.clear();
+        deleted_count = 0;
+        entry = -1;
+        max_level = -1;
+        for (const auto& [docId, v] : live) insertNode(docId, v);
+    }
+
+    template <typename T> static void put(std::ostream& out, const T& v) { out.write(reinterpret_cast<const char*>(&v), sizeof(T)); }
+    template <typename T> static T get(std::istream& in) { T v{}; in.read(reinterpret_cast<char*>(&v), sizeof(T)); return v; }
+
+public:
+    HnswIndex() = default;
+
+    // {"M": 16, "ef": 64, "ef_construction": 200, "metric": "cosine" | "dot" | "l2"}
+    explicit HnswIndex(const Document& options) {
+        auto num = [&](const char* key, size_t& out) {
+            auto it = options.find(key);
+            if (it != options.end() && it->second && it->second->isNumber() && it->second->getNumeric() >= 2) {
+                out = static_cast<size_t>(it->second->getNumeric());
+            }
+        };
+        num("M", M);
+        num("ef", ef_search);
+        num("ef_construction", ef_construction);
+
+        auto m = options.find("metric");
+        if (m != options.end() && m->second && m->second->type == Type::String) {
+            if (!parseMetric(m->second->asString(), metric)) throw std::runtime_error("Unknown metric: " + m->second->asString());
+        }
+    }
+
+    Metric getMetric() const { return metric; }
+    size_t size() const { return by_doc.size(); }
+
+    void add(uint64_t docId, const Value& val) {
+        std::vector<float> v;
+        if (!toVector(val, v)) return;
+        if (dim == 0) dim = v.size();
+        if (v.size() != dim) return; // wrong dimension: not indexed
+
+        if (metric == Metric::Cosine) normalize(v);
+        remove(docId);
+        insertNode(docId, v);
+    }
+
+    void remove(uint64_t docId) {
+        auto it = by_doc.find(docId);
+        if (it == by_doc.end()) return;
+        nodes[it->second].deleted = true;
+        by_doc.erase(it);
+        deleted_count++;
+        if (deleted_count > 64 && deleted_count * 2 > nodes.size()) compact();
+    }
+
+    // top-k closest live docs, (docId, distance) ascending
+    std::vector<std::pair<uint64_t, float>> search(const Value& query, size_t k, size_t ef = 0) const {
+        std::vector<std::pair<uint64_t, float>> results;
+        std::vector<float> q;
+        if (entry < 0 || !toVector(query, q) || q.size() != dim) return results;
+        if (metric == Metric::Cosine) normalize(q);
+
+        ef = std::max({ ef ? ef : ef_search, k, size_t(1) });
+        uint32_t ep = greedy(q.data(), static_cast<uint32_t>(entry), max_level, 0);
+
+        size_t widened = ef + ef * deleted_count / std::max<size_t>(1, nodes.size()); // tombstones take slots
+        for (const auto& [d, n] : searchLayer(q.data(), ep, widened, 0)) {
+            if (nodes[n].deleted) continue;
+            results.push_back({ nodes[n].docId, d });
+            if (results.size() >= k) break;
+        }
+        return results;
+    }
+
+    void clear() {
+        nodes.clear();
+        vectors.clear();
+        by_doc.clear();
+        deleted_count = 0;
+        entry = -1;
+        max_level = -1;
+        dim = 0;
+    }
+
+    // --- Snapshot payload (graph is restored as is, no rebuild) ---
+
+    void save(std::ostream& out) const {
+        put<uint8_t>(out, static_cast<uint8_t>(metric));
+        put<uint32_t>(out, static_cast<uint32_t>(M));
+        put<uint32_t>(out, static_cast<uint32_t>(ef_construction));
+        put<uint32_t>(out, static_cast<uint32_t>(ef_search));
+        put<uint32_t>(out, static_cast<uint32_t>(dim));
+        put<int64_t>(out, entry);
+        put<int32_t>(out, max_level);
+        put<uint32_t>(out, static_cast<uint32_t>(nodes.size()));
+
+        for (uint32_t n = 0; n < nodes.size(); ++n) {
+            const Node& node = nodes[n];
+            put<uint64_t>(out, node.docId);
+            put<int32_t>(out, node.level);
+            put<uint8_t>(out, node.deleted ? 1 : 0);
+            out.write(reinterpret_cast<const char*>(vec(n)), dim * sizeof(float));
+            for (const auto& l : node.links) {
+                put<uint32_t>(out, static_cast<uint32_t>(l.size()));
+                out.write(reinterpret_cast<const char*>(l.data()), l.size() * sizeof(uint32_t));
+            }
+        }
+    }
+
+    bool load(std::istream& in) {
+        clear();
+        metric = static_cast<Metric>(get<uint8_t>(in));
+        M = get<uint32_t>(in);
+        ef_construction = get<uint32_t>(in);
+        ef_search = get<uint32_t>(in);
+        dim = get<uint32_t>(in);
+        entry = get<int64_t>(in);
+        max_level = get<int32_t>(in);
+        uint32_t count = get<uint32_t>(in);
+        if (!in) return false;
+
+        nodes.reserve(count);
+        vectors.resize(size_t(count) * dim);
+        for (uint32_t n = 0; n < count && in; ++n) {
+            Node node;
+            node.docId = get<uint64_t>(in);
+            node.level = get<int32_t>(in);
+            node.deleted = get<uint8_t>(in) != 0;
+            in.read(reinterpret_cast<char*>(vectors.data() + size_t(n) * dim), dim * sizeof(float));
+            if (node.level < 0 || node.level > 64) return false;
+
+            node.links.resize(node.level + 1);
+            for (auto& l : node.links) {
+                uint32_t len = get<uint32_t>(in);
+                if (len > 4 * M + 1) return false;
+                l.resize(len);
+                in.read(reinterpret_cast<char*>(l.data()), len * sizeof(uint32_t));
+            }
+            if (node.deleted) deleted_count++;
+            else by_doc[node.docId] = n;
+            nodes.push_back(std::move(node));
+        }
+        if (!in || entry >= static_cast<int64_t>(count)) return false;
+
+        for (const auto& node : nodes) { // never trust offsets read from disk
+            for (const auto& l : node.links) {
+                for (uint32_t nb : l) {
+                    if (nb >= count || nodes[nb].level < static_cast<int>(&l - node.links.data())) return false;
+                }
+            }
+        }
+        return true;
+    }
+};
+
+// Exact top-k for fields without a VECTOR index (same kernels)
+inline std::vector<std::pair<uint64_t, float>> bruteForceNearest(
+        const std::vector<std::pair<uint64_t, std::shared_ptr<Value>>>& candidates, const Value& query, size_t k, Metric metric) {
+    std::vector<std::pair<uint64_t, float>> scored;
+    std::vector<float> q, v;
+    if (!toVector(query, q)) return scored;
+    if (metric == Metric::Cosine) normalize(q);
+
+    for (const auto& [id, val] : candidates) {
+        if (!toVector(*val, v) || v.size() != q.size()) continue;
+        if (metric == Metric::Cosine) normalize(v);
+        scored.push_back({ id, distance(metric, q.data(), v.data(), q.size()) });
+    }
+
+    size_t n = std::min(k, scored.size());
+    std::partial_sort(scored.begin(), scored.begin() + n, scored.end(),
+                      [](const auto& a, const auto& b) { return a.second < b.second; });
+    scored.resize(n);
+    return scored;
+}
+
+}
+
+#endif
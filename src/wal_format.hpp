@@ -0,0 +1,201 @@
+#ifndef WAL_FORMAT_HPP
+#define WAL_FORMAT_HPP
+
+#include "crc32c.hpp"
+#include "lz4.hpp"
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace fluxdb {
+
+// WAL v3 layout (little-endian):
+//   header: magic "FXWL" (u32) | version (u32) | base lsn (u64, first lsn this file may hold)
+//   frame:  length (u32, bytes after the crc) | crc32c (u32, of those bytes) |
+//           lsn (u64) | opcode (u8) | id (u64) | serialized doc (opcode 0x01 only)
+//   batch:  a frame with opcode 0x03 holding a group-commit batch of frames, LZ4-compressed:
+//           lsn = the first inner frame's, id = uncompressed size
+// v2 files are framed the same but hold ENCODING_V1 documents (v3: ENCODING_V2). v1 files
+// (bare opcode | id | size | doc records) start with 0x01/0x02. Both are still replayed
+namespace wal {
+
+constexpr uint32_t MAGIC = 0x4C575846; // "FXWL"
+constexpr uint32_t VERSION = 3;
+constexpr uint32_t VERSION_MIN = 2; // oldest framed version still read
+constexpr size_t HEADER_SIZE = 16;
+constexpr size_t FRAME_PREFIX = 8;    // length + crc
+constexpr size_t BODY_MIN = 8 + 1 + 8; // lsn + opcode + id
+constexpr uint32_t MAX_BODY = 1u << 30; // anything longer is a torn or garbage length
+constexpr uint8_t OP_BATCH = 0x03;
+constexpr size_t BATCH_MIN = 512;      // smaller batches are not worth compressing
+constexpr size_t BATCH_MAX = 64 << 20; // larger ones go out as they are
+
+inline std::vector<char> header(uint64_t baseLsn) {
+    std::vector<char> out(HEADER_SIZE);
+    std::memcpy(out.data(), &MAGIC, 4);
+    std::memcpy(out.data() + 4, &VERSION, 4);
+    std::memcpy(out.data() + 8, &baseLsn, 8);
+    return out;
+}
+
+inline bool isHeader(const uint8_t* data, size_t size, uint64_t& baseLsn, uint32_t& version) {
+    uint32_t magic;
+    if (size < HEADER_SIZE) return false;
+    std::memcpy(&magic, data, 4);
+    std::memcpy(&version, data + 4, 4);
+    if (magic != MAGIC || version < VERSION_MIN || version > VERSION) return false;
+    std::memcpy(&baseLsn, data + 8, 8);
+    return true;
+}
+
+inline bool isHeader(const uint8_t* data, size_t size, uint64_t& baseLsn) {
+    uint32_t version;
+    return isHeader(data, size, baseLsn, version);
+}
+
+// A frame built in place: beginFrame() writes everything up to the doc and returns where the
+// frame starts, the doc is appended to out, endFrame() fills in length and crc
+inline size_t beginFrame(std::vector<char>& out, uint64_t lsn, uint8_t opCode, uint64_t id) {
+    size_t at = out.size();
+    out.resize(at + FRAME_PREFIX + BODY_MIN);
+    char* body = out.data() + at + FRAME_PREFIX;
+    std::memcpy(body, &lsn, 8);
+    body[8] = static_cast<char>(opCode);
+    std::memcpy(body + 9, &id, 8);
+    return at;
+}
+
+inline void endFrame(std::vector<char>& out, size_t at) {
+    uint32_t length = static_cast<uint32_t>(out.size() - at - FRAME_PREFIX);
+    uint32_t crc = crc32c::value(out.data() + at + FRAME_PREFIX, length);
+    std::memcpy(out.data() + at, &length, 4);
+    std::memcpy(out.data() + at + 4, &crc, 4);
+}
+
+// frames (whole, from beginFrame/endFrame) as one compressed batch frame; false when that would not
+// be smaller, out is then untouched
+inline bool appendBatch(std::vector<char>& out, const std::vector<char>& frames) {
+    if (frames.size() < BATCH_MIN || frames.size() > BATCH_MAX) return false;
+    uint64_t lsn;
+    std::memcpy(&lsn, frames.data() + FRAME_PREFIX, 8);
+
+    size_t at = out.size();
+    out.resize(at + FRAME_PREFIX + BODY_MIN + lz4::bound(frames.size()));
+    char* body = out.data() + at + FRAME_PREFIX;
+    size_t packed = lz4::compress(reinterpret_cast<const uint8_t*>(frames.data()), frames.size(),
+                                  reinterpret_cast<uint8_t*>(body + BODY_MIN));
+    if (FRAME_PREFIX + BODY_MIN + packed >= frames.size()) {
+        out.resize(at);
+        return false;
+    }
+
+    uint32_t length = static_cast<uint32_t>(BODY_MIN + packed);
+    uint64_t rawSize = frames.size();
+    std::memcpy(body, &lsn, 8);
+    body[8] = static_cast<char>(OP_BATCH);
+    std::memcpy(body + 9, &rawSize, 8);
+    uint32_t crc = crc32c::value(body, length);
+    std::memcpy(out.data() + at, &length, 4);
+    std::memcpy(out.data() + at + 4, &crc, 4);
+    out.resize(at + FRAME_PREFIX + length);
+    return true;
+}
+
+struct Frame {
+    uint64_t lsn;
+    uint8_t opCode;
+    uint64_t id;
+    const uint8_t* doc; // points into the scanned buffer (or the unpacked batch)
+    size_t docSize;
+};
+
+// Sequential scan of a mapped WAL, batches unpacked on the way. Stops at the end or at the
+// first frame that is cut short, fails its crc or goes back in lsn; validEnd() is where the
+// good prefix ends (a batch counts once all of its frames were returned)
+class Reader {
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    uint64_t last_lsn;
+    const char* problem = nullptr;
+
+    std::vector<uint8_t> batch; // unpacked frames of the batch being read
+    size_t batch_pos = 0;
+    size_t batch_end = 0;       // file offset after the batch frame
+    std::vector<uint8_t> done;  // the batch just finished, its last frame is still in use
+
+    // The frame at buf[at], checked; at moves past it
+    bool parse(const uint8_t* buf, size_t n, size_t& at, Frame& f, bool outer) {
+        if (n - at < FRAME_PREFIX) return fail("truncated frame header");
+
+        uint32_t length, crc;
+        std::memcpy(&length, buf + at, 4);
+        std::memcpy(&crc, buf + at + 4, 4);
+        if (length < BODY_MIN || length > MAX_BODY) return fail("bad frame length");
+        if (n - at - FRAME_PREFIX < length) return fail("truncated frame");
+
+        const uint8_t* body = buf + at + FRAME_PREFIX;
+        if (crc32c::value(body, length) != crc) return fail("checksum mismatch");
+
+        std::memcpy(&f.lsn, body, 8);
+        f.opCode = body[8];
+        std::memcpy(&f.id, body + 9, 8);
+        f.doc = body + BODY_MIN;
+        f.docSize = length - BODY_MIN;
+        if (f.lsn <= last_lsn) return fail("lsn out of order");
+        if (f.opCode != 0x01 && f.opCode != 0x02 && !(outer && f.opCode == OP_BATCH)) return fail("unknown opcode");
+
+        if (f.opCode != OP_BATCH) last_lsn = f.lsn; // a batch's lsn is its first frame's
+        at += FRAME_PREFIX + length;
+        return true;
+    }
+
+public:
+    Reader(const uint8_t* d, size_t n, uint64_t baseLsn)
+        : data(d), size(n), pos(HEADER_SIZE), last_lsn(baseLsn ? baseLsn - 1 : 0) {}
+
+    bool next(Frame& f) {
+        while (batch.empty()) {
+            if (pos == size) return false;
+            size_t at = pos;
+            if (!parse(data, size, at, f, true)) return false;
+            if (f.opCode != OP_BATCH) {
+                pos = at;
+                return true;
+            }
+            if (f.id == 0 || f.id > BATCH_MAX) return fail("bad batch size");
+            batch.resize(f.id);
+            if (!lz4::decompress(f.doc, f.docSize, batch.data(), batch.size())) {
+                batch.clear();
+                return fail("undecodable batch");
+            }
+            batch_pos = 0;
+            batch_end = at;
+        }
+
+        if (!parse(batch.data(), batch.size(), batch_pos, f, false)) return false;
+        if (batch_pos == batch.size()) {
+            pos = batch_end;
+            done.swap(batch); // f.doc still points into it
+            batch.clear();
+        }
+        return true;
+    }
+
+    size_t validEnd() const { return pos; }
+    uint64_t lastLsn() const { return last_lsn; }
+    const char* error() const { return problem; } // nullptr = clean end
+
+private:
+    bool fail(const char* why) {
+        problem = why;
+        return false;
+    }
+};
+
+}
+
+}
+
+#endif
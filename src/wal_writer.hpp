@@ -0,0 +1,306 @@
+#ifndef WAL_WRITER_HPP
+#define WAL_WRITER_HPP
+
+#include "file_io.hpp"
+#include "wal_format.hpp"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdexcept>
+#include <filesystem>
+#include <iostream>
+#include <cstdio>
+
+namespace fluxdb {
+
+// NONE: acknowledged once queued, never synced (the OS decides). INTERVAL: acknowledged once
+// queued, synced every N ms (a crash loses at most that window). COMMIT: acknowledged after
+// the record's batch is synced
+enum class Durability { None, Interval, Commit };
+
+// Group commit: writers append encoded records to a shared buffer (under the collection lock,
+// so WAL order = apply order) and get a sequence number back. One thread moves the whole
+// buffer to the file with a single write (+ sync) while new records pile up for the next
+// batch, then wakes everyone whose records went out. Waiting happens outside the collection lock
+class WalWriter {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::string path;
+    AppendFile file;
+
+    mutable std::mutex mtx;
+    std::condition_variable work_cv; // writer thread: records, a sync request or shutdown
+    std::condition_variable done_cv; // clients: a batch went out
+
+    std::vector<char> pending;
+    uint64_t appended = 0;    // sequence of the last record queued
+    uint64_t written = 0;     // ... handed to the OS
+    uint64_t synced = 0;      // ... on stable storage
+    uint64_t sync_target = 0; // sync() wants everything up to here synced
+    bool busy = false;        // the writer thread is using the file outside the lock
+    bool stopping = false;
+    bool failed = false;
+
+    Durability durability = Durability::None;
+    std::chrono::milliseconds interval{ 0 };
+    Clock::time_point last_sync = Clock::now();
+
+    bool compress = false; // batches go out as one LZ4 frame when that is smaller
+
+    int64_t bytes = 0; // file size including pending
+    uint64_t batches = 0, syncs = 0;
+    uint64_t raw_bytes = 0, stored_bytes = 0; // record bytes written, and what they took on disk
+
+    std::thread worker;
+
+    // NONE / INTERVAL writes go out once this much is queued or this long after the first record
+    static constexpr size_t GATHER_BYTES = 256 * 1024;
+    static constexpr std::chrono::milliseconds GATHER_TIME{ 1 };
+
+    // Only while no records are queued (construction, truncate)
+    void writeHeader(uint64_t baseLsn) {
+        std::vector<char> head = wal::header(baseLsn);
+        if (file.write(head.data(), head.size()) && file.sync()) bytes = static_cast<int64_t>(head.size());
+        else std::cerr << "[WAL] Cannot write header to " << path << "\n";
+    }
+
+    // What goes to the file for a batch: the batch itself, or packed holding it compressed
+    static const std::vector<char>& encode(const std::vector<char>& batch, std::vector<char>& packed, bool compress) {
+        packed.clear();
+        if (compress && wal::appendBatch(packed, batch)) return packed;
+        return batch;
+    }
+
+    void countWrite(size_t raw, size_t stored) {
+        raw_bytes += raw;
+        stored_bytes += stored;
+        bytes -= static_cast<int64_t>(raw - stored);
+    }
+
+    bool syncOwed(Clock::time_point now) const {
+        if (appended == synced) return false;
+        return stopping || sync_target > synced || durability == Durability::Commit ||
+               (durability == Durability::Interval && now - last_sync >= interval);
+    }
+
+    void run() {
+        std::vector<char> batch, packed;
+        std::unique_lock<std::mutex> lk(mtx);
+        while (true) {
+            bool sync = syncOwed(Clock::now());
+            if (pending.empty() && !sync) {
+                if (stopping) break;
+                if (durability == Durability::Interval && appended > synced) work_cv.wait_until(lk, last_sync + interval);
+                else work_cv.wait(lk);
+                continue;
+            }
+
+            // nobody waits for an unsynced write: let it gather instead of a write per record
+            if (!sync && !stopping && pending.size() < GATHER_BYTES) {
+                work_cv.wait_for(lk, GATHER_TIME, [&] {
+                    return stopping || sync_target > synced || pending.size() >= GATHER_BYTES;
+                });
+                sync = syncOwed(Clock::now());
+            }
+
+            batch.swap(pending);
+            uint64_t upto = appended;
+            bool pack = compress;
+            busy = true;
+            lk.unlock();
+
+            const std::vector<char>& out = encode(batch, packed, pack);
+            bool ok = out.empty() || file.write(out.data(), out.size());
+            if (ok && sync) ok = file.sync();
+
+            lk.lock();
+            busy = false;
+            countWrite(batch.size(), out.size());
+            if (!ok && !failed) {
+                failed = true;
+                std::cerr << "[WAL] Write to " << path << " failed, further commits report WAL_WRITE_FAILED.\n";
+            }
+            if (!batch.empty()) batches++;
+            written = upto;
+            if (sync) {
+                synced = upto;
+                last_sync = Clock::now();
+                syncs++;
+            }
+            batch.clear();
+            done_cv.notify_all();
+        }
+    }
+
+public:
+    // A new or empty file gets a header starting at lsn 1; existing contents are left to recovery
+    explicit WalWriter(const std::string& walPath) : path(walPath) {
+        if (file.open(path)) bytes = file.size();
+        if (file.isOpen() && bytes == 0) writeHeader(1);
+        worker = std::thread(&WalWriter::run, this);
+    }
+
+    ~WalWriter() {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            stopping = true;
+        }
+        work_cv.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+    // Queues one or more records, which encode(pending) appends straight to the batch being
+    // gathered (a failed encode leaves it as it was); returns the ticket for commit()
+    // (0 = WAL unavailable)
+    template <typename Encode>
+    uint64_t append(Encode&& encode) {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (!file.isOpen()) return 0;
+        size_t before = pending.size();
+        try {
+            encode(pending);
+        } catch (...) {
+            pending.resize(before);
+            throw;
+        }
+        size_t added = pending.size() - before;
+        if (!added) return 0;
+        bool wake = before == 0 || durability == Durability::Commit || pending.size() >= GATHER_BYTES;
+        bytes += static_cast<int64_t>(added);
+        ++appended;
+        if (wake) work_cv.notify_one(); // otherwise the writer is already gathering this batch
+        return appended;
+    }
+
+    // Blocks until the ticket is as durable as the mode promises (only COMMIT waits)
+    void commit(uint64_t ticket) {
+        std::unique_lock<std::mutex> lk(mtx);
+        done_cv.wait(lk, [&] { return durability != Durability::Commit || synced >= ticket || failed; });
+        if (failed && synced < ticket) throw std::runtime_error("WAL_WRITE_FAILED");
+    }
+
+    // Everything queued so far written and synced (before a checkpoint)
+    void sync() {
+        std::unique_lock<std::mutex> lk(mtx);
+        uint64_t target = appended;
+        if (synced >= target) return;
+        sync_target = std::max(sync_target, target);
+        work_cv.notify_one();
+        done_cv.wait(lk, [&] { return synced >= target || failed; });
+    }
+
+    // Empties the file down to a header whose next lsn is baseLsn. Callers hold the collection
+    // lock, so nothing new is queued meanwhile; records still pending are superseded by the
+    // snapshot just taken
+    void truncate(uint64_t baseLsn) {
+        std::unique_lock<std::mutex> lk(mtx);
+        done_cv.wait(lk, [&] { return !busy; });
+        pending.clear();
+        written = synced = appended;
+        bytes = 0;
+        if (!file.open(path, true)) std::cerr << "[WAL] Cannot reopen " << path << "\n";
+        else writeHeader(baseLsn);
+        done_cv.notify_all();
+    }
+
+    // Checkpoint fence (collection lock held): queued records go to the current file, which
+    // is renamed to sealedPath, and a fresh file starts at baseLsn. Except in NONE mode the
+    // sealed file is synced first, so its records' tickets stay honest. false = still on the
+    // old file
+    bool rotate(uint64_t baseLsn, const std::string& sealedPath) {
+        std::unique_lock<std::mutex> lk(mtx);
+        done_cv.wait(lk, [&] { return !busy; });
+        if (!file.isOpen()) return false;
+
+        std::vector<char> packed;
+        const std::vector<char>& out = encode(pending, packed, compress);
+        bool ok = out.empty() || file.write(out.data(), out.size());
+        if (ok) countWrite(pending.size(), out.size());
+        if (ok && synced < appended && (durability != Durability::None || sync_target > synced)) {
+            ok = file.sync();
+            if (ok) syncs++;
+        }
+        if (!ok) {
+            if (!failed) std::cerr << "[WAL] Write to " << path << " failed, further commits report WAL_WRITE_FAILED.\n";
+            failed = true;
+            done_cv.notify_all();
+            return false;
+        }
+        if (!pending.empty()) batches++;
+        pending.clear();
+        written = synced = appended;
+        file.close();
+
+        std::error_code ec;
+        std::filesystem::rename(path, sealedPath, ec);
+        if (ec) {
+            std::cerr << "[WAL] Cannot seal " << path << ": " << ec.message() << "\n";
+            if (file.open(path)) bytes = file.size();
+            done_cv.notify_all();
+            return false;
+        }
+        if (file.open(path, true)) writeHeader(baseLsn);
+        else std::cerr << "[WAL] Cannot reopen " << path << "\n";
+        done_cv.notify_all();
+        return true;
+    }
+
+    // Cuts a torn or corrupt tail found by recovery, so new frames follow the last good one
+    void discardTail(uint64_t validBytes) {
+        std::unique_lock<std::mutex> lk(mtx);
+        done_cv.wait(lk, [&] { return !busy; });
+        file.close();
+        std::error_code ec;
+        std::filesystem::resize_file(path, validBytes, ec);
+        if (ec) std::cerr << "[WAL] Cannot cut " << path << ": " << ec.message() << "\n";
+        if (file.open(path)) bytes = file.size();
+    }
+
+    void setDurability(Durability level, unsigned intervalMs = 0) {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            durability = level;
+            interval = std::chrono::milliseconds(intervalMs);
+        }
+        work_cv.notify_one();
+        done_cv.notify_all(); // COMMIT waiters are released when the mode is lowered
+    }
+
+    void setCompression(bool on) {
+        std::lock_guard<std::mutex> lk(mtx);
+        compress = on;
+    }
+
+    int64_t size() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        return bytes;
+    }
+
+    std::string toJson() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        const char* mode = durability == Durability::Commit ? "commit" : durability == Durability::Interval ? "interval" : "none";
+        std::string json = "{";
+        json += "\"durability\": \"" + std::string(mode) + "\", ";
+        json += "\"compression\": \"" + std::string(compress ? "lz4" : "none") + "\", ";
+        if (durability == Durability::Interval) json += "\"interval_ms\": " + std::to_string(interval.count()) + ", ";
+        json += "\"bytes\": " + std::to_string(bytes) + ", ";
+        json += "\"appends\": " + std::to_string(appended) + ", ";
+        json += "\"batches\": " + std::to_string(batches) + ", ";
+        json += "\"syncs\": " + std::to_string(syncs);
+        if (compress && stored_bytes) {
+            char ratio[32];
+            std::snprintf(ratio, sizeof(ratio), "%.2f", static_cast<double>(raw_bytes) / static_cast<double>(stored_bytes));
+            json += ", \"compression_ratio\": " + std::string(ratio);
+        }
+        json += "}";
+        return json;
+    }
+};
+
+}
+
+#endif